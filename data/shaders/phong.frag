@@ -1,5 +1,16 @@
 #version 330
 
+//variant defines (see ShaderVariants.h):
+//- USE_DIFFUSE_MAP, USE_SPECULAR_MAP: material has these textures
+//- NUM_LIGHTS n: scene has at most n lights, stored first in u_light_data and
+//  padded with black lights, so the loop has a constant count
+//- CLUSTERED_LIGHTS: lights are read from the cluster of the fragment
+//- TEXTURE_ARRAYS: textures are in the arrays of TextureAtlas, and colours,
+//  layers and uv rectangles are read from the material data
+#if !defined(NUM_LIGHTS) && !defined(CLUSTERED_LIGHTS)
+#define CLUSTERED_LIGHTS
+#endif
+
 //varyings and out color
 in vec2 v_uv;
 in vec3 v_normal;
@@ -8,6 +19,26 @@ in vec3 v_cam_dir;
 in vec3 v_vertex_world_pos;
 out vec4 fragColor;
 
+#ifdef TEXTURE_ARRAYS
+//5 texels per material, see TextureAtlas::uploadMaterialData
+uniform samplerBuffer u_material_data;
+flat in int v_material;
+
+#ifdef USE_DIFFUSE_MAP
+uniform sampler2DArray u_diffuse_map;
+#endif
+#ifdef USE_SPECULAR_MAP
+uniform sampler2DArray u_specular_map;
+#endif
+
+//samples a texture of an array. rect is the uv offset (xy) and scale (zw) of
+//the texture in its layer; gradients of the unwrapped uv keep mips right at
+//the wrap
+vec4 sampleArray(sampler2DArray tex, vec4 rect, float layer){
+	vec2 uv = rect.xy + fract(v_uv) * rect.zw;
+	return textureGrad(tex, vec3(uv, layer), dFdx(v_uv) * rect.zw, dFdy(v_uv) * rect.zw);
+}
+#else
 //basic material uniforms
 uniform vec3 u_ambient;
 uniform vec3 u_diffuse;
@@ -15,45 +46,118 @@ uniform vec3 u_specular;
 uniform float u_specular_gloss;
 
 //texture uniforms
+#ifdef USE_DIFFUSE_MAP
 uniform sampler2D u_diffuse_map;
+#endif
+#ifdef USE_SPECULAR_MAP
+uniform sampler2D u_specular_map;
+#endif
+#endif
+
+//lights - see LightClusters.h
+uniform samplerBuffer u_light_data; //2 texels per light: position + radius, color
+uniform vec3 u_cam_pos;
+
+#ifdef CLUSTERED_LIGHTS
+//dimensions must match LightClusters::DIM_X, DIM_Y and DIM_Z
+const int CLUSTERS_X = 16;
+const int CLUSTERS_Y = 8;
+const int CLUSTERS_Z = 24;
+uniform usamplerBuffer u_light_grid; //offset and count per cluster
+uniform usamplerBuffer u_light_indices;
+uniform vec3 u_cluster_z; //z slice = log(depth) * x + y
+uniform vec3 u_viewport;
+uniform vec3 u_cam_forward;
+
+//returns index of the cluster of this fragment
+int getCluster(){
+	float depth = max(dot(v_vertex_world_pos - u_cam_pos, u_cam_forward), 0.0001);
+	int slice = clamp(int(log(depth) * u_cluster_z.x + u_cluster_z.y), 0, CLUSTERS_Z - 1);
+	ivec2 tile = ivec2(gl_FragCoord.xy / u_viewport.xy * vec2(CLUSTERS_X, CLUSTERS_Y));
+	tile = clamp(tile, ivec2(0), ivec2(CLUSTERS_X - 1, CLUSTERS_Y - 1));
+	return tile.x + tile.y * CLUSTERS_X + slice * CLUSTERS_X * CLUSTERS_Y;
+}
+#endif
+
+//diffuse and specular light of one light
+//- diffuse, specular: material colours, multiplied by their maps
+vec3 shadeLight(int light, vec3 N, vec3 V, vec3 diffuse, vec3 specular, float gloss){
+	vec4 position_radius = texelFetch(u_light_data, light * 2);
+	vec3 light_color = texelFetch(u_light_data, light * 2 + 1).xyz;
 
-//light structs and uniforms
-struct PointLight {
-	vec3 position;
-	vec3 color;
-};
-const int MAX_LIGHTS = 8;
-uniform PointLight lights[MAX_LIGHTS];
-uniform int u_num_lights;
+	vec3 to_light = position_radius.xyz - v_vertex_world_pos;
+	float distance = length(to_light);
+	//smooth falloff to zero at the light radius
+	float falloff = clamp(1.0 - pow(distance / position_radius.w, 4.0), 0.0, 1.0);
+	falloff *= falloff;
 
+	vec3 L = to_light / distance; //to light
+	vec3 R = reflect(-L,N); //reflection vector
+
+	//diffuse color
+	float NdotL = max(0.0, dot(N, L));
+	vec3 diffuse_color = NdotL * diffuse * light_color;
+
+	//specular color
+	float RdotV = max(0.0, dot(R, V)); //calculate dot product
+	RdotV = pow(RdotV, gloss); //raise to power for glossiness effect
+	vec3 specular_color = RdotV * light_color * specular;
+
+	return (diffuse_color + specular_color) * falloff;
+}
 
 void main(){
 
+#ifdef TEXTURE_ARRAYS
+	int material = v_material * 5;
+	vec4 ambient_gloss = texelFetch(u_material_data, material);
+	vec4 diffuse_layer = texelFetch(u_material_data, material + 1);
+	vec4 specular_layer = texelFetch(u_material_data, material + 2);
+	vec3 ambient = ambient_gloss.xyz;
+	float gloss = ambient_gloss.w;
+	vec3 diffuse = diffuse_layer.xyz;
+	vec3 specular = specular_layer.xyz;
+#else
+	vec3 ambient = u_ambient;
+	float gloss = u_specular_gloss;
+	vec3 diffuse = u_diffuse;
+	vec3 specular = u_specular;
+#endif
+
+#if defined(USE_DIFFUSE_MAP) && defined(TEXTURE_ARRAYS)
+	vec3 diffuse_map = sampleArray(u_diffuse_map, texelFetch(u_material_data, material + 3), diffuse_layer.w).xyz;
+#elif defined(USE_DIFFUSE_MAP)
 	vec3 diffuse_map = texture(u_diffuse_map, v_uv).xyz;
+#else
+	vec3 diffuse_map = vec3(1.0);
+#endif
+#if defined(USE_SPECULAR_MAP) && defined(TEXTURE_ARRAYS)
+	vec3 specular_map = sampleArray(u_specular_map, texelFetch(u_material_data, material + 4), specular_layer.w).xyz;
+#elif defined(USE_SPECULAR_MAP)
+	vec3 specular_map = texture(u_specular_map, v_uv).xyz;
+#else
+	vec3 specular_map = vec3(1.0);
+#endif
+	diffuse *= diffuse_map;
+	specular *= specular_map;
 
 	//ambient light
-	vec3 final_color = u_ambient * diffuse_map;
-	
-	//loop lights
-	for (int i = 0; i < u_num_lights; i++){
-
-		vec3 L = normalize(lights[i].position - v_vertex_world_pos); //to light
-		vec3 N = normalize(v_normal); //normal
-		vec3 R = reflect(-L,N); //reflection vector
-		vec3 V = normalize(v_cam_dir); //to camera
-
-		//diffuse color
-		float NdotL = max(0.0, dot(N, L));
-		vec3 diffuse_color = NdotL * diffuse_map * u_diffuse * lights[i].color;
-
-		//specular color
-		float RdotV = max(0.0, dot(R, V)); //calculate dot product
-		RdotV = pow(RdotV, u_specular_gloss); //raise to power for glossiness effect
-		vec3 specular_color = RdotV * lights[i].color * u_specular;
-
-		//final color
-		final_color += diffuse_color + specular_color;
+	vec3 final_color = ambient * diffuse_map;
+
+	vec3 N = normalize(v_normal); //normal
+	vec3 V = normalize(v_cam_dir); //to camera
+
+#ifdef CLUSTERED_LIGHTS
+	//loop lights of this cluster only
+	uvec2 cluster = texelFetch(u_light_grid, getCluster()).xy;
+	for (uint i = 0u; i < cluster.y; i++){
+		int light = int(texelFetch(u_light_indices, int(cluster.x + i)).x);
+		final_color += shadeLight(light, N, V, diffuse, specular, gloss);
 	}
+#else
+	for (int i = 0; i < NUM_LIGHTS; i++)
+		final_color += shadeLight(i, N, V, diffuse, specular, gloss);
+#endif
 
 	fragColor = vec4(final_color, 1.0);
-}
\ No newline at end of file
+}
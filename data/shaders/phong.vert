@@ -1,30 +1,85 @@
 #version 330
 
+//variant defines (see ShaderVariants.h):
+//- INSTANCING: per-draw data is read from a buffer written by
+//  IndirectDrawBuffer, instead of from uniforms. The variant is built as
+//  #version 430 core, which has storage buffers
+//- TEXTURE_ARRAYS: the fragment shader reads the material data, so it needs
+//  the index of the material of the draw
+
 layout(location = 0) in vec3 a_vertex;
 layout(location = 1) in vec2 a_uv;
 layout(location = 2) in vec3 a_normal;
 
+#ifdef INSTANCING
+layout(location = 3) in uint a_draw_id;
+
+//must match PerDrawData in IndirectDrawBuffer.h
+struct PerDraw {
+	mat4 model;
+	vec4 normal_matrix[3];
+	uint material;
+};
+layout(std430) buffer PerDrawBuffer {
+	PerDraw draws[];
+};
+
+uniform mat4 u_vp;
+#else
 uniform mat4 u_mvp;
 uniform mat4 u_model;
 uniform mat4 u_normal_matrix;
+#endif
 uniform vec3 u_cam_pos; 
 
+//the depth pre-pass computes the same positions, see g_shader_depth_prepass_vertex
+invariant gl_Position;
+
 out vec2 v_uv;
 out vec3 v_normal;
 out vec3 v_vertex_world_pos;
 out vec3 v_cam_dir;
 
+#ifdef TEXTURE_ARRAYS
+#ifndef INSTANCING
+uniform int u_material;
+#endif
+flat out int v_material;
+#endif
+
 void main(){
 
 	v_uv = a_uv;
+
+#ifdef INSTANCING
+	PerDraw draw = draws[a_draw_id];
+
+	//rotate normal 
+	mat3 normal_matrix = mat3(draw.normal_matrix[0].xyz, draw.normal_matrix[1].xyz, draw.normal_matrix[2].xyz);
+	v_normal = normal_matrix * a_normal;
+
+	//calculate world position of current vertex
+	v_vertex_world_pos = (draw.model * vec4(a_vertex, 1.0)).xyz;
+
+	gl_Position = u_vp * vec4(v_vertex_world_pos, 1.0);
+#else
 	//rotate normal 
 	v_normal = (u_normal_matrix * vec4(a_normal, 1.0)).xyz;
 
 	//calculate world position of current vertex
 	v_vertex_world_pos = (u_model * vec4(a_vertex, 1.0)).xyz;
 
+	gl_Position = u_mvp * vec4(a_vertex, 1.0);
+#endif
+
+#ifdef TEXTURE_ARRAYS
+#ifdef INSTANCING
+	v_material = int(draw.material);
+#else
+	v_material = u_material;
+#endif
+#endif
+
 	//calculate direction to camera in world space
 	v_cam_dir = u_cam_pos - v_vertex_world_pos;
-
-	gl_Position = u_mvp * vec4(a_vertex, 1.0);
-}
\ No newline at end of file
+}
@@ -116,6 +116,7 @@ void Mesh::Save(rapidjson::Document& json, rapidjson::Value & entity)
         val2.SetString(material_name.c_str(), static_cast<rapidjson::SizeType>(material_name.length()), allocator);
         materials.PushBack(val2, allocator);
         obj.AddMember("materials", materials, allocator);
+        if (occluder) obj.AddMember("occluder", true, allocator);
     }
 
     entity.AddMember("render", obj, allocator);
@@ -135,6 +136,9 @@ void Mesh::debugRender() {
         ImGui::SameLine();
         std::string mesh_name = Game::get().getGraphicsSystem().geometries_[geometry].name;
         ImGui::Text(mesh_name.c_str());
+        Geometry& geom = Game::get().getGraphicsSystem().geometries_[geometry];
+        ImGui::Text("LOD: %d/%d (%d tris)", lod, geom.num_lods - 1, geom.lods[lod].num_indices / 3);
+        ImGui::Checkbox("Occluder", &occluder);
 		ImGui::AddSpace(0, 10);
 
         ImGui::Unindent(8);
@@ -170,6 +174,7 @@ void Mesh::debugRender() {
 			ImGui::Text("File:");
 			ImGui::SameLine();
 			ImGui::Text(material_name.c_str());
+			ImGui::Text("Shader: %s", Game::get().getGraphicsSystem().shaders_[mat.shader_id]->name.c_str());
 			ImGui::AddSpace(0, 10);
 			ImGui::Image((ImTextureID)(mat.diffuse_map), ImVec2(64, 64));
 			ImGui::SameLine();
@@ -196,14 +201,27 @@ void Mesh::debugRender() {
 
 void Light::Save(rapidjson::Document& json, rapidjson::Value & entity)
 {
-    // TO-DO
-    // Implement save on lights
+    rapidjson::Value obj(rapidjson::kObjectType);
+    rapidjson::Document::AllocatorType& allocator = json.GetAllocator();
+
+    {
+        rapidjson::Value light_color(rapidjson::kArrayType);
+        light_color.PushBack(color.x, allocator);
+        light_color.PushBack(color.y, allocator);
+        light_color.PushBack(color.z, allocator);
+        obj.AddMember("color", light_color, allocator);
+        obj.AddMember("radius", radius, allocator);
+    }
+
+    entity.AddMember("light", obj, allocator);
 }
 
 void Light::Load(rapidjson::Value & entity, int ent_id) {
 
     auto json_lc = entity["light"]["color"].GetArray();
     this->color = lm::vec3(json_lc[0].GetFloat(), json_lc[1].GetFloat(), json_lc[2].GetFloat());
+    if (entity["light"].HasMember("radius"))
+        this->radius = entity["light"]["radius"].GetFloat();
 }
 
 void Light::debugRender() {
@@ -213,6 +231,7 @@ void Light::debugRender() {
         if (ImGui::TreeNode("Light")) {
             ImGui::AddSpace(0, 5);
             ImGui::ColorPicker4("Color", &color.x);
+            ImGui::DragFloat("Radius", &radius, 0.1f, 0.0f, 10000.0f);
             ImGui::TreePop();
         }
     }
@@ -65,6 +65,8 @@ struct Transform : public Component, public lm::mat4 {
 struct Mesh : public Component {
     int geometry;
     int material;
+    int lod = 0; //current level of detail, selected each frame by GraphicsSystem
+    bool occluder = false; //hides other meshes in occlusion culling
 
     void Save(rapidjson::Document& json, rapidjson::Value & entity);
     void Load(rapidjson::Value & entity, int ent_id);
@@ -72,6 +74,13 @@ struct Mesh : public Component {
 };
 
 
+//how a camera decides to draw depth only before lighting, see GLRenderBackend
+enum DepthPrepassMode {
+	DepthPrepassOff,
+	DepthPrepassOn,
+	DepthPrepassAuto //when the measured overdraw is high
+};
+
 //Camera component
 // - position, forward and up vectors for rapid access
 // - view and projection matrices for camera
@@ -83,6 +92,7 @@ struct Camera : public Component {
 	lm::mat4 view_matrix;
 	lm::mat4 projection_matrix;
 	lm::mat4 view_projection;
+	DepthPrepassMode depth_prepass = DepthPrepassAuto;
 
 	//constructor that sets placeholder matrices
 	Camera() {
@@ -121,6 +131,7 @@ struct Camera : public Component {
 //Later will be developed extensively
 struct Light : public Component {
     lm::vec3 color;
+    float radius = 100.0f; //light has no effect beyond this distance
 
     void Save(rapidjson::Document& json, rapidjson::Value & entity);
     void Load(rapidjson::Value & entity, int ent_id);
@@ -197,7 +208,8 @@ struct GUIElement : public Component {
 	GLint height = 0;
 	GUIAnchor anchor = GUIAnchorCenter;
 	lm::vec2 offset;
-	ScreenBounds screen_bounds;
+	ScreenBounds screen_bounds; //updated when drawn
+	int layer = 0; //images are drawn in increasing layer, texts above them
 	std::function<void()> onClick;
 };
 
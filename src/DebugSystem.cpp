@@ -3,8 +3,11 @@
 #include "Parsers.h"
 #include "shaders_default.h"
 #include "Game.h"
+#include "render/DebugDraw.h"
+#include "render/RenderStats.h"
 
 DebugSystem::~DebugSystem() {
+	DebugDraw::shutdown();
 	delete grid_shader_;
 	delete icon_shader_;
 }
@@ -22,11 +25,12 @@ void DebugSystem::lateInit() {
 	icon_shader_ = new Shader();
 	icon_shader_->compileFromStrings(g_shader_icon_vertex, g_shader_icon_fragment);
 
+	//lines of frustra, colliders and other systems
+	DebugDraw::init();
+
 	//create geometries
 	createGrid_();
 	createIcon_();
-	createCube_();
-	createRay_();
 
 	//create texture for light icon
 	icon_light_texture_ = Parsers::parseTexture("data/assets/icon_light.tga");
@@ -60,132 +64,69 @@ void DebugSystem::update(float dt) {
 	//get the camera view projection matrix
 	lm::mat4 vp = ECS.getComponentInArray<Camera>(ECS.main_camera).view_projection;
 
-	//line drawing first
-	if (draw_grid_ || draw_frustra_ || draw_colliders_) {
-
-		//use line shader to draw all lines and boxes
+	if (draw_grid_) {
+		//set uniforms and draw grid
 		glUseProgram(grid_shader_->program);
-		GLint u_mvp = glGetUniformLocation(grid_shader_->program, "u_mvp");
-		GLint u_color = glGetUniformLocation(grid_shader_->program, "u_color");
-		GLint u_color_mod = glGetUniformLocation(grid_shader_->program, "u_color_mod");
-		GLint u_size_scale = glGetUniformLocation(grid_shader_->program, "u_size_scale");
-		GLint u_center_mod = glGetUniformLocation(grid_shader_->program, "u_center_mod");
-
-
-
-		if (draw_grid_) {
-			//set uniforms and draw grid
-			glUniformMatrix4fv(u_mvp, 1, GL_FALSE, vp.m);
-			glUniform3fv(u_color, 4, grid_colors);
-			glUniform3f(u_size_scale, 1.0, 1.0, 1.0);
-			glUniform3f(u_center_mod, 0.0, 0.0, 0.0);
-			glUniform1i(u_color_mod, 0);
-			glBindVertexArray(grid_vao_); //GRID
-			glDrawElements(GL_LINES, grid_num_indices, GL_UNSIGNED_INT, 0);
+		grid_shader_->setUniform(U_MVP, vp);
+		glUniform3fv(grid_shader_->getUniformLocation(U_COLOR), 4, grid_colors);
+		grid_shader_->setUniform(U_COLOR_MOD, 0);
+		glBindVertexArray(grid_vao_); //GRID
+		glDrawElements(GL_LINES, grid_num_indices, GL_UNSIGNED_INT, 0);
+		RenderStats::add(RenderStats::SHADER_BINDS);
+		RenderStats::add(RenderStats::DRAW_CALLS);
+	}
+
+	if (draw_frustra_) {
+		//draw frustra for all cameras but the current one
+		auto& cameras = ECS.getAllComponents<Camera>();
+		for (int i = 0; i < (int)cameras.size(); i++) {
+			if (i == ECS.main_camera) continue;
+			DebugDraw::frustum(cameras[i].view_projection, lm::vec3(1.0f, 0.5f, 0.5f));
 		}
+	}
 
-		if (draw_frustra_) {
-			//draw frustra for all cameras
-			auto& cameras = ECS.getAllComponents<Camera>();
-            int counter = 0;
-			for (auto& cc : cameras) {
-                //don't draw current camera frustum
-                if (counter == ECS.main_camera) continue;
-                counter++;
-                
-				lm::mat4 cam_iv = cc.view_matrix;
-				cam_iv.inverse();
-				lm::mat4 cam_ip = cc.projection_matrix;
-				cam_ip.inverse();
-				lm::mat4 cam_ivp = cc.view_projection;
-				cam_ivp.inverse();
-				lm::mat4 mvp = vp * cam_ivp;
-
-				//set uniforms and draw cube
-				glUniformMatrix4fv(u_mvp, 1, GL_FALSE, mvp.m);
-				glUniform1i(u_color_mod, 1); //set color to index 1 (red)
-				glBindVertexArray(cube_vao_); //CUBE
-				glDrawElements(GL_LINES, 24, GL_UNSIGNED_INT, 0);
+	if (draw_colliders_) {
+		//draw all colliders
+		auto& transforms = ECS.getAllComponents<Transform>();
+		auto& colliders = ECS.getAllComponents<Collider>();
+		for (auto& cc : colliders) {
+			//get transform for collider
+			Transform& tc = ECS.getComponentFromEntity<Transform>(cc.owner);
+			lm::mat4 collider_matrix = tc.getGlobalMatrix(transforms);
+			//move by the collider offset, as CollisionSystem does
+			collider_matrix.translateLocal(cc.local_center.x, cc.local_center.y, cc.local_center.z);
+
+			if (cc.collider_type == ColliderTypeBox) {
+				//convert -1 -> +1 box to size of collider box
+				collider_matrix.scaleLocal(cc.local_halfwidth.x, cc.local_halfwidth.y, cc.local_halfwidth.z);
+				DebugDraw::obb(collider_matrix, lm::vec3(0.5f, 1.0f, 0.5f));
 			}
-		}
 
-		if (draw_colliders_) {
-			//draw all colliders
-			auto& colliders = ECS.getAllComponents<Collider>();
-			for (auto& cc : colliders) {
-				//get transform for collider
-				Transform& tc = ECS.getComponentFromEntity<Transform>(cc.owner);
-				//get the colliders local model matrix in order to draw correctly
-				lm::mat4 collider_matrix = tc.getGlobalMatrix(ECS.getAllComponents<Transform>());
-
-				if (cc.collider_type == ColliderTypeBox) {
-
-					//now move by the box by its offset
-					collider_matrix.translateLocal(cc.local_center.x, cc.local_center.y, cc.local_center.z);
-					//convert -1 -> +1 geometry to size of collider box
-					collider_matrix.scaleLocal(cc.local_halfwidth.x, cc.local_halfwidth.y, cc.local_halfwidth.z);
-					//set mvp
-					lm::mat4 mvp = vp * collider_matrix;
-
-					//set uniforms and draw
-					glUniformMatrix4fv(u_mvp, 1, GL_FALSE, mvp.m);
-					glUniform1i(u_color_mod, 2); //set color to index 2 (green)
-					glBindVertexArray(cube_vao_); //CUBE
-					glDrawElements(GL_LINES, 24, GL_UNSIGNED_INT, 0);
-				}
-
-				if (cc.collider_type == ColliderTypeRay) {
-					//ray natively goes from (0,0,0 to 0,0,1) (see definition in createRay_())
-					//we need to rotate this vector so that it matches the direction specified by the component
-					//to do this we first need to find angle and axis between the two vectors
-					lm::vec3 buffer_vec(0, 0, 1);
-					lm::vec3 dir_norm = cc.direction;
-					dir_norm.normalize();
-					float rotation_angle = acos(dir_norm.dot(buffer_vec));
-					//if angle is PI, vector is opposite to buffer vec
-					//so rotation axis can be anything (we set it to 0,1,0 vector
-					lm::vec3 rotation_axis = lm::vec3(0, 1, 0);
-					//otherwise, we calculate rotation axis with cross product
-					if (rotation_angle < 3.14159f) {
-						rotation_axis = dir_norm.cross(buffer_vec).normalize();
-					}
-					//now we rotate the buffer vector to
-					if (rotation_angle > 0.00001f) {
-						//only rotate if we have to
-						collider_matrix.rotateLocal(rotation_angle, rotation_axis);
-					}
-					//apply distance scale
-					collider_matrix.scaleLocal(cc.max_distance, cc.max_distance, cc.max_distance);
-					//apply center offset
-					collider_matrix.translateLocal(cc.local_center.x, cc.local_center.y, cc.local_center.z);
-
-					//set uniforms
-					lm::mat4 mvp = vp * collider_matrix;
-					glUniformMatrix4fv(u_mvp, 1, GL_FALSE, mvp.m);
-					//set color to index 2 (green)
-					glUniform1i(u_color_mod, 3);
-
-					//bind the cube vao
-					glBindVertexArray(collider_ray_vao_);
-					glDrawElements(GL_LINES, 2, GL_UNSIGNED_INT, 0);
-				}
+			if (cc.collider_type == ColliderTypeRay) {
+				//rotate the direction into world space
+				lm::vec3 origin = collider_matrix.position();
+				lm::vec3 direction = collider_matrix * cc.direction - origin;
+				DebugDraw::ray(origin, direction, cc.max_distance, lm::vec3(0.5f, 0.5f, 1.0f));
 			}
 		}
 	}
 
+	//lines added by any system this frame, in one or two draw calls
+	DebugDraw::flush(vp, dt);
+
 	if (draw_icons_) {
 		//switch to icon shader
 		glUseProgram(icon_shader_->program);
+		RenderStats::add(RenderStats::SHADER_BINDS);
 
-		//get uniforms
-		GLint u_mvp = glGetUniformLocation(icon_shader_->program, "u_mvp");
-		GLint u_icon = glGetUniformLocation(icon_shader_->program, "u_icon");
-		glUniform1i(u_icon, 0);
+		//get uniforms. u_icon samples unit 0, its default
+		GLint u_mvp = icon_shader_->getUniformLocation(U_MVP);
 
 
 		//for each light - bind light texture
 		glActiveTexture(GL_TEXTURE0);
 		glBindTexture(GL_TEXTURE_2D, icon_light_texture_);
+		RenderStats::add(RenderStats::TEXTURE_BINDS);
 
 		auto& lights = ECS.getAllComponents<Light>();
 		for (auto& curr_light : lights) {
@@ -203,11 +144,15 @@ void DebugSystem::update(float dt) {
 			glUniformMatrix4fv(u_mvp, 1, GL_FALSE, bill_matrix.m);
 			glBindVertexArray(icon_vao_);
 			glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+			RenderStats::add(RenderStats::DRAW_CALLS);
+			RenderStats::add(RenderStats::TRIANGLES, 2);
+			RenderStats::add(RenderStats::INSTANCES);
 		}
 
 		//bind camera texture
 		glActiveTexture(GL_TEXTURE0);
 		glBindTexture(GL_TEXTURE_2D, icon_camera_texture_);
+		RenderStats::add(RenderStats::TEXTURE_BINDS);
 
 		//for each camera, exactly the same but with camera texture
 		auto& cameras = ECS.getAllComponents<Camera>();
@@ -221,6 +166,9 @@ void DebugSystem::update(float dt) {
 			glUniformMatrix4fv(u_mvp, 1, GL_FALSE, bill_matrix.m);
 			glBindVertexArray(icon_vao_);
 			glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+			RenderStats::add(RenderStats::DRAW_CALLS);
+			RenderStats::add(RenderStats::TRIANGLES, 2);
+			RenderStats::add(RenderStats::INSTANCES);
 
 		}
 	}
@@ -307,69 +255,6 @@ void DebugSystem::createIcon_() {
 	glBindVertexArray(0);
 }
 
-void DebugSystem::createRay_() {
-	//4th component is color
-	GLfloat icon_vertices[8]{ 0, 0, 0, 0,
-		0, 0, 1, 0 };
-	GLuint icon_indices[2]{ 0, 1 };
-	glGenVertexArrays(1, &collider_ray_vao_);
-	glBindVertexArray(collider_ray_vao_);
-	GLuint vbo;
-	//positions
-	glGenBuffers(1, &vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(icon_vertices), icon_vertices, GL_STATIC_DRAW);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
-	//indices
-	GLuint ibo;
-	glGenBuffers(1, &ibo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(icon_indices), icon_indices, GL_STATIC_DRAW);
-	//unbind
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
-}
-
-void DebugSystem::createCube_() {
-
-	//4th component is color!
-	const GLfloat quad_vertex_buffer_data[] = {
-		-1.0f,  -1.0f,  -1.0f,  0.0f,  //near bottom left
-		1.0f,   -1.0f,  -1.0f,  0.0f,   //near bottom right
-		1.0f,   1.0f,   -1.0f,  0.0f,    //near top right
-		-1.0f,  1.0f,   -1.0f,  0.0f,   //near top left
-		-1.0f,  -1.0f,  1.0f,   0.0f,   //far bottom left
-		1.0f,   -1.0f,  1.0f,   0.0f,    //far bottom right
-		1.0f,   1.0f,   1.0f,   0.0f,     //far top right
-		-1.0f,  1.0f,   1.0f,   0.0f,    //far top left
-	};
-
-	const GLuint quad_index_buffer_data[] = {
-		0,1, 1,2, 2,3, 3,0, //top
-		4,5, 5,6, 6,7, 7,4, // bottom
-		4,0, 7,3, //left
-		5,1, 6,2, //right
-	};
-
-	glGenVertexArrays(1, &cube_vao_);
-	glBindVertexArray(cube_vao_);
-
-	GLuint vbo;
-	glGenBuffers(1, &vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(quad_vertex_buffer_data), quad_vertex_buffer_data, GL_STATIC_DRAW);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
-
-	glGenBuffers(1, &vbo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quad_index_buffer_data), quad_index_buffer_data, GL_STATIC_DRAW);
-
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-}
-
 //creates the debug grid for our scene
 void DebugSystem::createGrid_() {
 
@@ -27,14 +27,7 @@ private:
 	bool draw_frustra_;
 	bool draw_colliders_;
 
-	//cube for frustra and boxes
-	void createCube_();
-	GLuint cube_vao_;
-
-	//colliders
-	void createRay_();
-	GLuint collider_ray_vao_;
-	GLuint collider_box_vao_;
+	//frustra and colliders are drawn with DebugDraw
 
 	//icons
 	void createIcon_();
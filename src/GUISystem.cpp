@@ -1,8 +1,18 @@
 #include "GUISystem.h"
 #include "extern.h"
-
-#include "ft2build.h"
-#include FT_FREETYPE_H
+#include "render/TextureStreamer.h"
+#include "render/RenderStats.h"
+#include <algorithm>
+#include <cstddef>
+
+GUISystem::~GUISystem() {
+	delete sprite_shader_;
+	delete text_shader_;
+	delete text_sdf_shader_;
+	glDeleteBuffers(1, &quad_vbo_);
+	glDeleteVertexArrays(1, &quad_vao_);
+	GlyphCache::shutdown();
+}
 
 void GUISystem::init(int w, int h) {
 	width_ = w;
@@ -11,11 +21,13 @@ void GUISystem::init(int w, int h) {
 	//create vp
 	view_projection.orthographic((float)-width_/2, (float)width_/2, (float)-height_/2, (float)height_/2, -0.5, -2);
 
-    icon_shader_ = new Shader();//"data/shaders/tmp.vert", "data/shaders/tmp.frag");
-    icon_shader_->compileFromStrings(g_shader_icon_vertex, g_shader_icon_fragment);
+    sprite_shader_ = new Shader();
+    sprite_shader_->compileFromStrings(g_shader_font_vertex, g_shader_sprite_fragment);
     
 	text_shader_ = new Shader();
 	text_shader_->compileFromStrings(g_shader_font_vertex, g_shader_font_fragment);
+	text_sdf_shader_ = new Shader();
+	text_sdf_shader_->compileFromStrings(g_shader_font_vertex, g_shader_font_sdf_fragment);
 	    
 	createGeometry_();
 }
@@ -26,117 +38,165 @@ void GUISystem::lateInit() {
 	for (auto& el : elements) {
 
 		//check to see if we have specified gui width and height, if not, set them according to texture
+		if (el.width == 0 || el.height == 0)
+			TextureStreamer::finish(el.texture);
 		glBindTexture(GL_TEXTURE_2D, el.texture);
 		if (el.width == 0)
 			glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &(el.width));
 		if (el.height == 0)
 			glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &(el.height));
 
-		//get screen coords of element
-		lm::mat4 model;
-		model.makeScaleMatrix((float)el.width / 2, (float)el.height / 2, 1.0f);
-		anchorModelMatrix_(el.anchor, el.width, el.height, model);
-		model.translate(el.offset.x, el.offset.y, 0);
-		lm::mat4 mvp = view_projection * model;
-		
-		lm::vec3 bl(-1, -1, 0);
-		lm::vec3 tr(1, 1, 0);
-
-		lm::vec3 blc = mvp * bl;
-		lm::vec3 trc = mvp * tr;
-
-		el.screen_bounds.x_min = (int)(((blc.x + 1) / 2) * width_);
-		el.screen_bounds.x_max = (int)(((trc.x + 1) / 2) * width_);
-		el.screen_bounds.y_min = (int)(height_ - ((trc.y + 1) / 2) * height_);
-		el.screen_bounds.y_max = (int)(height_ - ((blc.y + 1) / 2) * height_);
+		//screen bounds, so clicks work before the first frame
+		placeElement_(el, el.width, el.height);
 	}
 
-	//for all texts
+	//for all texts, rasterize the glyphs they start with
+	std::vector<TextVertex> vertices;
 	auto& text_elements = ECS.getAllComponents<GUIText>();
 	for (auto& el : text_elements) {
-		//check if texture has been created
-		if (el.texture == 0) {
-			el.texture = createTextTexture(el.text, el.font_face, el.font_size, el.width, el.height);
-		}
+		GlyphCache* cache = GlyphCache::get(el.font_face, el.font_size, sdf_text);
+		if (cache) cache->buildText(el.text, el.font_size, 0, 0, el.width, el.color, vertices);
 	}
 }
 void GUISystem::update(float dt) {
 
+	//images, then texts on top, as quads in one buffer
+	quad_vertices_.clear();
+	quad_batches_.clear();
+	addSprites_();
+	addTexts_();
+	if (quad_batches_.empty()) return;
+
+	size_t size = quad_vertices_.size() * sizeof(TextVertex);
+	glBindBuffer(GL_ARRAY_BUFFER, quad_vbo_);
+	//orphan the buffer, so we don't wait for the draws of last frame
+	if (size > quad_vbo_size_) quad_vbo_size_ = std::max(size, quad_vbo_size_ * 2);
+	glBufferData(GL_ARRAY_BUFFER, quad_vbo_size_, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, size, quad_vertices_.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	RenderStats::add(RenderStats::UPLOAD_BYTES, size);
+
 	//we draw GUI last, want it to be on top of everything
 	glDisable(GL_DEPTH_TEST);
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glActiveTexture(GL_TEXTURE0 + 10);
+	glBindVertexArray(quad_vao_);
+
+	Shader* current_shader = nullptr;
+	for (auto& batch : quad_batches_) {
+		if (batch.shader != current_shader) {
+			current_shader = batch.shader;
+			glUseProgram(current_shader->program);
+			current_shader->setUniform(U_MVP, view_projection);
+			current_shader->setUniform(U_ICON, 10);
+			RenderStats::add(RenderStats::SHADER_BINDS);
+		}
+		glBindTexture(GL_TEXTURE_2D, batch.texture);
+		glDrawArrays(GL_TRIANGLES, batch.first, batch.count);
+		RenderStats::add(RenderStats::TEXTURE_BINDS);
+		RenderStats::add(RenderStats::DRAW_CALLS);
+		RenderStats::add(RenderStats::TRIANGLES, batch.count / 3);
+	}
+	//one instance per image and glyph
+	RenderStats::add(RenderStats::INSTANCES, quad_vertices_.size() / 6);
 
-	//draw GUI images first
-	glUseProgram(icon_shader_->program);
-
-	//for all images
-	auto& elements = ECS.getAllComponents<GUIElement>();
-	for (auto& el : elements) {
-
-		//scale -1->+1 quad to size of image
-		lm::mat4 model;
-		model.makeScaleMatrix((float)el.width / 2, (float)el.height / 2, 1.0f);
-
-		//apply anchor
-		anchorModelMatrix_(el.anchor, el.width, el.height, model);
-
-		//apply offset
-		model.translate(el.offset.x, el.offset.y, 0);
-
-		//set uniforms
-		GLint u_mvp = glGetUniformLocation(icon_shader_->program, "u_mvp");
-		glUniformMatrix4fv(u_mvp, 1, GL_FALSE, (view_projection * model).m);
-
-		GLint u_icon = glGetUniformLocation(icon_shader_->program, "u_icon");
-		glUniform1i(u_icon, 10);
-
-		glActiveTexture(GL_TEXTURE0 + 10);
-		glBindTexture(GL_TEXTURE_2D, el.texture);
+	glBindVertexArray(0);
+	glEnable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+}
 
-		//draw
-		glBindVertexArray(vao_);
-		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+//starts a batch with the vertices from first, or extends the last one if it
+//uses the same texture and shader
+void GUISystem::addBatch_(GLuint texture, Shader* shader, size_t first) {
+	GLsizei count = (GLsizei)(quad_vertices_.size() - first);
+	if (count == 0) return;
+	if (!quad_batches_.empty() && quad_batches_.back().texture == texture && quad_batches_.back().shader == shader) {
+		quad_batches_.back().count += count;
+		return;
 	}
+	quad_batches_.push_back({ texture, shader, (GLint)first, count });
+}
 
-	//use a different shader for text
-	glUseProgram(text_shader_->program);
+//image quads in layer order and, within a layer, by texture, so elements
+//sharing a texture (or atlas page) are one draw
+void GUISystem::addSprites_() {
+	auto& elements = ECS.getAllComponents<GUIElement>();
+	sprite_order_.resize(elements.size());
+	for (size_t i = 0; i < elements.size(); i++) sprite_order_[i] = (int)i;
+	std::stable_sort(sprite_order_.begin(), sprite_order_.end(), [&](int a, int b) {
+		if (elements[a].layer != elements[b].layer) return elements[a].layer < elements[b].layer;
+		return elements[a].texture < elements[b].texture;
+	});
+
+	for (int i : sprite_order_) {
+		GUIElement& el = elements[i];
+		lm::vec2 top_left = placeElement_(el, el.width, el.height);
+		float x0 = top_left.x, x1 = top_left.x + el.width;
+		float y0 = top_left.y - el.height, y1 = top_left.y;
+		size_t first = quad_vertices_.size();
+		TextVertex bl = { x0, y0, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+		TextVertex br = { x1, y0, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+		TextVertex tr = { x1, y1, 1.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+		TextVertex tl = { x0, y1, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+		quad_vertices_.insert(quad_vertices_.end(), { bl, br, tr, bl, tr, tl });
+		addBatch_(el.texture, sprite_shader_, first);
+	}
+}
 
-	//for all texts
+//quads of texts are rebuilt every frame from cached glyphs, so texts can
+//change freely. One batch per glyph cache: per font with distance fields,
+//per font and size otherwise
+void GUISystem::addTexts_() {
 	auto& text_elements = ECS.getAllComponents<GUIText>();
-	for (auto& el : text_elements) {
-
-		//scale -1->+1 quad to size of image
-		lm::mat4 model;
-		model.makeScaleMatrix((float)el.width / 2, (float)el.height / 2, 1.0f);
-
-		//apply anchor
-		anchorModelMatrix_(el.anchor, el.width, el.height, model);
-
-		//apply offset
-		model.translate(el.offset.x, el.offset.y, 0);
-
-		//set uniforms
-		GLint u_mvp = glGetUniformLocation(text_shader_->program, "u_mvp");
-		glUniformMatrix4fv(u_mvp, 1, GL_FALSE, (view_projection * model).m);
+	if (text_elements.empty()) return;
 
-		GLint u_color = glGetUniformLocation(text_shader_->program, "u_color");
-		glUniform3fv(u_color, 1, el.color.value_);
-
-		GLint u_icon = glGetUniformLocation(text_shader_->program, "u_icon");
-		glUniform1i(u_icon, 10);
-
-		glActiveTexture(GL_TEXTURE0 + 10);
-		glBindTexture(GL_TEXTURE_2D, el.texture);
-
-		//draw
-		glBindVertexArray(vao_);
-		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+	for (auto& batch : text_batches_) batch.second.clear();
+	for (auto& el : text_elements) {
+		GlyphCache* cache = GlyphCache::get(el.font_face, el.font_size, sdf_text);
+		if (!cache) continue;
+		auto batch = std::find_if(text_batches_.begin(), text_batches_.end(),
+			[cache](const std::pair<GlyphCache*, std::vector<TextVertex>>& b) { return b.first == cache; });
+		if (batch == text_batches_.end()) {
+			text_batches_.emplace_back(cache, std::vector<TextVertex>());
+			batch = text_batches_.end() - 1;
+		}
+		std::vector<TextVertex>& vertices = batch->second;
+		size_t first = vertices.size();
+		lm::vec2 size = cache->buildText(el.text, el.font_size, 0, 0, el.width, el.color, vertices);
+
+		//anchor the text box: the element size if set, otherwise the text size
+		int box_width = el.width ? el.width : (int)size.x;
+		int box_height = el.height ? el.height : (int)size.y;
+		lm::vec2 top_left = placeElement_(el, box_width, box_height);
+		//glyph quads grow down from (0, 0), the view grows up
+		for (size_t i = first; i < vertices.size(); i++) {
+			vertices[i].x += top_left.x;
+			vertices[i].y = top_left.y - vertices[i].y;
+		}
 	}
 
-	glEnable(GL_DEPTH_TEST);
-	glDisable(GL_BLEND);
+	for (auto& batch : text_batches_) {
+		size_t first = quad_vertices_.size();
+		quad_vertices_.insert(quad_vertices_.end(), batch.second.begin(), batch.second.end());
+		addBatch_(batch.first->getTexture(), batch.first->isSdf() ? text_sdf_shader_ : text_shader_, first);
+	}
+}
 
+lm::vec2 GUISystem::placeElement_(GUIElement& el, int el_width, int el_height) {
+	lm::mat4 model;
+	anchorModelMatrix_(el.anchor, el_width, el_height, model);
+	model.translate(el.offset.x, el.offset.y, 0);
+	//whole pixels, so images and glyphs are not filtered
+	float left = floorf(model.m[12] - el_width / 2.0f);
+	float top = floorf(model.m[13] + el_height / 2.0f);
+
+	//view space is centered with y up, screen space has y down
+	el.screen_bounds.x_min = (int)left + width_ / 2;
+	el.screen_bounds.x_max = (int)left + el_width + width_ / 2;
+	el.screen_bounds.y_min = height_ / 2 - (int)top;
+	el.screen_bounds.y_max = height_ / 2 - (int)top + el_height;
+	return lm::vec2(left, top);
 }
 
 void GUISystem::anchorModelMatrix_(GUIAnchor anchor, int el_width, int el_height, lm::mat4& model) {
@@ -176,93 +236,6 @@ void GUISystem::anchorModelMatrix_(GUIAnchor anchor, int el_width, int el_height
 	}
 }
 
-GLuint GUISystem::createTextTexture(std::string text, std::string font_path, int font_size, int tex_width, int tex_height) {
-
-	//initialise freetype
-	FT_Library ft;
-	FT_Init_FreeType(&ft);
-
-	//load a font-face
-	FT_Face face;
-	FT_New_Face(ft, font_path.c_str(), 0, &face);
-
-	// width and height - width of 0 = automatic
-	FT_Set_Pixel_Sizes(face, 0, font_size);
-
-	GLuint texture_id;
-	//create texture according to size
-	glGenTextures(1, &texture_id);
-	glBindTexture(GL_TEXTURE_2D, texture_id);
-
-	// disable default 4-byte alignment as freetype creates textures as single byte greyscale
-	// so set byte-alignment to 1
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-	//we will create an 'empty' arrayi.e. all values 0, the same size as
-	//our texture, with an 8-bit type (unsigned char) and set it all to zero.
-	std::vector<unsigned char> empty_data(tex_width * tex_height, 0);
-
-	//create gl texture. Freetype glyphs are 8-bit greyscale intensities. So we will create a single chanel
-	//(GL_RED) texture which stores GL_UNSIGNED_BYTEs.
-	//data pointer (last argument) is to our empty array (if we pass 0 as final parameter, the data will be random!)
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, tex_width, tex_height, 0, GL_RED, GL_UNSIGNED_BYTE, &(empty_data[0]));
-
-	//first loop to get height of highest glyph in string
-	int maxY = 0;
-	for (char& c : text) {
-		FT_Load_Char(face, c, FT_LOAD_RENDER);
-		if (face->glyph->metrics.horiBearingY > maxY)
-			maxY = face->glyph->metrics.horiBearingY;
-	}
-
-	//Freetype units are 1/64th of a pixel, bit-shifting an int by 6 bits divides it by 64 :)
-	maxY = maxY >> 6;
-
-	//now draw to openGL texture.
-	//loop our string again, loading the glyphs and copying their data to the 'relevant' part of the gl texture
-	//using glTexSubImage2D. 
-	int x = 0; //current position in x (from left)
-	int y = 0; //current position in y (from top)
-	int lineY = 0;
-	for (char& c : text) {
-		//newline character means reset x and advance y by a line, then skip character
-		if (c == '\n' || c == '\r') {
-			x = 0;
-			lineY += face->glyph->metrics.vertAdvance >> 6;
-			continue;
-		}
-		//load glyph
-		FT_Load_Char(face, c, FT_LOAD_RENDER);
-		//set y to correct height
-		y = lineY + maxY - face->glyph->bitmap_top;
-		//draw only a portion of the image
-		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, face->glyph->bitmap.width, face->glyph->bitmap.rows, GL_RED, GL_UNSIGNED_BYTE, face->glyph->bitmap.buffer);
-		//advance x by horizontal advance
-		x += face->glyph->metrics.horiAdvance >> 6;
-		//if x is wider than texture, newline
-		if (x > tex_width) {
-			x = 0;
-			lineY += face->glyph->metrics.vertAdvance >> 6;
-		}
-	}
-
-	// Set texture filtering options because we're not using mipmaps
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	//unbind texture
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	//reset alignment
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-
-	//clean up free type
-	FT_Done_Face(face);
-	FT_Done_FreeType(ft);
-
-	//return
-	return texture_id;
-}
-
 void GUISystem::key_mouse_callback(int key, int action, int mods) {
 	if (key == GLFW_MOUSE_BUTTON_1 && action == GLFW_PRESS) {
 
@@ -282,37 +255,21 @@ void GUISystem::updateViewport(int new_width, int new_height) {
 	view_projection.orthographic((float)-width_ / 2, (float)width_ / 2, (float)-height_ / 2, (float)height_ / 2, -0.5, -2);
 }
 
+//dynamic buffer of image and glyph quads, see update
 void GUISystem::createGeometry_() {
-	std::vector<GLfloat> vertices, uvs;
-	std::vector<GLuint> indices;
-	vertices = { -1.0f, -1.0f, 1.0f, 
-		1.0f, -1.0f, 1.0f, 
-		1.0f, 1.0f, 1.0f, 
-		-1.0f, 1.0f, 1.0f };
-	uvs = { 0.0f, 1.0f,   1.0f, 1.0f,    1.0f, 0.0f,   0.0f, 0.0f };
-	indices = { 0, 1, 2, 0, 2, 3 };
-
-	//generate the OpenGL buffers and create geometry
-	glGenVertexArrays(1, &vao_);
-	glBindVertexArray(vao_);
-	GLuint vbo;
+	glGenVertexArrays(1, &quad_vao_);
+	glBindVertexArray(quad_vao_);
+	glGenBuffers(1, &quad_vbo_);
+	glBindBuffer(GL_ARRAY_BUFFER, quad_vbo_);
 	//positions
-	glGenBuffers(1, &vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &(vertices[0]), GL_STATIC_DRAW);
 	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, x));
 	//texture coords
-	glGenBuffers(1, &vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(float), &(uvs[0]), GL_STATIC_DRAW);
 	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
-	//indices
-	GLuint ibo;
-	glGenBuffers(1, &ibo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &(indices[0]), GL_STATIC_DRAW);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, u));
+	//colors
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, r));
 	//unbind
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindVertexArray(0);
@@ -2,32 +2,56 @@
 #include "includes.h"
 #include "Components.h"
 #include "Shader.h"
-
-#include "ft2build.h"
-#include FT_FREETYPE_H
+#include "render/GlyphCache.h"
+#include <vector>
 
 class GUISystem {
 public:
+	~GUISystem();
 	void init(int w, int h);
 	void lateInit();
 	void update(float dt);
 
 	void updateViewport(int new_width, int new_height);
 
-	GLuint createTextTexture(std::string text, std::string font_path, int font_size, int tex_width, int tex_height);
-
 	void updateMousePosition(int new_x, int new_y) { mouse_x_ = new_x; mouse_y_ = new_y; };
 	void key_mouse_callback(int key, int action, int mods);
+
+	//texts use one distance field atlas per font, for all sizes, instead of
+	//one bitmap atlas per font and size
+	bool sdf_text = true;
 	
 private:
 	int width_, height_;
-	GLuint vao_;
-	Shader* icon_shader_;
+	Shader* sprite_shader_;
     Shader* text_shader_;
-	void createGeometry_();
+    Shader* text_sdf_shader_;
 	lm::mat4 view_projection;
 
+	//images and texts are quads in one dynamic buffer, drawn in batches
+	struct QuadBatch {
+		GLuint texture;
+		Shader* shader;
+		GLint first;
+		GLsizei count;
+	};
+	GLuint quad_vao_ = 0;
+	GLuint quad_vbo_ = 0;
+	size_t quad_vbo_size_ = 0; //bytes
+	std::vector<TextVertex> quad_vertices_; //sprites use the text vertex format
+	std::vector<QuadBatch> quad_batches_;
+	std::vector<int> sprite_order_;
+	//text quads of each glyph cache, before they are appended. Kept in the
+	//order caches were first used, so fonts are always drawn in the same order
+	std::vector<std::pair<GlyphCache*, std::vector<TextVertex>>> text_batches_;
+	void createGeometry_();
+	void addSprites_();
+	void addTexts_();
+	void addBatch_(GLuint texture, Shader* shader, size_t first);
+
 	int mouse_x_; int mouse_y_;
 
 	void anchorModelMatrix_(GUIAnchor anchor, int el_width, int el_height, lm::mat4& model);
+	//places an element, and sets its screen bounds. Returns its top left, in view space
+	lm::vec2 placeElement_(GUIElement& el, int el_width, int el_height);
 };
@@ -9,6 +9,10 @@
 #include "extern.h"
 #include "Parsers.h"
 #include "render/RenderToTexture.h"
+#include "render/ShaderCache.h"
+#include "render/FrameGraph.h"
+#include "render/RenderStats.h"
+#include "tools/Profiler.h"
 
 Game* Game::game_instance = nullptr;
 
@@ -20,6 +24,11 @@ Game::Game() {
 //Nothing here yet
 void Game::init(int window_width, int window_height) {
 
+	double start_time = glfwGetTime();
+
+	//must be ready before any system compiles a shader
+	ShaderCache::init("data/shaders/program_cache.bin");
+
 	//******* INIT SYSTEMS *******
 
 	//init systems except debug, which needs info about scene
@@ -44,7 +53,13 @@ void Game::init(int window_width, int window_height) {
     script_system_.lateInit();
     debug_system_.lateInit();
 
-    main_buffer = new RenderToTexture("main_buffer", window_width, window_height);
+    //shaders were compiled in the background while loading, wait for any left
+    //and save new program binaries
+    Shader::finishPending();
+    std::cout << "Startup: " << (int)((glfwGetTime() - start_time) * 1000.0) << " ms, "
+              << (!ShaderCache::isEnabled() ? "disabled" : ShaderCache::getMisses() ? "cold" : "warm") << " shader cache ("
+              << ShaderCache::getHits() << " programs loaded, "
+              << ShaderCache::getMisses() << " compiled)" << std::endl;
 }
 
 // Temporal render to texture
@@ -52,41 +67,115 @@ void Game::init(int window_width, int window_height) {
 
 //update each system in turn
 void Game::update(float dt) {
+	Profiler::beginFrame();
 
 	//update input
-	control_system_.update(dt);
+	{
+		Profiler::Zone zone("control");
+		control_system_.update(dt);
+	}
 
 	//collision
-	collision_system_.update(dt);
+	{
+		Profiler::Zone zone("collision");
+		collision_system_.update(dt);
+	}
 
 	//scripts
-	script_system_.update(dt);
+	{
+		Profiler::Zone zone("scripts");
+		script_system_.update(dt);
+	}
 
-    // Rendering modules
+    // Components
     {
-        if (editor_system_.GetEditorStatus()) {
-            main_buffer->Activate();
-            graphics_system_.update(dt);
-            debug_system_.update(dt);
-            main_buffer->Deactivate();
-        }
-        else {
-            graphics_system_.update(dt);
-            debug_system_.update(dt);
-        }
+        Profiler::Zone zone("components");
+        ECS.update(dt);
     }
 
-    // render character avatar
+    // Rendering modules: scene, debug, GUI and editor. Passes are zones too
+    render_(dt);
 
-    // Components
-    ECS.update(dt);
+    //variants compiled this frame (instancing, light buckets) are kept for the next run
+    ShaderCache::save();
 
-	// GUI
-	gui_system_.update(dt);
+    Profiler::endFrame();
+}
 
-    // Editor window
-    editor_system_.update(dt);
+//The editor shows the scene in its render window, so it is rendered to a
+//target of exactly the size of that window. Otherwise it goes straight to the
+//window, unless dynamic resolution lowers the scale: then it is rendered
+//smaller and stretched to the window
+//In editor idle mode the scene is kept in a target of its own, and its
+//passes are only added when EditorIdle sees a change
+void Game::render_(float dt) {
+	bool editor = !headless && editor_system_.GetEditorStatus();
+	bool idle = editor && EditorIdle::isEnabled();
+	DynamicResolution& resolution = graphics_system_.getDynamicResolution();
+	//idle frames are long because the loop waited, not because rendering is slow
+	if (!idle) resolution.Update(dt * 1000.0f);
+
+	int output_width = window_width_, output_height = window_height_;
+	if (editor && editor_system_.render_size.x >= 1.0f && editor_system_.render_size.y >= 1.0f) {
+		output_width = (int)editor_system_.render_size.x;
+		output_height = (int)editor_system_.render_size.y;
+	}
+	setCameraAspect_((float)output_width / (float)output_height);
+
+	FrameGraph& graph = graphics_system_.getFrameGraph();
+	graph.reset();
+	FrameResource window = graph.importWindow(window_width_, window_height_);
+	FrameResource scene = window;
+	bool render_scene = true;
+	if (idle) {
+		int width = resolution.Scaled(output_width), height = resolution.Scaled(output_height);
+		render_scene = EditorIdle::updateScene(graphics_system_, width, height);
+		if (!idle_scene_) idle_scene_.reset(new RenderToTexture("idle scene", width, height));
+		idle_scene_->Resize(width, height);
+		scene = graph.importTarget("scene", idle_scene_.get());
+	}
+	else if (editor || resolution.GetScale() < 1.0f)
+		scene = graph.createTarget("scene", resolution.Scaled(output_width), resolution.Scaled(output_height));
+
+	if (render_scene) {
+		graph.addPass("scene", {}, { scene }, [&](FrameGraph&) {
+			graphics_system_.update(dt);
+		});
+		graph.addPass("debug", {}, { scene }, [&](FrameGraph&) {
+			debug_system_.update(dt);
+		});
+	}
+	if (scene != window && !editor) {
+		graph.addPass("upscale", { scene }, { window }, [&](FrameGraph& g) {
+			g.getTarget(scene)->BlitToScreen(window_width_, window_height_);
+		});
+	}
+	graph.addPass("gui", {}, { window }, [&](FrameGraph&) {
+		gui_system_.update(dt);
+	});
+	//ImGui windows, including the render window showing the scene
+	if (!headless) {
+		graph.addPass("editor", { scene }, { window }, [&](FrameGraph& g) {
+			main_buffer = g.getTarget(scene);
+			editor_system_.update(dt);
+		});
+	}
 
+	graph.compile();
+	RenderStats::beginFrame();
+	graph.execute();
+	RenderStats::endFrame();
+	graphics_system_.getRenderTargets().EndFrame();
+}
+
+//sets the projection of all cameras, if the aspect changed
+void Game::setCameraAspect_(float aspect) {
+	if (aspect == camera_aspect_) return;
+	camera_aspect_ = aspect;
+	auto& cameras = ECS.getAllComponents<Camera>();
+	for (auto& cam : cameras) {
+		cam.setPerspective(60.0f*DEG2RAD, aspect, 0.01f, 10000.0f);
+	}
 }
 
 //update game viewports
@@ -94,12 +183,10 @@ void Game::update_viewports(int window_width, int window_height) {
 	window_width_ = window_width;
 	window_height_ = window_height;
 
-	auto& cameras = ECS.getAllComponents<Camera>();
-	for (auto& cam : cameras) {
-		cam.setPerspective(60.0f*DEG2RAD, (float)window_width_ / (float) window_height_, 0.01f, 10000.0f);
-	}
+	setCameraAspect_((float)window_width_ / (float) window_height_);
 
 	graphics_system_.updateMainViewport(window_width_, window_height_);
+	EditorIdle::invalidate();
 }
 
 int Game::createFree_(float aspect, ControlSystem& sys) {
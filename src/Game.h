@@ -13,6 +13,8 @@
 #include "ScriptSystem.h"
 #include "GUISystem.h"
 #include "tools/EditorSystem.h"
+#include "tools/EditorIdle.h"
+#include <memory>
 
 class RenderToTexture;
 
@@ -21,7 +23,11 @@ class Game
 public:
 
     unsigned int fps;
-    RenderToTexture * main_buffer;
+    //target the scene was rendered to this frame, shown by the editor. Set by
+    //the editor pass of the frame graph, null while rendering to the window
+    RenderToTexture * main_buffer = nullptr;
+    //no editor or ImGui, see tools/Headless.h
+    bool headless = false;
 
 	Game();
 	void init(int window_width, int window_height);
@@ -29,6 +35,11 @@ public:
 
     static Game* game_instance;
 
+    //seconds the main loop may wait for input, see EditorIdle
+    double getEventWait() {
+        return !headless && editor_system_.GetEditorStatus() ? EditorIdle::getWaitTime() : 0.0;
+    }
+
     static Game& get() {
         assert(game_instance);
         return *game_instance;
@@ -76,7 +87,8 @@ public:
 	void mouse_button_callback(int button, int action, int mods) {
 
         if (editor_system_.GetRenderStatus()) {
-            editor_system_.SetPickingRay(mouse_x_, mouse_y_, editor_system_.render_size.x, editor_system_.render_size.y);
+            editor_system_.SetPickingRay(mouse_x_ - (int)editor_system_.render_pos.x, mouse_y_ - (int)editor_system_.render_pos.y,
+                (int)editor_system_.render_size.x, (int)editor_system_.render_size.y);
         }
 
 		if (!editor_system_.GetEditorStatus() || editor_system_.GetRenderStatus()) {
@@ -101,6 +113,13 @@ private:
 	int createFree_(float aspect, ControlSystem& sys);
 	int createPlayer_(float aspect, ControlSystem& sys);
 
+	//declares and runs the render passes of the frame
+	void render_(float dt);
+	float camera_aspect_ = 0.0f;
+	//scene of the editor in idle mode, kept while nothing changes
+	std::unique_ptr<RenderToTexture> idle_scene_;
+	void setCameraAspect_(float aspect);
+
 	int window_width_;
 	int window_height_;
 	int mouse_x_;
@@ -9,11 +9,23 @@
 #include "rapidjson/document.h"
 #include "rapidjson/istreamwrapper.h"
 #include <fstream>
+#include "Parallel.h"
+#include "render/MeshOptimizer.h"
+#include "render/MeshSimplifier.h"
+#include "render/TextureStreamer.h"
+#include "render/RenderStats.h"
+#include "tools/Profiler.h"
+#include <tuple>
 
 std::unordered_map<std::string, int> Material::materials;
+std::unordered_map<uint64_t, int> Material::material_hashes;
 std::unordered_map<std::string, int> Material::textures;
 std::unordered_map<std::string, int> Geometry::geometries;
 
+GraphicsSystem::GraphicsSystem() : frame_graph_(render_targets_), gl_backend_(*this) {
+	backend_ = &gl_backend_;
+}
+
 //destructor
 GraphicsSystem::~GraphicsSystem() {
 	//delete shader pointers
@@ -21,6 +33,7 @@ GraphicsSystem::~GraphicsSystem() {
 		if (shader_pair.second)
 			delete shader_pair.second;
 	}
+	TextureStreamer::shutdown();
 }
 
 //set initial state of graphics system
@@ -33,13 +46,99 @@ void GraphicsSystem::init(int window_width, int window_height) {
 
     glEnable(GL_CULL_FACE); //enable culling
     glCullFace(GL_BACK); //which face to cull
+
+    //all geometry is stored in shared buffers
+    geometry_arena_.init();
 }
 
 //called after loading everything
 void GraphicsSystem::lateInit() {
 
+	//all materials and lights are loaded, so we can pick shader variants
+	selectShaderVariants_();
+
 	//sort meshes by shader and material
     sortMeshes_();
+
+    initMultiDraw_();
+}
+
+//enables multi-draw if driver supports it. The multi-draw versions of the
+//shaders are their INSTANCING variants, see selectShaderVariants_
+void GraphicsSystem::initMultiDraw_() {
+    if (!multiDrawSupported()) {
+        std::cout << "Multi-draw indirect not supported, drawing meshes one by one" << std::endl;
+        return;
+    }
+    gl_backend_.setMultiDraw(true);
+}
+
+//variant key for a material, before masking with the features of its shader
+uint32_t GraphicsSystem::materialVariantKey_(const Material& mat) {
+	uint32_t key = light_bucket_;
+	if (mat.diffuse_map != -1) key |= SHADER_DIFFUSE_MAP;
+	if (mat.specular_map != -1) key |= SHADER_SPECULAR_MAP;
+	//textures in the atlas are read from arrays, which can be shared by many materials
+	bool in_atlas = (mat.diffuse_map != -1 || mat.specular_map != -1) &&
+		(mat.diffuse_map == -1 || texture_atlas_.find(mat.diffuse_map)) &&
+		(mat.specular_map == -1 || texture_atlas_.find(mat.specular_map));
+	if (in_atlas) key |= SHADER_TEXTURE_ARRAYS;
+	return key;
+}
+
+//points every material to the shader variant matching its textures and the
+//number of lights, and registers the INSTANCING variants for multi-draw
+void GraphicsSystem::selectShaderVariants_() {
+	light_bucket_ = ShaderVariants::lightBucket((int)ECS.getAllComponents<Light>().size());
+	bool multi_draw = multiDrawSupported();
+	for (auto& mat : materials_) {
+		if (mat.base_shader_id == -1) mat.base_shader_id = mat.shader_id;
+		auto it = program_variants_.find(mat.shader_id);
+		if (it == program_variants_.end()) continue;
+		mat.variant_key = materialVariantKey_(mat) & it->second->getFeatures();
+		mat.shader_id = getShaderVariant(mat.shader_id, mat.variant_key);
+
+		if (!multi_draw || !(it->second->getFeatures() & SHADER_INSTANCING)) continue;
+		GLuint instanced = getShaderVariant(mat.shader_id, mat.variant_key | SHADER_INSTANCING);
+		if (shaders_[instanced]->finishLink())
+			gl_backend_.addMultiDrawProgram(mat.shader_id, instanced);
+		else
+			std::cerr << "ERROR: Could not build multi-draw shader " << shaders_[instanced]->name << std::endl;
+	}
+	assignMaterialBuckets_();
+	variants_dirty_ = false;
+}
+
+//materials whose variant reads their textures from the same arrays, and their
+//colours from the material data, only differ by per-draw data, so they share
+//a bucket: the index of the first of them
+void GraphicsSystem::assignMaterialBuckets_() {
+	std::map<std::tuple<int, GLuint, GLuint>, int> buckets; //shader, diffuse array, specular array
+	for (size_t i = 0; i < materials_.size(); i++) {
+		Material& mat = materials_[i];
+		mat.bucket = (int)i;
+		if (!(mat.variant_key & SHADER_TEXTURE_ARRAYS)) continue;
+		const AtlasSlot* diffuse = mat.diffuse_map != -1 ? texture_atlas_.find(mat.diffuse_map) : nullptr;
+		const AtlasSlot* specular = mat.specular_map != -1 ? texture_atlas_.find(mat.specular_map) : nullptr;
+		auto key = std::make_tuple(mat.shader_id, diffuse ? diffuse->array : 0, specular ? specular->array : 0);
+		mat.bucket = buckets.emplace(key, (int)i).first->second;
+	}
+}
+
+//packs the textures of materials whose shader can read them from arrays
+void GraphicsSystem::buildTextureAtlas_() {
+	std::vector<GLuint> textures;
+	for (auto& mat : materials_) {
+		auto it = program_variants_.find(mat.shader_id);
+		if (it == program_variants_.end() || !(it->second->getFeatures() & SHADER_TEXTURE_ARRAYS)) continue;
+		if (mat.diffuse_map != -1) textures.push_back(mat.diffuse_map);
+		if (mat.specular_map != -1) textures.push_back(mat.specular_map);
+	}
+	int packed = texture_atlas_.build(textures);
+	std::cout << "Texture atlas: " << packed << " textures in " << texture_atlas_.getNumArrays() << " arrays" << std::endl;
+	atlas_dirty_ = false;
+	//materials move to the TEXTURE_ARRAYS variants
+	variants_dirty_ = true;
 }
 
 void GraphicsSystem::updateMainViewport(int window_width, int window_height) {
@@ -68,6 +167,10 @@ void GraphicsSystem::sortMeshes_(){
     for (size_t i = 0; i < materials_.size(); i++){
         old_new[materials_[i].index] = (int)i;
     }
+
+    //loaded material caches point to the new indices
+    for (auto& loaded : Material::materials) loaded.second = old_new[loaded.second];
+    for (auto& loaded : Material::material_hashes) loaded.second = old_new[loaded.second];
     
     //now we swap index of materials in all meshes
     auto& meshes = ECS.getAllComponents<Mesh>();
@@ -99,21 +202,25 @@ void GraphicsSystem::sortMeshes_(){
         int new_index = old_new[old_index];
         ent.components[type2int<Mesh>::result] = new_index;
     }
+
+    //buckets are material indices
+    assignMaterialBuckets_();
 }
 
-void GraphicsSystem::checkShaderAndMaterial(Mesh& mesh) {
-    //get shader id from material. if same, don't change
-    if (!shader_ || shader_->program != materials_[mesh.material].shader_id) {
-		useShader(materials_[mesh.material].shader_id);
-    }
-    //set material uniforms if required
-    if (current_material_ != mesh.material) {
-        current_material_ = mesh.material;
-        setMaterialUniforms();
-    }
+bool GraphicsSystem::isLoading() {
+	return atlas_dirty_ || TextureStreamer::getPending() > 0;
 }
 
 void GraphicsSystem::update(float dt) {
+
+    //textures which finished loading replace their placeholders, within the budget
+    {
+        Profiler::Zone zone("textures");
+        TextureStreamer::update();
+        //arrays are read back from the textures, so wait for all of them
+        if (atlas_dirty_ && !TextureStreamer::getPending())
+            buildTextureAtlas_();
+    }
     
     //set initial OpenGL state
 	glClearColor(clear_color.r, clear_color.g, clear_color.b, 1.0f);
@@ -127,16 +234,150 @@ void GraphicsSystem::update(float dt) {
 	auto& cameras = ECS.getAllComponents<Camera>();
 	for (auto &cam : cameras) cam.update();
 
+	//materials were added, or lights moved to another bucket
+	if (variants_dirty_ || ShaderVariants::lightBucket((int)ECS.getAllComponents<Light>().size()) != light_bucket_)
+		selectShaderVariants_();
+
+	Camera& cam = ECS.getComponentInArray<Camera>(ECS.main_camera);
+	if (occlusion_culling) {
+		Profiler::Zone zone("occluders");
+		renderOccluders_(cam);
+	}
+	{
+		Profiler::Zone zone("light clusters");
+		buildLightClusters_(cam);
+		texture_atlas_.uploadMaterialData(materials_);
+	}
+	{
+		Profiler::Zone zone("traversal");
+		buildCommandBuffer_(cam);
+		int visible = 0;
+		for (auto& queue : render_queues_) visible += (int)queue.items.size();
+		RenderStats::add(RenderStats::VISIBLE, visible);
+		RenderStats::add(RenderStats::FRUSTUM_CULLED, getFrustumCulled());
+		RenderStats::add(RenderStats::OCCLUSION_CULLED, getOcclusionCulled());
+	}
+	{
+		Profiler::Zone zone("backend");
+		backend_->execute(command_buffer_);
+	}
+}
+
+int GraphicsSystem::getFrustumCulled() const {
+	int culled = 0;
+	for (auto& queue : render_queues_) culled += queue.frustum_culled;
+	return culled;
+}
+
+int GraphicsSystem::getOcclusionCulled() const {
+	int culled = 0;
+	for (auto& queue : render_queues_) culled += queue.occlusion_culled;
+	return culled;
+}
+
+//traverses all mesh components and produces the sorted command buffer for a camera.
+//Traversal is split across worker threads, each filling its own queue, so
+//no GL calls may happen here
+void GraphicsSystem::buildCommandBuffer_(Camera& cam) {
+	auto& mesh_components = ECS.getAllComponents<Mesh>();
+	auto& transforms = ECS.getAllComponents<Transform>();
+
+	int num_queues = parallelBatches((int)mesh_components.size(), 256);
+	if ((int)render_queues_.size() < num_queues) render_queues_.resize(num_queues);
+	for (auto& queue : render_queues_) queue.clear();
+
+	parallelFor((int)mesh_components.size(), 256, [&](int begin, int end, int worker) {
+		RenderQueue& queue = render_queues_[worker];
+		for (int i = begin; i < end; i++)
+			queueMeshComponent_(mesh_components[i], cam, transforms, queue);
+		queue.sort();
+	});
+
+	command_buffer_.clear();
+	command_buffer_.view.view_projection = cam.view_projection;
+	command_buffer_.view.cam_pos = cam.position;
+	command_buffer_.view.depth_prepass = useDepthPrepass_(cam);
+	command_buffer_.merge(render_queues_);
+}
+
+//depth pre-pass of a camera. In auto mode it follows the overdraw measured
+//by the backend, which is the same with or without the pre-pass
+bool GraphicsSystem::useDepthPrepass_(const Camera& cam) {
+	if (cam.depth_prepass != DepthPrepassAuto) return cam.depth_prepass == DepthPrepassOn;
+	float overdraw = gl_backend_.getOverdraw();
+	if (overdraw > depth_prepass_overdraw) auto_depth_prepass_ = true;
+	else if (overdraw < depth_prepass_overdraw * 0.75f) auto_depth_prepass_ = false;
+	return auto_depth_prepass_;
+}
+
+//returns true if mesh should be rendered into the occlusion buffer: either
+//flagged as occluder, or big enough to be picked automatically
+bool GraphicsSystem::isOccluder_(Mesh& comp, const Geometry& geom, const lm::mat4& model_matrix) {
+	if (comp.occluder) return true;
+	if (auto_occluder_radius <= 0.0f) return false;
+	float scale = std::max(model_matrix.right().length(), std::max(model_matrix.top().length(), model_matrix.front().length()));
+	return geom.aabb.half_width.length() * scale >= auto_occluder_radius;
+}
+
+//reads positions and occluder LOD indices of a geometry back from the arena.
+//Indices are relative to the first vertex of the geometry
+void GraphicsSystem::readOccluder_(Geometry& geom) {
+	const ArenaPage& page = geometry_arena_.getPages()[geom.range.page];
+	std::vector<Vertex> vertices(geom.range.num_vertices);
+	glBindBuffer(GL_ARRAY_BUFFER, page.vbo);
+	glGetBufferSubData(GL_ARRAY_BUFFER, (GLintptr)geom.range.base_vertex * sizeof(Vertex), vertices.size() * sizeof(Vertex), vertices.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	geom.cpu_positions.resize(vertices.size() * 3);
+	for (size_t i = 0; i < vertices.size(); i++)
+		for (int j = 0; j < 3; j++) geom.cpu_positions[i * 3 + j] = vertices[i].position[j];
+
+	const GeometryLOD& lod = geom.lods[geom.occluder_lod];
+	GLintptr offset = geom.range.indexOffset() + (GLintptr)lod.first_index * geom.range.indexSize();
+	geom.occluder_indices.resize(lod.num_indices);
+	//the element buffer binding belongs to the VAO
+	glBindVertexArray(0);
+	glBindBuffer(GL_COPY_READ_BUFFER, page.ibo);
+	if (geom.range.index_type == GL_UNSIGNED_SHORT) {
+		std::vector<unsigned short> shorts(lod.num_indices);
+		glGetBufferSubData(GL_COPY_READ_BUFFER, offset, shorts.size() * 2, shorts.data());
+		std::copy(shorts.begin(), shorts.end(), geom.occluder_indices.begin());
+	}
+	else {
+		glGetBufferSubData(GL_COPY_READ_BUFFER, offset, geom.occluder_indices.size() * 4, geom.occluder_indices.data());
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+//rasterizes all occluders into the software depth buffer
+void GraphicsSystem::renderOccluders_(Camera& cam) {
 	auto& mesh_components = ECS.getAllComponents<Mesh>();
-	for (auto &mesh : mesh_components) {
-        checkShaderAndMaterial(mesh);
-		renderMeshComponent_(mesh);
+	auto& transforms = ECS.getAllComponents<Transform>();
+
+	occlusion_culler_.begin(cam.view_projection);
+	for (auto& comp : mesh_components) {
+		if (!comp.active) continue;
+		Geometry& geom = geometries_[comp.geometry];
+		if (!geom.num_tris) continue;
+		lm::mat4 model_matrix = ECS.getComponentFromEntity<Transform>(comp.owner).getGlobalMatrix(transforms);
+		if (!isOccluder_(comp, geom, model_matrix)) continue;
+		if (geom.occluder_indices.empty()) readOccluder_(geom);
+		occlusion_culler_.renderOccluder(geom.cpu_positions, geom.occluder_indices, model_matrix);
 	}
+	occlusion_culler_.end();
 }
 
 //sets uniforms for current material and current shader
 void GraphicsSystem::setMaterialUniforms() {
     Material& mat = materials_[current_material_];
+
+    //the whole bucket uses the same arrays. Colours and layers are in the material data
+    if (mat.variant_key & SHADER_TEXTURE_ARRAYS) {
+        if (mat.diffuse_map != -1)
+            shader_->setTextureArray(U_DIFFUSE_MAP, texture_atlas_.find(mat.diffuse_map)->array, 0);
+        if (mat.specular_map != -1)
+            shader_->setTextureArray(U_SPECULAR_MAP, texture_atlas_.find(mat.specular_map)->array, 1);
+        return;
+    }
     
     //material uniforms
     /*GLint u_ambient = glGetUniformLocation(current_shader_->program, "u_ambient");
@@ -163,85 +404,123 @@ void GraphicsSystem::setMaterialUniforms() {
 
     if (mat.diffuse_map != -1)
         shader_->setTexture(U_DIFFUSE_MAP, mat.diffuse_map, 0);
+    if (mat.specular_map != -1)
+        shader_->setTexture(U_SPECULAR_MAP, mat.specular_map, 1);
+}
 
-    
-    //light uniforms
-    const std::vector<Light>& lights = ECS.getAllComponents<Light>();  // get number of lights in scene from ECM
-    
-    GLint u_num_lights = glGetUniformLocation(shader_->program, "u_num_lights"); //get/set uniform in shader
-    if (u_num_lights != -1) glUniform1i(u_num_lights, (int)lights.size());
-    
-    //for each light
-    for (size_t i = 0; i < lights.size(); i++) {
-        //get light transform
-        Transform& light_transform = ECS.getComponentFromEntity<Transform>(lights[i].owner);
-        
-        //position
-        std::string light_position_name = "lights[" + std::to_string(i) + "].position"; // create dynamic uniform name
-        GLint u_light_pos = glGetUniformLocation(shader_->program, light_position_name.c_str()); //find it
-        if (u_light_pos != -1) glUniform3fv(u_light_pos, 1, light_transform.position().value_); // light position
-        
-        //color
-        std::string light_color_name = "lights[" + std::to_string(i) + "].color";
-        GLint u_light_col = glGetUniformLocation(shader_->program, light_color_name.c_str());
-        if (u_light_col != -1) glUniform3fv(u_light_col, 1, lights[i].color.value_);
-    }
+//gathers all lights, assigns them to the clusters of the camera and uploads the result
+void GraphicsSystem::buildLightClusters_(Camera& cam) {
+	auto& lights = ECS.getAllComponents<Light>();
+	cluster_lights_.resize(lights.size());
+	for (size_t i = 0; i < lights.size(); i++) {
+		Transform& light_transform = ECS.getComponentFromEntity<Transform>(lights[i].owner);
+		cluster_lights_[i].position = light_transform.position();
+		cluster_lights_[i].radius = lights[i].radius;
+		cluster_lights_[i].color = lights[i].color;
+	}
+
+	//variants with a light count loop all lights, padded with black lights far away
+	int looped_lights = ShaderVariants::bucketLights(light_bucket_);
+	if (lights.size() <= (size_t)ShaderVariants::kMaxLoopedLights) {
+		ClusterLight padding = { lm::vec3(1e20f, 1e20f, 1e20f), 1.0f, lm::vec3(0.0f, 0.0f, 0.0f) };
+		cluster_lights_.resize(std::max((size_t)looped_lights, lights.size()), padding);
+		light_clusters_.buildLightData(cluster_lights_);
+	}
+	else
+		light_clusters_.build(cluster_lights_, cam.view_matrix, cam.projection_matrix);
+	light_clusters_.upload();
+
+	//shader finds the cluster x and y from the fragment coordinate
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	viewport_size_ = lm::vec3((float)viewport[2], (float)viewport[3], 0.0f);
+}
+
+//sets uniforms of the light clusters for the current shader
+void GraphicsSystem::setLightUniforms() {
+	shader_->setUniform(U_LIGHT_DATA, (int)LightClusters::LIGHT_DATA_UNIT);
+	shader_->setUniform(U_LIGHT_GRID, (int)LightClusters::GRID_UNIT);
+	shader_->setUniform(U_LIGHT_INDICES, (int)LightClusters::INDICES_UNIT);
+	shader_->setUniform(U_CLUSTER_Z, lm::vec3(light_clusters_.getZScale(), light_clusters_.getZBias(), 0.0f));
+	shader_->setUniform(U_VIEWPORT, viewport_size_);
+	Camera& cam = ECS.getComponentInArray<Camera>(ECS.main_camera);
+	shader_->setUniform(U_CAM_FORWARD, cam.forward);
 }
 
-//renders a given mesh component
-void GraphicsSystem::renderMeshComponent_(Mesh& comp) {
+//adds a given mesh component to a render queue
+void GraphicsSystem::queueMeshComponent_(Mesh& comp, Camera& cam, std::vector<Transform>& transforms, RenderQueue& queue) {
     
 	if (!comp.active) return;
 
     //get transform of components entity
     Transform& transform = ECS.getComponentFromEntity<Transform>(comp.owner);
-	//get camera
-	Camera& cam = ECS.getComponentInArray<Camera>(ECS.main_camera);
-    //get Geometry, material and textures
+    //get Geometry and material
     Geometry& geom = geometries_[comp.geometry];
+    Material& mat = materials_[comp.material];
    
 	//model matrix
-	lm::mat4 model_matrix = transform.getGlobalMatrix(ECS.getAllComponents<Transform>());
+	lm::mat4 model_matrix = transform.getGlobalMatrix(transforms);
 	//Model view projection matrix
 	lm::mat4 mvp_matrix = cam.view_projection * model_matrix;
 
 	//view frustum culling
-    //if (!BBInFrustum_(geom.aabb, mvp_matrix)) {
-    //    return;
-    //}
-	
-	//std::cout << ECS.entities[comp.owner].name << "-";
+    if (frustum_culling && !BBInFrustum_(geom.aabb, mvp_matrix)) {
+        queue.frustum_culled++;
+        return;
+    }
+
+	//occlusion culling. Occluders are not tested, as they are in the depth buffer
+	if (occlusion_culling && !isOccluder_(comp, geom, model_matrix) &&
+		!occlusion_culler_.isVisible(geom.aabb.center, geom.aabb.half_width, mvp_matrix)) {
+		queue.occlusion_culled++;
+		return;
+	}
 
 	//normal matrix
 	lm::mat4 normal_matrix = model_matrix;
 	normal_matrix.inverse();
 	normal_matrix.transpose();
-    
-    //transform uniforms
-    //GLint u_mvp = glGetUniformLocation(shader_->program, "u_mvp");
-    //if (u_mvp != -1) glUniformMatrix4fv(u_mvp, 1, GL_FALSE, mvp_matrix.m);
-	shader_->setUniform(U_MVP, mvp_matrix);
-    
-    //GLint u_model = glGetUniformLocation(shader_->program, "u_model");
-    //if (u_model != -1) glUniformMatrix4fv(u_model, 1, GL_FALSE, model_matrix.m);
-	shader_->setUniform(U_MODEL, model_matrix);
 
-	//GLint u_normal_matrix = glGetUniformLocation(shader_->program, "u_normal_matrix");
-	//if (u_normal_matrix != -1) glUniformMatrix4fv(u_normal_matrix, 1, GL_FALSE, normal_matrix.m);
-	shader_->setUniform(U_NORMAL_MATRIX, normal_matrix);
+	int lod = selectLOD_(comp, geom, model_matrix, cam);
 
-    //GLint u_cam_pos = glGetUniformLocation(shader_->program, "u_cam_pos");
-    //if (u_cam_pos != -1) glUniform3fv(u_cam_pos, 1, cam.position.value_); // ...3fv - is array of 3 floats
-	shader_->setUniform(U_CAM_POS, cam.position);
-    
-    //tell OpenGL we want to the the vao_ container with our buffers
-    glBindVertexArray(geom.vao);
-    //draw our geometry
-    glDrawElements(GL_TRIANGLES, geom.num_tris * 3, GL_UNSIGNED_INT, 0);
-    //tell OpenGL we don't want to use our container anymore
-    glBindVertexArray(0);
-    
+	int bucket = mat.bucket != -1 ? mat.bucket : comp.material;
+	DrawItem& item = queue.push(mat.shader_id, bucket, comp.geometry, lod, mat.variant_key);
+	item.constants.material = comp.material;
+	item.constants.mvp = mvp_matrix;
+	item.constants.model = model_matrix;
+	item.constants.normal_matrix = normal_matrix;
+}
+//selects level of detail of a mesh from the projected size of its bounding sphere.
+//To go to a coarser LOD the size must be below the threshold by lod_hysteresis,
+//so meshes near a threshold don't switch every frame
+int GraphicsSystem::selectLOD_(Mesh& comp, const Geometry& geom, const lm::mat4& model_matrix, Camera& cam) {
+	if (geom.num_lods == 1) return comp.lod = 0;
+
+	//bounding sphere in world space. Radius is scaled by largest axis scale
+	lm::vec3 center = model_matrix * geom.aabb.center;
+	float scale = std::max(model_matrix.right().length(), std::max(model_matrix.top().length(), model_matrix.front().length()));
+	float radius = geom.aabb.half_width.length() * scale;
+
+	//radius projected to a fraction of half the viewport height. M[1][1] is
+	//1/tan(fov/2) for perspective projections; orthographic ones do not use distance
+	const lm::mat4& proj = cam.projection_matrix;
+	float screen_size = radius * proj.m[5];
+	if (proj.m[15] == 0.0f) {
+		float distance = (center - cam.position).length();
+		screen_size = distance > radius ? screen_size / distance : 1.0f;
+	}
+
+	//finest LOD whose threshold the size is above
+	int lod = 0;
+	while (lod < geom.num_lods - 1 && screen_size < lod_screen_sizes[lod]) lod++;
+
+	//hysteresis: leave current LOD for a coarser one only once the size is clearly below its threshold
+	int current = std::min(comp.lod, geom.num_lods - 1);
+	if (lod > current && screen_size > lod_screen_sizes[current] * (1.0f - lod_hysteresis))
+		lod = current;
+	return comp.lod = lod;
 }
+
 //
 ////********************************************
 //// Adding and creating functions
@@ -257,6 +536,7 @@ void GraphicsSystem::useShader(Shader* s) {
     else if (!shader_ || shader_ != s){
         glUseProgram(s->program);
         shader_ = s;
+        RenderStats::add(RenderStats::SHADER_BINDS);
     }
 }
 
@@ -270,6 +550,7 @@ void GraphicsSystem::useShader(GLuint p) {
     else if (!shader_ || shader_->program != p) {
         glUseProgram(p);
         shader_ = shaders_[p];
+        RenderStats::add(RenderStats::SHADER_BINDS);
     }
 }
 
@@ -284,14 +565,41 @@ Shader* GraphicsSystem::loadShader(std::string vs, std::string fs, bool compile_
 		new_shader->compileFromStrings(vs, fs);
 	}
 	else {
-		new_shader = new Shader(vs, fs);
+		//keep the sources, so we can build variants of them
+		new_shader = new Shader();
+		std::string vs_source = new_shader->readFile(vs);
+		std::string fs_source = new_shader->readFile(fs);
+		new_shader->compileFromStrings(vs_source, fs_source);
+		variant_sets_.emplace_back(vs_source, fs_source);
+		if (variant_sets_.back().getFeatures())
+			program_variants_[new_shader->program] = &variant_sets_.back();
+		else
+			variant_sets_.pop_back();
 	}
 	shaders_[new_shader->program] = new_shader;
 	return new_shader;
 }
 
+GLuint GraphicsSystem::getShaderVariant(GLuint program, uint32_t key) {
+	auto it = program_variants_.find(program);
+	if (it == program_variants_.end()) return program;
+	ShaderVariants& variants = *it->second;
+	key &= variants.getFeatures();
+	int variant = variants.getProgram(key);
+	if (variant != -1) return (GLuint)variant;
+
+	//compiled in the background like any other shader
+	Shader* shader = loadShader(variants.getVertexSource(key), variants.getFragmentSource(key), true);
+	shader->name = shaders_[program]->name + ShaderVariants::describe(key);
+	variants.setProgram(key, shader->program);
+	program_variants_[shader->program] = &variants;
+	return shader->program;
+}
+
 //create a new material and return pointer to it
 int GraphicsSystem::createMaterial() {
+    variants_dirty_ = true;
+    atlas_dirty_ = true;
     materials_.emplace_back();
     return (int)materials_.size() - 1;
 }
@@ -305,11 +613,8 @@ int GraphicsSystem::createPlaneGeometry(){
     uvs = { 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f };
     normals = { 0.0f, 0.0f, 1.0f,    0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f,    0.0f, 0.0f, 1.0f };
     indices = { 0, 1, 2, 0, 2, 3 };
-    //generate the OpenGL buffers and create geometry
-    GLuint vao = generateBuffers_(vertices, uvs, normals, indices);
-    geometries_.emplace_back(vao, 2);
-    
-    return (int)geometries_.size() - 1;
+    //store in the arena and create geometry
+    return createGeometry_(vertices, uvs, normals, indices);
 }
 
 //create geometry from
@@ -324,11 +629,10 @@ int GraphicsSystem::createGeometryFromFile(std::string filename) {
     {
         //fill it with data from object
         if (Parsers::parseOBJ(filename, vertices, uvs, normals, indices)) {
-
-            //generate the OpenGL buffers and create geometry
-            GLuint vao = generateBuffers_(vertices, uvs, normals, indices);
-            geometries_.emplace_back(vao, (GLuint)indices.size() / 3);
-            return (int)geometries_.size() - 1;
+            MeshOptimizer::optimizeMesh(vertices, uvs, normals, indices).print(filename);
+            std::vector<GeometryLOD> lods;
+            generateLODs_(vertices, indices, lods);
+            return createGeometry_(vertices, uvs, normals, indices, lods);
         }
         else {
             std::cerr << "ERROR: Could not parse mesh file" << std::endl;
@@ -338,11 +642,10 @@ int GraphicsSystem::createGeometryFromFile(std::string filename) {
     else if (ext == "mesh") {
         //fill it with data from object
         if (Parsers::parseBin(filename, vertices, uvs, normals, indices)) {
-
-            //generate the OpenGL buffers and create geometry
-            GLuint vao = generateBuffers_(vertices, uvs, normals, indices);
-            geometries_.emplace_back(vao, (GLuint)indices.size() / 3);
-            return (int)geometries_.size() - 1;
+            MeshOptimizer::optimizeMesh(vertices, uvs, normals, indices).print(filename);
+            std::vector<GeometryLOD> lods;
+            generateLODs_(vertices, indices, lods);
+            return createGeometry_(vertices, uvs, normals, indices, lods);
         }
         else {
             std::cerr << "ERROR: Could not parse mesh file" << std::endl;
@@ -355,6 +658,75 @@ int GraphicsSystem::createGeometryFromFile(std::string filename) {
     }
 }
 
+//interleaves vertex data, stores it in the geometry arena and creates a geometry.
+//- lods: index ranges of each LOD in indices. If empty, indices are a single LOD
+//returns index in geometry array, or -1 if geometry could not be stored
+int GraphicsSystem::createGeometry_(std::vector<float>& vertices, std::vector<float>& uvs, std::vector<float>& normals, std::vector<unsigned int>& indices, const std::vector<GeometryLOD>& lods) {
+
+    size_t num_vertices = vertices.size() / 3;
+    std::vector<Vertex> interleaved(num_vertices);
+    for (size_t i = 0; i < num_vertices; i++) {
+        Vertex& v = interleaved[i];
+        for (int j = 0; j < 3; j++) v.position[j] = vertices[i * 3 + j];
+        //missing uvs or normals are set to zero
+        for (int j = 0; j < 2; j++) v.uv[j] = i * 2 + j < uvs.size() ? uvs[i * 2 + j] : 0.0f;
+        for (int j = 0; j < 3; j++) v.normal[j] = i * 3 + j < normals.size() ? normals[i * 3 + j] : 0.0f;
+    }
+
+    Geometry geom;
+    if (!geometry_arena_.allocate(interleaved, indices, geom.range)) {
+        std::cerr << "ERROR: Could not store geometry in arena" << std::endl;
+        return -1;
+    }
+    if (lods.empty()) {
+        geom.lods[0].num_indices = (GLuint)indices.size();
+    }
+    else {
+        geom.num_lods = std::min((int)lods.size(), Geometry::MAX_LODS);
+        for (int i = 0; i < geom.num_lods; i++) geom.lods[i] = lods[i];
+    }
+    geom.num_tris = geom.lods[0].num_indices / 3;
+    setGeometryAABB_(geom, vertices);
+
+    //occluders must not cover pixels the mesh doesn't, and simplification can
+    //move the silhouette outwards, so use the coarsest LOD without error
+    for (int i = 1; i < geom.num_lods; i++)
+        if (geom.lods[i].error == 0.0f) geom.occluder_lod = i;
+    geometries_.push_back(geom);
+    return (int)geometries_.size() - 1;
+}
+
+//simplifies a mesh into up to MAX_LODS - 1 extra levels of detail, each with about
+//half the triangles of the previous one. LOD indices are appended to indices, and
+//lods receives the range of each level (including LOD 0)
+void GraphicsSystem::generateLODs_(std::vector<float>& vertices, std::vector<unsigned int>& indices, std::vector<GeometryLOD>& lods) {
+    const size_t min_lod_indices = 64 * 3; //not worth simplifying below this
+    const float max_error = 0.05f; //5% of mesh size
+
+    lods.clear();
+    lods.push_back({ 0, (GLuint)indices.size(), 0.0f });
+    std::vector<unsigned int> previous = indices;
+
+    while ((int)lods.size() < Geometry::MAX_LODS && previous.size() > min_lod_indices) {
+        float error = 0;
+        std::vector<unsigned int> lod = MeshSimplifier::simplify(previous, vertices, previous.size() / 2, max_error, &error);
+        //stop when simplification can't remove enough triangles within the error
+        if (lod.size() > previous.size() * 3 / 4) break;
+        MeshOptimizer::optimizeVertexCache(lod, (unsigned int)vertices.size() / 3);
+
+        lods.push_back({ (GLuint)indices.size(), (GLuint)lod.size(), error });
+        indices.insert(indices.end(), lod.begin(), lod.end());
+        previous.swap(lod);
+    }
+}
+
+//returns geometry memory to the arena. Geometry slot stays, with no triangles
+void GraphicsSystem::freeGeometry(int geom_id) {
+    Geometry& geom = geometries_[geom_id];
+    geometry_arena_.free(geom.range);
+    geom.num_tris = 0;
+}
+
 // Given an array of floats (in sets of three, representing vertices) calculates and
 // sets the AABB of a geometry
 void GraphicsSystem::setGeometryAABB_(Geometry& geom, std::vector<GLfloat>& vertices) {
@@ -493,7 +865,7 @@ bool GraphicsSystem::AABBInFrustum_(const AABB& aabb, const lm::mat4& to_clip) {
 	//near plane
 	in = 0;
 	for (int i = 0; i < 8; i++) {
-		if (-clip_points[i].z < clip_points[i].z) in++;
+		if (-clip_points[i].w < clip_points[i].z) in++;
 	}
 	if (!in) return false;
 
@@ -576,7 +948,7 @@ bool GraphicsSystem::BBInFrustum_(const AABB& aabb, const lm::mat4& mvp) {
 	//near plane
 	in = 0;
 	for (int i = 0; i < 8; i++) {
-		if (-clip_points[i].z < clip_points[i].z) in++;
+		if (-clip_points[i].w < clip_points[i].z) in++;
 	}
 	if (!in) return false;
 
@@ -590,43 +962,6 @@ bool GraphicsSystem::BBInFrustum_(const AABB& aabb, const lm::mat4& mvp) {
 	return true;
 }
 
-//generates buffers in VRAM and returns VAO handle.
-GLuint GraphicsSystem::generateBuffers_(std::vector<float>& vertices, std::vector<float>& uvs, std::vector<float>& normals, std::vector<unsigned int>& indices) {
-    //generate and bind vao
-    GLuint vao;
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-    GLuint vbo;
-    //positions
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &(vertices[0]), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    //texture coords
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(float), &(uvs[0]), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
-    //normals
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(float), &(normals[0]), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    //indices
-    GLuint ibo;
-    glGenBuffers(1, &ibo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &(indices[0]), GL_STATIC_DRAW);
-    //unbind
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-
-    return vao;
-}
-
 int Geometry::Load(GraphicsSystem& graphics_system, rapidjson::Value & entity, int ent_id)
 {
     auto jmesh = entity["render"]["mesh"].GetString();
@@ -650,43 +985,86 @@ int Material::Load(GraphicsSystem & graphics_system, rapidjson::Value & entity,
     auto jmat = entity["render"]["materials"].GetArray();
     std::string mat_name = jmat[0].GetString();
 
-    std::ifstream json_file(jmat[0].GetString());
+    //each file is read once, entities using it share the material
+    auto loaded = materials.find(mat_name);
+    if (loaded != materials.end()) return loaded->second;
+
+    std::ifstream json_file(mat_name);
     rapidjson::IStreamWrapper json_stream(json_file);
     rapidjson::Document json_material;
     json_material.ParseStream(json_stream);
 
-    int mat_id = graphics_system.createMaterial();
-    graphics_system.getMaterial(mat_id).shader_id = Parsers::shaders["phong"];
-    graphics_system.getMaterial(mat_id).name = mat_name;
-
-    if (json_material.HasParseError()) std::cerr << "JSON format is not valid!" << std::endl;
-
-    if (json_material["textures"].HasMember("diffuse")) {
-        std::string tx_diff = json_material["textures"]["diffuse"].GetString();
-        int tex_id;
-        if (textures.find(tx_diff) == textures.end()) { tex_id = Parsers::parseTexture(tx_diff); textures[tx_diff] = tex_id; }
-        else { tex_id = textures[tx_diff]; }
+    Material mat;
+    mat.shader_id = mat.base_shader_id = Parsers::shaders["phong"];
+    mat.name = mat_name;
 
-        graphics_system.getMaterial(mat_id).diffuse_map = tex_id; //assign texture id from material
-    }
-
-    if (json_material["textures"].HasMember("specular")) {
-        std::string tx_spec = json_material["textures"]["specular"].GetString();
-        int tex_id = Parsers::parseTexture(tx_spec);
-        //graphics_system.getMaterial(mat_id).specular = lm::vec3(json_spec[0].GetFloat(), json_spec[1].GetFloat(), json_spec[2].GetFloat());
+    if (json_material.HasParseError() || !json_material.IsObject() || !json_material.HasMember("textures")) {
+        std::cerr << "JSON format is not valid!" << std::endl;
     }
     else {
-        graphics_system.getMaterial(mat_id).specular = lm::vec3(0, 0, 0); //no specular
-    }
+        auto& json_textures = json_material["textures"];
+        if (json_textures.HasMember("diffuse"))
+            mat.diffuse_map = LoadTexture(json_textures["diffuse"].GetString());
 
-    if (json_material["textures"].HasMember("ambient")) {
-        std::string tx_amb = json_material["textures"]["ambient"].GetString();
-        int tex_id = Parsers::parseTexture(tx_amb);
-        //graphics_system.getMaterial(mat_id).ambient = lm::vec3(json_ambient[0].GetFloat(), json_ambient[1].GetFloat(), json_ambient[2].GetFloat());
+        if (json_textures.HasMember("specular"))
+            mat.specular_map = LoadTexture(json_textures["specular"].GetString());
+        else
+            mat.specular = lm::vec3(0, 0, 0); //no specular
+
+        //there is no ambient map slot, so an ambient texture is not loaded
+        mat.ambient = lm::vec3(0.1f, 0.1f, 0.1f); //small ambient
     }
-    else {
-        graphics_system.getMaterial(mat_id).ambient = lm::vec3(0.1f, 0.1f, 0.1f); //small ambient
+
+    //another file may describe the same material
+    uint64_t hash = mat.hashParameters();
+    auto same = material_hashes.find(hash);
+    if (same != material_hashes.end() && graphics_system.getMaterial(same->second).sameParameters(mat)) {
+        materials[mat_name] = same->second;
+        return same->second;
     }
 
+    int mat_id = graphics_system.createMaterial();
+    graphics_system.getMaterial(mat_id) = mat;
+    materials[mat_name] = mat_id;
+    material_hashes[hash] = mat_id;
     return mat_id;
-}
\ No newline at end of file
+}
+
+int Material::LoadTexture(const std::string& path)
+{
+    auto loaded = textures.find(path);
+    if (loaded != textures.end()) return loaded->second;
+    int tex_id = Parsers::parseTexture(path);
+    textures[path] = tex_id;
+    return tex_id;
+}
+
+uint64_t Material::hashParameters() const
+{
+    uint64_t hash = 14695981039346656037ULL;
+    auto add = [&hash](const void* data, size_t size) {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+    };
+    add(&base_shader_id, sizeof(base_shader_id));
+    add(ambient.value_, sizeof(ambient.value_));
+    add(diffuse.value_, sizeof(diffuse.value_));
+    add(specular.value_, sizeof(specular.value_));
+    add(&specular_gloss, sizeof(specular_gloss));
+    add(&diffuse_map, sizeof(diffuse_map));
+    add(&specular_map, sizeof(specular_map));
+    return hash;
+}
+
+bool Material::sameParameters(const Material& other) const
+{
+    return base_shader_id == other.base_shader_id &&
+        ambient.x == other.ambient.x && ambient.y == other.ambient.y && ambient.z == other.ambient.z &&
+        diffuse.x == other.diffuse.x && diffuse.y == other.diffuse.y && diffuse.z == other.diffuse.z &&
+        specular.x == other.specular.x && specular.y == other.specular.y && specular.z == other.specular.z &&
+        specular_gloss == other.specular_gloss &&
+        diffuse_map == other.diffuse_map && specular_map == other.specular_map;
+}
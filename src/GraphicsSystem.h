@@ -8,7 +8,16 @@
 #include <unordered_map>
 #include "components/comp_rotator.h"
 #include "components/comp_tag.h"
-#include "GraphicsSystem.h"
+#include "render/RenderCommandBuffer.h"
+#include "render/GLRenderBackend.h"
+#include "render/GeometryArena.h"
+#include "render/OcclusionCuller.h"
+#include "render/LightClusters.h"
+#include "render/ShaderVariants.h"
+#include "render/TextureAtlas.h"
+#include "render/RenderToTexture.h"
+#include "render/FrameGraph.h"
+#include <list>
 struct AABB {
 	lm::vec3 center;
 	lm::vec3 half_width;
@@ -16,14 +25,32 @@ struct AABB {
 
 class GraphicsSystem;
 
+//index range of one level of detail, relative to the geometry range
+struct GeometryLOD {
+    GLuint first_index = 0;
+    GLuint num_indices = 0;
+    float error = 0; //simplification error, relative to mesh size
+};
+
+//Geometry is a range of vertices and indices inside the GeometryArena.
+//All levels of detail share the vertices and have their own index range
 struct Geometry {
 
+    static const int MAX_LODS = 4;
+
     std::string name;
-    GLuint vao;
-    GLuint num_tris;
+    ArenaAllocation range;
+    GLuint num_tris; //of LOD 0
 	AABB aabb;
-    Geometry() { vao = 0; num_tris = 0;}
-    Geometry(int a_vao, int a_tris) : vao(a_vao), num_tris(a_tris) {}
+    GeometryLOD lods[MAX_LODS];
+    int num_lods = 1;
+    //LOD rasterized when the geometry is an occluder, and a CPU copy of its
+    //positions and indices. The copy is read back from the arena the first
+    //time the geometry occludes, so other geometry keeps no copy
+    int occluder_lod = 0;
+    std::vector<float> cpu_positions;
+    std::vector<unsigned int> occluder_indices;
+    Geometry() { num_tris = 0;}
     static std::unordered_map<std::string, int> geometries;
 
     static int Load(GraphicsSystem& graphics_system, rapidjson::Value & entity, int ent_id);
@@ -33,14 +60,28 @@ struct Material {
     std::string name;
     int index = -1;
 	int shader_id;
+	//shader the material was given. shader_id is replaced by the variant of it
+	//in use (see selectShaderVariants_), so materials are compared by this one
+	int base_shader_id = -1;
 	lm::vec3 ambient;
     lm::vec3 diffuse;
     lm::vec3 specular;
     float specular_gloss;
     
     int diffuse_map;
+    int specular_map;
+
+    //features of the shader variant used by this material, see ShaderVariants.h
+    uint32_t variant_key = 0;
+    //index of the first material with the same shader and texture arrays. It is
+    //bound for the draws of all of them, see TextureAtlas
+    int bucket = -1;
 
+    //loaded materials by .mtl path, and by hash of their parameters so that
+    //files describing the same material share one
     static std::unordered_map<std::string, int> materials;
+    static std::unordered_map<uint64_t, int> material_hashes;
+    //loaded textures by path, for every map slot
     static std::unordered_map<std::string, int> textures;
 
     Material() {
@@ -49,15 +90,24 @@ struct Material {
         diffuse = lm::vec3(1.0f, 1.0f, 1.0f);
         specular = lm::vec3(1.0f, 1.0f, 1.0f);
         diffuse_map = -1;
+        specular_map = -1;
+        variant_key = 0;
         specular_gloss = 80.0f;
     }
 
+    //FNV-1a of the parameters which affect rendering (not name or bookkeeping)
+    uint64_t hashParameters() const;
+    bool sameParameters(const Material& other) const;
+
     static int Load(GraphicsSystem& graphics_system, rapidjson::Value & entity, int ent_id);
+    //texture id of the file, loading it only the first time
+    static int LoadTexture(const std::string& path);
 };
 
 class GraphicsSystem {
 public:
 
+	GraphicsSystem();
 	~GraphicsSystem();
 
     //resources
@@ -74,20 +124,67 @@ public:
 
     //shader loader
 	Shader* loadShader(std::string vs_path, std::string fs_path, bool compile_direct = false);
+	//returns program of a variant of a shader loaded from files, compiling it if
+	//needed. Returns the same program if the shader has no variants
+	GLuint getShaderVariant(GLuint program, uint32_t key);
 
 	//materials
     int createMaterial();
 	Material& getMaterial(int mat_id) { return materials_.at(mat_id); }
+	int getNumMaterials() { return (int)materials_.size(); }
     
     //geometry
     int createPlaneGeometry();
     int createGeometryFromFile(std::string filename);
+    void freeGeometry(int geom_id);
+    GeometryArena& getGeometryArena() { return geometry_arena_; }
 
 	void setClearColor(lm::vec3 new_color) {		
 		clear_color = new_color;
 	}
+	lm::vec3 getClearColor() { return clear_color; }
+	//true while textures are streaming in, or the texture atlas waits for them,
+	//so frames do not show the final images yet
+	bool isLoading();
+
+	//render backend - null backend records commands instead of drawing
+	void setNullBackend(bool use_null) { backend_ = use_null ? (RenderBackend*)&null_backend_ : &gl_backend_; }
+	bool isNullBackend() { return backend_ == &null_backend_; }
+	RenderBackend& getBackend() { return *backend_; }
+	NullRenderBackend& getNullBackend() { return null_backend_; }
+	//multi-draw indirect path. Returns false if not supported by the driver
+	bool setMultiDraw(bool enable) { return gl_backend_.setMultiDraw(enable); }
+	bool isMultiDraw() { return gl_backend_.isMultiDraw(); }
+
+	//level of detail: LOD i is used while projected bounding sphere radius, as a
+	//fraction of half the viewport height, is below lod_screen_sizes[i - 1]
+	float lod_screen_sizes[Geometry::MAX_LODS - 1] = { 0.25f, 0.1f, 0.04f };
+	float lod_hysteresis = 0.15f; //fraction of the threshold, to avoid switching every frame
+
+	//culling
+	bool frustum_culling = true;
+	bool occlusion_culling = true;
+	float auto_occluder_radius = 10.0f; //meshes with a bigger world bounding sphere are occluders too. 0 to disable
+
+	//cameras in DepthPrepassAuto draw a depth pre-pass above this overdraw
+	//(fragments passing the depth test per pixel), and stop below 3/4 of it
+	float depth_prepass_overdraw = 2.0f;
+	float getOverdraw() { return gl_backend_.getOverdraw(); }
+	OcclusionCuller& getOcclusionCuller() { return occlusion_culler_; }
+	//meshes rejected in the last frame
+	int getFrustumCulled() const;
+	int getOcclusionCulled() const;
+
+	TextureAtlas& getTextureAtlas() { return texture_atlas_; }
+
+	//offscreen targets (editor viewport, dynamic resolution), see Game::render_
+	RenderTargetPool& getRenderTargets() { return render_targets_; }
+	DynamicResolution& getDynamicResolution() { return dynamic_resolution_; }
+	//passes of the frame, rebuilt every frame by Game::render_
+	FrameGraph& getFrameGraph() { return frame_graph_; }
 
 private:
+	friend class GLRenderBackend;
 
 	lm::vec3 clear_color = lm::vec3(1.0f,1.0f,1.0f);
 
@@ -100,12 +197,51 @@ private:
     GLint current_material_ = -1;
     void setMaterialUniforms();
 
-	//sorting and checking
+	//shader variants: each set is shared by all its programs
+	std::list<ShaderVariants> variant_sets_;
+	std::unordered_map<GLuint, ShaderVariants*> program_variants_;
+	uint32_t light_bucket_ = 0;
+	bool variants_dirty_ = true; //a material was added
+	uint32_t materialVariantKey_(const Material& mat);
+	void selectShaderVariants_();
+	void assignMaterialBuckets_();
+
+	//textures of materials packed in arrays, once they are all resident
+	TextureAtlas texture_atlas_;
+	bool atlas_dirty_ = true; //a material was added
+	void buildTextureAtlas_();
+
+	RenderTargetPool render_targets_;
+	DynamicResolution dynamic_resolution_;
+	FrameGraph frame_graph_;
+
+	//lights are assigned to clusters once per frame; shaders read the clusters
+	LightClusters light_clusters_;
+	std::vector<ClusterLight> cluster_lights_;
+	lm::vec3 viewport_size_;
+	void buildLightClusters_(Camera& cam);
+	void setLightUniforms();
+
+	//sorting
 	void sortMeshes_();
-	void checkShaderAndMaterial(Mesh& mesh);
     
-    //rendering
-    void renderMeshComponent_(Mesh& comp);
+    //rendering: traversal fills one queue per worker, queues are merged into
+    //command buffer, and backend executes it
+    GLRenderBackend gl_backend_;
+    NullRenderBackend null_backend_;
+    RenderBackend* backend_;
+    std::vector<RenderQueue> render_queues_;
+    RenderCommandBuffer command_buffer_;
+    void buildCommandBuffer_(Camera& cam);
+    OcclusionCuller occlusion_culler_;
+    void renderOccluders_(Camera& cam);
+    bool isOccluder_(Mesh& comp, const Geometry& geom, const lm::mat4& model_matrix);
+    void readOccluder_(Geometry& geom);
+    void initMultiDraw_();
+    bool auto_depth_prepass_ = false;
+    bool useDepthPrepass_(const Camera& cam);
+    void queueMeshComponent_(Mesh& comp, Camera& cam, std::vector<Transform>& transforms, RenderQueue& queue);
+    int selectLOD_(Mesh& comp, const Geometry& geom, const lm::mat4& model_matrix, Camera& cam);
     
 	//AABB
 	void setGeometryAABB_(Geometry& geom, std::vector<GLfloat>& vertices);
@@ -113,9 +249,12 @@ private:
 	bool BBInFrustum_(const AABB& aabb, const lm::mat4& model_view_projection);
 	bool AABBInFrustum_(const AABB& aabb, const lm::mat4& view_projection);
 
-    //create geometry buffers
-    GLuint generateBuffers_(std::vector<float>& vertices,
-                            std::vector<float>& uvs,
-                            std::vector<float>& normals,
-                            std::vector<unsigned int>& indices);
+    //geometry storage
+    GeometryArena geometry_arena_;
+    int createGeometry_(std::vector<float>& vertices,
+                        std::vector<float>& uvs,
+                        std::vector<float>& normals,
+                        std::vector<unsigned int>& indices,
+                        const std::vector<GeometryLOD>& lods = {});
+    void generateLODs_(std::vector<float>& vertices, std::vector<unsigned int>& indices, std::vector<GeometryLOD>& lods);
 };
@@ -0,0 +1,44 @@
+#pragma once
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+//returns number of worker threads we want to use for parallel work
+inline int workerCount() {
+    unsigned int hw = std::thread::hardware_concurrency();
+    if (hw == 0) hw = 4; //hardware_concurrency can return 0 if unknown
+    return (int)std::min(hw, 16u);
+}
+
+//splits the range [0, count) into contiguous batches and calls
+//func(begin, end, worker_index) for each batch, one batch per thread.
+//- min_batch: smallest batch worth a thread. Small ranges run on the calling thread
+//- returns number of batches used, so callers can size per-worker storage first
+//  with parallelBatches()
+inline int parallelBatches(int count, int min_batch) {
+    if (count <= 0) return 1;
+    int batches = std::max(1, std::min(workerCount(), count / std::max(1, min_batch)));
+    return batches;
+}
+
+template<typename Func>
+int parallelFor(int count, int min_batch, Func func) {
+    int batches = parallelBatches(count, min_batch);
+    if (batches == 1) {
+        func(0, count, 0);
+        return 1;
+    }
+
+    int batch_size = (count + batches - 1) / batches;
+    std::vector<std::thread> threads;
+    threads.reserve(batches - 1);
+    //worker 0 is the calling thread, the rest are spawned
+    for (int w = 1; w < batches; w++) {
+        int begin = w * batch_size;
+        int end = std::min(count, begin + batch_size);
+        threads.emplace_back([=, &func]() { func(begin, end, w); });
+    }
+    func(0, std::min(count, batch_size), 0);
+    for (auto& t : threads) t.join();
+    return batches;
+}
@@ -7,157 +7,464 @@
 #include "components/comp_tag.h"
 #include "components/comp_movingplatform.h"
 #include <unordered_map>
+#include <cstring>
+#include <cmath>
+#include "render/TextureStreamer.h"
+#include "Parallel.h"
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 std::unordered_map<std::string, int> Parsers::geometries;
 std::unordered_map<std::string, int> Parsers::textures;
 std::unordered_map<std::string, int> Parsers::materials;
 std::unordered_map<std::string, int> Parsers::shaders;
 
-void split(std::string to_split, std::string delim, std::vector<std::string>& result) {
-    size_t last_offset = 0;
-    while (true) {
-        //find first delim
-        size_t offset = to_split.find_first_of(delim, last_offset);
-        result.push_back(to_split.substr(last_offset, offset - last_offset));
-        if (offset == std::string::npos) // if at end of string
-            break;
-        else //otherwise continue
-            last_offset = offset + 1;
+//OBJ parsing. The file is mapped into memory and cut into chunks at line
+//boundaries, which are parsed on their own threads into attributes and face
+//corners. The corners are then made into vertices in file order, so the result
+//does not depend on the number of threads
+static const size_t OBJ_CHUNK_SIZE = 4 << 20; //bytes worth a thread
+
+//read-only view of a whole file
+struct MappedFile {
+    const char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#else
+    int file = -1;
+#endif
+
+    bool open(const std::string& filename) {
+#ifdef _WIN32
+        file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size)) return false;
+        size = (size_t)file_size.QuadPart;
+        if (size == 0) return true; //empty files can't be mapped
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!mapping) return false;
+        data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        return data != nullptr;
+#else
+        file = ::open(filename.c_str(), O_RDONLY);
+        if (file < 0) return false;
+        struct stat info;
+        if (fstat(file, &info) != 0) return false;
+        size = (size_t)info.st_size;
+        if (size == 0) return true;
+        void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (view == MAP_FAILED) return false;
+        madvise(view, size, MADV_SEQUENTIAL);
+        data = (const char*)view;
+        return true;
+#endif
     }
-}
 
-//parses a wavefront object into passed arrays
-bool Parsers::parseOBJ(std::string filename, std::vector<float>& vertices, std::vector<float>& uvs, std::vector<float>& normals, std::vector<unsigned int>& indices) {
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (data) munmap((void*)data, size);
+        if (file >= 0) close(file);
+#endif
+    }
+};
+
+//face corner, 0-based indices of position, uv and normal, -1 if missing
+struct ObjCorner {
+    int index[3];
+};
+
+//what one chunk of the file contains, indices of corners are global except
+//for relative (negative) ones, which are counted from the chunk start
+struct ObjChunk {
+    std::vector<float> positions, uvs, normals;
+    std::vector<ObjCorner> corners;
+    std::vector<unsigned char> relative; //bit per attribute of each corner
+    std::vector<int> face_sizes;
+};
+
+static inline bool isBlank(char c) { return c == ' ' || c == '\t'; }
+static inline bool isDigit(char c) { return (unsigned)(c - '0') < 10; }
+
+static const char* skipBlanks(const char* p, const char* end) {
+    while (p < end && isBlank(*p)) p++;
+    return p;
+}
 
-    std::string line;
-    std::ifstream file(filename);
-    if (file.is_open())
-    {
-        //declare containers for temporary and final attributes
-        std::vector<lm::vec3> temp_vertices;
-        std::vector<lm::vec2> temp_uvs;
-        std::vector<lm::vec3> temp_normals;
-
-        //container to store map for indices
-        std::unordered_map<std::string, int> indices_map;
-        int next_index = 0; //stores next available index
-
-        //parse file line by line
-        while (std::getline(file, line))
-        {
-            //split line string
-            std::vector<std::string> words;
-            split(line, " ", words);
-            for (auto it = words.begin(); it != words.end();)
-            {
-                if ((*it) == "") it = words.erase(it);
-                else it++;
+//locale independent float reader, in place of std::from_chars which has no
+//float version in our compiler. Keeps 19 significant digits, far more than a
+//float holds
+static const char* parseFloat(const char* p, const char* end, float& value) {
+    static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    p = skipBlanks(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    for (; p < end && isDigit(*p); p++) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += mantissa != 0;
+        }
+        else exponent++;
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && isDigit(*p); p++) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+                exponent--;
             }
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        bool negative_exponent = false;
+        if (q < end && (*q == '-' || *q == '+')) negative_exponent = *q++ == '-';
+        if (q < end && isDigit(*q)) {
+            int e = 0;
+            for (; q < end && isDigit(*q); q++)
+                if (e < 10000) e = e * 10 + (*q - '0');
+            exponent += negative_exponent ? -e : e;
+            p = q;
+        }
+    }
+    double result = (double)mantissa;
+    if (exponent < -22 || exponent > 22) result *= pow(10.0, exponent);
+    else if (exponent < 0) result /= powers[-exponent];
+    else result *= powers[exponent];
+    value = (float)(negative ? -result : result);
+    return p;
+}
 
-            if (words.empty()) continue; //empty line, skip
-            if (words[0][0] == '#')	continue; //first word starts with #, line is a comment
+//reads an optional signed integer, 0 if there is none (OBJ indices start at 1)
+static const char* parseIndex(const char* p, const char* end, int& value) {
+    bool negative = p < end && *p == '-';
+    if (negative) p++;
+    int result = 0;
+    for (; p < end && isDigit(*p); p++) result = result * 10 + (*p - '0');
+    value = negative ? -result : result;
+    return p;
+}
 
-            if (words[0] == "v") { //line contains vertex data
-                //read words to floats
-                lm::vec3 pos((float)atof(words[1].c_str()),
-                    (float)atof(words[2].c_str()),
-                    (float)atof(words[3].c_str()));
-                //add to temporary vector of positions
-                temp_vertices.push_back(pos);
-            }
-            if (words[0] == "vt") { //line contains texture data
-                //read words to floats
-                lm::vec2 tex((float)atof(words[1].c_str()),
-                    (float)atof(words[2].c_str()));
-                //add to temporary vector of texture coords
-                temp_uvs.push_back(tex);
+static bool lineStartsWith(const char* p, const char* end, const char* word, size_t length) {
+    return (size_t)(end - p) > length && !memcmp(p, word, length) && isBlank(p[length]);
+}
+
+static void parseOBJChunk(const char* p, const char* end, ObjChunk& chunk) {
+    while (p < end) {
+        p = skipBlanks(p, end);
+        if (lineStartsWith(p, end, "v", 1)) {
+            float xyz[3];
+            p += 2;
+            for (int i = 0; i < 3; i++) p = parseFloat(p, end, xyz[i]);
+            chunk.positions.insert(chunk.positions.end(), xyz, xyz + 3);
+        }
+        else if (lineStartsWith(p, end, "vt", 2)) {
+            float uv[2];
+            p += 3;
+            for (int i = 0; i < 2; i++) p = parseFloat(p, end, uv[i]);
+            chunk.uvs.insert(chunk.uvs.end(), uv, uv + 2);
+        }
+        else if (lineStartsWith(p, end, "vn", 2)) {
+            float xyz[3];
+            p += 3;
+            for (int i = 0; i < 3; i++) p = parseFloat(p, end, xyz[i]);
+            chunk.normals.insert(chunk.normals.end(), xyz, xyz + 3);
+        }
+        else if (lineStartsWith(p, end, "f", 1)) {
+            int counts[3] = { (int)chunk.positions.size() / 3, (int)chunk.uvs.size() / 2, (int)chunk.normals.size() / 3 };
+            int face_size = 0;
+            p += 2;
+            while (true) {
+                p = skipBlanks(p, end);
+                if (p == end || !(isDigit(*p) || *p == '-')) break;
+                //v, v/t, v//n or v/t/n
+                int raw[3] = { 0, 0, 0 };
+                p = parseIndex(p, end, raw[0]);
+                for (int a = 1; a < 3 && p < end && *p == '/'; a++) p = parseIndex(p + 1, end, raw[a]);
+                ObjCorner corner;
+                unsigned char relative = 0;
+                for (int a = 0; a < 3; a++) {
+                    if (raw[a] > 0) corner.index[a] = raw[a] - 1;
+                    else if (raw[a] < 0) {
+                        corner.index[a] = counts[a] + raw[a];
+                        relative |= 1 << a;
+                    }
+                    else corner.index[a] = -1;
+                }
+                chunk.corners.push_back(corner);
+                chunk.relative.push_back(relative);
+                face_size++;
+                while (p < end && !isBlank(*p) && *p != '\n' && *p != '\r') p++;
             }
-            if (words[0] == "vn") { //line contains vertex data
-                //read words to floats
-                lm::vec3 norm((float)atof(words[1].c_str()),
-                    (float)atof(words[2].c_str()),
-                    (float)atof(words[3].c_str()));
-                //add to temporary vector of normals
-                temp_normals.push_back(norm);
+            if (face_size >= 3) chunk.face_sizes.push_back(face_size);
+            else { //points and lines are not drawn
+                chunk.corners.resize(chunk.corners.size() - face_size);
+                chunk.relative.resize(chunk.relative.size() - face_size);
             }
+        }
+        //comments, groups, materials and the rest of the line
+        const char* line_end = (const char*)memchr(p, '\n', end - p);
+        p = line_end ? line_end + 1 : end;
+    }
+}
 
-            //line contains face-vertex data
-            if (words[0] == "f") {
-                if (words.size() < 4) continue; // faces with fewer than 3 vertices??!
-
-                bool quad_face = false; //boolean to help us deal with quad faces
-
-                std::vector<std::string> nums; // container used for split indices
-                //for each face vertex
-                for (int i = 1; i < words.size(); i++) {
-
-                    //check if face vertex has already been indexed
-                    if (indices_map.count(words[i]) == 0) {
+static inline uint64_t mixHash(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    return x ^ (x >> 33);
+}
 
-                        if (words[i] == "") continue;
-                        //if not, start by getting all indices
-                        nums.clear();
-                        split(words[i], "/", nums);
-                        int v_ind = atoi(nums[0].c_str()) - 1; //subtract 1 to convert to 0-based array!
-                        int t_ind = atoi(nums[1].c_str()) - 1;
-                        int n_ind = atoi(nums[2].c_str()) - 1;
+//corner key when the three indices don't fit in 64 bits
+struct ObjWideKey {
+    uint32_t v, t, n;
+    bool operator==(const ObjWideKey& other) const { return v == other.v && t == other.t && n == other.n; }
+};
+
+static inline uint64_t hashKey(uint64_t key) { return mixHash(key); }
+static inline uint64_t hashKey(const ObjWideKey& key) { return mixHash(((uint64_t)key.v << 32 | key.t) ^ mixHash(key.n)); }
+
+//open addressing table from face corners to vertex indices, linear probing
+template<typename Key>
+class ObjCornerTable {
+public:
+    ObjCornerTable(size_t expected) {
+        size_t capacity = 64;
+        while (capacity < expected * 2) capacity *= 2;
+        resize_(capacity);
+    }
 
-                        //add vertices to final arrays of floats
-                        for (int j = 0; j < 3; j++)
-                            vertices.push_back(temp_vertices[v_ind].value_[j]);
-                        for (int j = 0; j < 2; j++)
-                            uvs.push_back(temp_uvs[t_ind].value_[j]);
-                        for (int j = 0; j < 3; j++)
-                            normals.push_back(temp_normals[n_ind].value_[j]);
+    //returns the vertex of key, or stores next for it
+    unsigned int insert(const Key& key, unsigned int next, bool& added) {
+        size_t slot = hashKey(key) & mask_;
+        while (values_[slot] != EMPTY) {
+            if (keys_[slot] == key) {
+                added = false;
+                return values_[slot];
+            }
+            slot = (slot + 1) & mask_;
+        }
+        keys_[slot] = key;
+        values_[slot] = next;
+        added = true;
+        if (++used_ * 2 > keys_.size()) resize_(keys_.size() * 2);
+        return next;
+    }
 
-                        //add an index to final array
-                        indices.push_back(next_index);
+private:
+    static const unsigned int EMPTY = 0xffffffff;
+    std::vector<Key> keys_;
+    std::vector<unsigned int> values_;
+    size_t mask_ = 0;
+    size_t used_ = 0;
+
+    void resize_(size_t capacity) {
+        std::vector<Key> old_keys(capacity);
+        std::vector<unsigned int> old_values(capacity, EMPTY);
+        old_keys.swap(keys_);
+        old_values.swap(values_);
+        mask_ = capacity - 1;
+        for (size_t i = 0; i < old_keys.size(); i++) {
+            if (old_values[i] == EMPTY) continue;
+            size_t slot = hashKey(old_keys[i]) & mask_;
+            while (values_[slot] != EMPTY) slot = (slot + 1) & mask_;
+            keys_[slot] = old_keys[i];
+            values_[slot] = old_values[i];
+        }
+    }
+};
 
-                        //record that this index is used for this face vertex
-                        indices_map[words[i]] = next_index;
+static int bitsFor(size_t value) {
+    int bits = 0;
+    while (value >> bits) bits++;
+    return bits;
+}
 
-                        //increment index
-                        next_index++;
-                    }
-                    else {
-                        //face vertex was already added to final arrays
-                        //so search for its stored index
-                        int the_index = indices_map.at(words[i]); //safe to use as we know it exists
-                        //add it to final index array
-                        indices.push_back(the_index);
-                    }
+//turns the corners into unique vertices, in file order, and the faces into
+//triangle fans. Returns true if any vertex has no normal
+template<typename Key, typename MakeKey>
+static bool buildOBJVertices(const std::vector<ObjChunk>& chunks, const std::vector<float>& positions,
+    const std::vector<float>& uvs, const std::vector<float>& normals, MakeKey make_key,
+    std::vector<float>& out_vertices, std::vector<float>& out_uvs, std::vector<float>& out_normals,
+    std::vector<unsigned int>& out_indices, std::vector<unsigned char>& missing_normal) {
+
+    size_t num_corners = 0;
+    for (auto& chunk : chunks) num_corners += chunk.corners.size();
+    ObjCornerTable<Key> table(std::min(num_corners, positions.size() / 3 + 1));
+    unsigned int next = (unsigned int)(out_vertices.size() / 3);
+    bool any_missing = false;
+    std::vector<unsigned int> face;
+    for (auto& chunk : chunks) {
+        size_t c = 0;
+        for (int face_size : chunk.face_sizes) {
+            face.clear();
+            for (int i = 0; i < face_size; i++, c++) {
+                const ObjCorner& corner = chunk.corners[c];
+                bool added;
+                unsigned int index = table.insert(make_key(corner), next, added);
+                if (added) {
+                    int v = corner.index[0], t = corner.index[1], n = corner.index[2];
+                    out_vertices.insert(out_vertices.end(), &positions[v * 3], &positions[v * 3] + 3);
+                    if (t >= 0) out_uvs.insert(out_uvs.end(), &uvs[t * 2], &uvs[t * 2] + 2);
+                    else out_uvs.insert(out_uvs.end(), 2, 0.0f);
+                    if (n >= 0) out_normals.insert(out_normals.end(), &normals[n * 3], &normals[n * 3] + 3);
+                    else out_normals.insert(out_normals.end(), 3, 0.0f);
+                    missing_normal.push_back(n < 0);
+                    any_missing |= n < 0;
+                    next++;
+                }
+                face.push_back(index);
+            }
+            for (int i = 1; i + 1 < face_size; i++) {
+                out_indices.push_back(face[0]);
+                out_indices.push_back(face[i]);
+                out_indices.push_back(face[i + 1]);
+            }
+        }
+    }
+    return any_missing;
+}
 
-                    //***CHECK FOR QUAD FACES****
-                    //If the face is a quads (i.e. words.size() == 5), we need to create two triangles
-                    //out of the quad. We have already created one triangle with words[1], [2] and [3]
-                    //now we make another with [4], [1] and [3]. 
-                    if (i == 4) {
-                        //face-vertex 4 is already added, so we search for indices of 1 and 3 and add them
-                        int index_1 = indices_map.at(words[1]);
-                        indices.push_back(index_1);
-                        int index_3 = indices_map.at(words[3]);
-                        indices.push_back(index_3);
-                    }
+//parses a wavefront object into passed arrays. Faces with more than three
+//corners are made into triangle fans. Missing uvs are 0, and vertices without
+//a normal get the area weighted normal of the faces which share them
+bool Parsers::parseOBJ(std::string filename, std::vector<float>& vertices, std::vector<float>& uvs, std::vector<float>& normals, std::vector<unsigned int>& indices) {
 
+    MappedFile file;
+    if (!file.open(filename)) return false;
+    const char* data = file.data;
+    size_t size = file.size;
+
+    //chunk boundaries, each moved forward to the start of a line
+    int num_chunks = (int)std::min<size_t>(workerCount(), size / OBJ_CHUNK_SIZE + 1);
+    std::vector<size_t> bounds(num_chunks + 1, size);
+    bounds[0] = 0;
+    for (int i = 1; i < num_chunks; i++) {
+        size_t offset = std::max(bounds[i - 1], size / num_chunks * i);
+        while (offset < size && data[offset - 1] != '\n') offset++;
+        bounds[i] = offset;
+    }
+    std::vector<ObjChunk> chunks(num_chunks);
+    parallelFor(num_chunks, 1, [&](int begin, int end, int) {
+        for (int i = begin; i < end; i++)
+            parseOBJChunk(data + bounds[i], data + bounds[i + 1], chunks[i]);
+    });
+
+    //attributes of all the chunks, and where each chunk starts in them
+    std::vector<float> all_attributes[3];
+    const int components[3] = { 3, 2, 3 };
+    std::vector<int> starts(num_chunks * 3);
+    for (int i = 0; i < num_chunks; i++) {
+        std::vector<float>* attributes[3] = { &chunks[i].positions, &chunks[i].uvs, &chunks[i].normals };
+        for (int a = 0; a < 3; a++) {
+            starts[i * 3 + a] = (int)(all_attributes[a].size() / components[a]);
+            all_attributes[a].insert(all_attributes[a].end(), attributes[a]->begin(), attributes[a]->end());
+            std::vector<float>().swap(*attributes[a]);
+        }
+    }
+    int counts[3];
+    for (int a = 0; a < 3; a++) counts[a] = (int)(all_attributes[a].size() / components[a]);
+
+    //make relative indices global, and check all of them
+    std::vector<unsigned char> valid(num_chunks);
+    parallelFor(num_chunks, 1, [&](int begin, int end, int) {
+        for (int i = begin; i < end; i++) {
+            ObjChunk& chunk = chunks[i];
+            bool chunk_valid = true;
+            for (size_t c = 0; c < chunk.corners.size(); c++) {
+                int* index = chunk.corners[c].index;
+                for (int a = 0; a < 3; a++) {
+                    if (chunk.relative[c] & (1 << a)) index[a] += starts[i * 3 + a];
+                    if (index[a] >= counts[a] || (index[a] < 0 && (a == 0 || chunk.relative[c] & (1 << a))))
+                        chunk_valid = false;
                 }
-
             }
+            valid[i] = chunk_valid;
+        }
+    });
+    for (int i = 0; i < num_chunks; i++) {
+        if (!valid[i]) {
+            std::cerr << "ERROR: OBJ face index out of range: " << filename << std::endl;
+            return false;
+        }
+    }
 
+    //corner keys are 64 bit integers when the indices fit, which is nearly always
+    int t_bits = bitsFor(counts[1]), n_bits = bitsFor(counts[2]);
+    std::vector<unsigned char> missing_normal;
+    size_t first_vertex = vertices.size() / 3;
+    bool any_missing;
+    if (bitsFor(counts[0]) + t_bits + n_bits <= 64) {
+        auto make_key = [=](const ObjCorner& corner) {
+            return (uint64_t)corner.index[0] << (t_bits + n_bits) | (uint64_t)(corner.index[1] + 1) << n_bits | (uint64_t)(corner.index[2] + 1);
+        };
+        any_missing = buildOBJVertices<uint64_t>(chunks, all_attributes[0], all_attributes[1], all_attributes[2], make_key,
+            vertices, uvs, normals, indices, missing_normal);
+    }
+    else {
+        auto make_key = [](const ObjCorner& corner) {
+            ObjWideKey key = { (uint32_t)corner.index[0], (uint32_t)corner.index[1], (uint32_t)corner.index[2] };
+            return key;
+        };
+        any_missing = buildOBJVertices<ObjWideKey>(chunks, all_attributes[0], all_attributes[1], all_attributes[2], make_key,
+            vertices, uvs, normals, indices, missing_normal);
+    }
+    if (!any_missing) return true;
+
+    //sum the face normals at the vertices without one, then normalize
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        unsigned int tri[3] = { indices[i], indices[i + 1], indices[i + 2] };
+        if (!missing_normal[tri[0] - first_vertex] && !missing_normal[tri[1] - first_vertex] && !missing_normal[tri[2] - first_vertex]) continue;
+        lm::vec3 p0(vertices[tri[0] * 3], vertices[tri[0] * 3 + 1], vertices[tri[0] * 3 + 2]);
+        lm::vec3 p1(vertices[tri[1] * 3], vertices[tri[1] * 3 + 1], vertices[tri[1] * 3 + 2]);
+        lm::vec3 p2(vertices[tri[2] * 3], vertices[tri[2] * 3 + 1], vertices[tri[2] * 3 + 2]);
+        lm::vec3 face_normal = (p1 - p0).cross(p2 - p0); //length is twice the area
+        for (int k = 0; k < 3; k++) {
+            if (!missing_normal[tri[k] - first_vertex]) continue;
+            for (int j = 0; j < 3; j++) normals[tri[k] * 3 + j] += face_normal.value_[j];
         }
-        file.close();
-        return true;
     }
-    return false;
+    for (size_t v = 0; v < missing_normal.size(); v++) {
+        if (!missing_normal[v]) continue;
+        float* n = &normals[(first_vertex + v) * 3];
+        float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length > 0.0f) for (int j = 0; j < 3; j++) n[j] /= length;
+    }
+    return true;
 }
 
 bool Parsers::parseBin(std::string filename, std::vector<float>& vertices, std::vector<float>& uvs, std::vector<float>& normals, std::vector<unsigned int>& indices)
 {
     FILE* f = nullptr;
     f = fopen(filename.c_str(), "rb");
+    if (!f) return false;
 
     //declare containers for temporary and final attributes
     THeader header;
     std::vector<float> temp_vtxs;
+    std::vector<unsigned char> temp_idxs;
 
     //parse file line by line
     bool eof_found = false;
@@ -167,7 +474,7 @@ bool Parsers::parseBin(std::string filename, std::vector<float>& vertices, std::
         //split line string
         TChunk chunk;
         auto bytes_read = fread(&chunk, 1, sizeof(chunk), f);
-        assert(bytes_read == sizeof(chunk));
+        if (bytes_read != sizeof(chunk)) break;
 
         switch (chunk.magic_id) {
 
@@ -179,21 +486,23 @@ bool Parsers::parseBin(std::string filename, std::vector<float>& vertices, std::
 
         case magicVtxs:
 
-            temp_vtxs.resize(chunk.num_bytes);
+            //chunk size is in bytes, not floats
+            temp_vtxs.resize(chunk.num_bytes / sizeof(float));
             bytes_read = fread(temp_vtxs.data(), 1, chunk.num_bytes, f);
             assert(bytes_read == chunk.num_bytes);
             break;
 
         case magicIdxs:
 
-            indices.resize(chunk.num_bytes);
-            bytes_read = fread(indices.data(), 1, chunk.num_bytes, f);
+            temp_idxs.resize(chunk.num_bytes);
+            bytes_read = fread(temp_idxs.data(), 1, chunk.num_bytes, f);
             assert(bytes_read == chunk.num_bytes);
             break;
 
         case magicSubGroups:
 
             // add subgroups here
+            fseek(f, chunk.num_bytes, SEEK_CUR);
             break;
 
         case magicEoF:
@@ -203,68 +512,50 @@ bool Parsers::parseBin(std::string filename, std::vector<float>& vertices, std::
 
         default:
             //printf("Unknown chunk data type %08x of %d bytes while reading file %s\n", chunk.magic_id, chunk.num_bytes, filename.c_str());
+            fseek(f, chunk.num_bytes, SEEK_CUR);
             break;
         }
     }
+    fclose(f);
 
-    // Replace this with an efficient system without hardcoded sizes!
-    int vertex_size = header.bytes_per_vtx / sizeof(float);
-
-    for (unsigned int i = 0; i < temp_vtxs.size() - vertex_size; i = i + vertex_size) {
+    //indices can be stored with 2 or 4 bytes
+    if (header.bytes_per_idx == 2) {
+        const uint16_t* idxs = (const uint16_t*)temp_idxs.data();
+        indices.assign(idxs, idxs + temp_idxs.size() / 2);
+    }
+    else {
+        const uint32_t* idxs = (const uint32_t*)temp_idxs.data();
+        indices.assign(idxs, idxs + temp_idxs.size() / 4);
+    }
 
-        vertices.insert(vertices.end(), { temp_vtxs[i], temp_vtxs[i + 1], temp_vtxs[i + 2] });
-        normals.insert(normals.end(), { temp_vtxs[i + 3], temp_vtxs[i + 4], temp_vtxs[i + 5] });
-        uvs.insert(uvs.end(), { temp_vtxs[i + 6], temp_vtxs[i + 7] });
+    // vertex layout is position, normal, uv, then anything else (e.g. tangents)
+    size_t vertex_size = header.bytes_per_vtx / sizeof(float);
+    if (vertex_size < 8) return false;
+    size_t num_vertices = temp_vtxs.size() / vertex_size;
+    vertices.resize(num_vertices * 3);
+    normals.resize(num_vertices * 3);
+    uvs.resize(num_vertices * 2);
+    for (size_t v = 0; v < num_vertices; v++) {
+        const float* src = &temp_vtxs[v * vertex_size];
+        memcpy(&vertices[v * 3], src, 3 * sizeof(float));
+        memcpy(&normals[v * 3], src + 3, 3 * sizeof(float));
+        memcpy(&uvs[v * 2], src + 6, 2 * sizeof(float));
     }
 
-    fclose(f);
     return true;
 }
 
-// load uncompressed RGB targa file into an OpenGL texture
+// load uncompressed RGB targa file, or a cooked DDS/KTX file, into an OpenGL texture
 GLint Parsers::parseTexture(std::string filename) {
     std::string str = filename;
     std::string ext = str.substr(str.size() - 4, 4);
 
 
-    GLuint texture_id;
-
-    if (ext == ".tga" || ext == ".TGA")
+    //decoded on worker threads and uploaded over the next frames, see TextureStreamer.
+    //A cooked .dds next to a .tga is loaded instead of it
+    if (ext == ".tga" || ext == ".TGA" || ext == ".dds" || ext == ".DDS" || ext == ".ktx" || ext == ".KTX")
     {
-        TGAInfo* tgainfo = loadTGA(filename);
-        if (tgainfo == NULL) {
-            std::cerr << "ERROR: Could not load TGA file" << std::endl;
-            return false;
-        }
-
-        //generate new openGL texture and bind it (tell openGL we want to do stuff with it)
-        glGenTextures(1, &texture_id);
-        glBindTexture(GL_TEXTURE_2D, texture_id); //we are making a regular 2D texture
-
-                                                  //screen pixels will almost certainly not be same as texture pixels, so we need to
-                                                  //set some parameters regarding the filter we use to deal with these cases
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);	//set the mag filter
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR); //set the min filter
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, 4); //use anisotropic filtering
-
-                                                                          //this is function that actually loads texture data into OpenGL
-        glTexImage2D(GL_TEXTURE_2D, //the target type, a 2D texture
-            0, //the base level-of-detail in the mipmap
-            (tgainfo->bpp == 24 ? GL_RGB : GL_RGBA), //specified the color channels for opengl
-            tgainfo->width, //the width of the texture
-            tgainfo->height, //the height of the texture
-            0, //border - must always be 0
-            (tgainfo->bpp == 24 ? GL_BGR : GL_BGRA), //the format of the incoming data
-            GL_UNSIGNED_BYTE, //the type of the incoming data
-            tgainfo->data); // a pointer to the incoming data
-
-                            //we want to use mipmaps
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        //clean up memory
-        delete tgainfo->data;
-        delete tgainfo;
-        return texture_id;
+        return TextureStreamer::load(filename);
     }
     else {
         std::cerr << "ERROR: No extension or extension not supported" << std::endl;
@@ -415,7 +706,8 @@ bool Parsers::parseJSONLevel(std::string filename,
         //create material
         int mat_id = graphics_system.createMaterial();
         //shader_id is mandatory
-        graphics_system.getMaterial(mat_id).shader_id = shaders[json["materials"][i]["shader"].GetString()];
+        graphics_system.getMaterial(mat_id).shader_id = graphics_system.getMaterial(mat_id).base_shader_id =
+            shaders[json["materials"][i]["shader"].GetString()];
 
         //optional properties
         //diffuse texture
@@ -423,6 +715,11 @@ bool Parsers::parseJSONLevel(std::string filename,
             std::string diffuse = json["materials"][i]["diffuse_texture"].GetString();
             graphics_system.getMaterial(mat_id).diffuse_map = textures[diffuse]; //assign texture id from material
         }
+        //specular texture
+        if (json["materials"][i].HasMember("specular_texture")) {
+            std::string specular = json["materials"][i]["specular_texture"].GetString();
+            graphics_system.getMaterial(mat_id).specular_map = textures[specular];
+        }
         //specular
         if (json["materials"][i].HasMember("specular")) {
             auto& json_spec = json["materials"][i]["specular"];
@@ -640,6 +937,9 @@ int Parsers::parseEntity(rapidjson::Value & entity, GraphicsSystem & graphics_sy
         Mesh& ent_mesh = ECS.createComponentForEntity<Mesh>(ent_id);
         ent_mesh.geometry = geo_id;
         ent_mesh.material = mat_id;
+        //optional: mesh is rendered into the occlusion culling depth buffer
+        if (entity["render"].HasMember("occluder"))
+            ent_mesh.occluder = entity["render"]["occluder"].GetBool();
     }
 
     // Load collider parameters
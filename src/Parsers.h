@@ -39,9 +39,9 @@ static const uint32_t magicSubGroups =  0x55556688;
 static const uint32_t magicEoF =        0x55558888;
 
 class Parsers {
-private:
-    static TGAInfo* loadTGA(std::string filename);
 public:
+    //reads a TGA file into memory. Does not use OpenGL, so it can run on any thread
+    static TGAInfo* loadTGA(std::string filename);
 
     static std::unordered_map<std::string, int> geometries;
     static std::unordered_map<std::string, int> textures;
@@ -1,5 +1,8 @@
 #include "Shader.h"
+#include "render/ShaderCache.h"
+#include "render/RenderStats.h"
 #include <vector>
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 
@@ -19,6 +22,8 @@ std::vector<std::string> split(const std::string &s, char delim) {
     return elems;
 }
 
+std::vector<Shader*> Shader::pending_shaders_;
+
 Shader::Shader() {}
 
 //uniform setters
@@ -65,6 +70,7 @@ bool Shader::setTexture(UniformID id, GLuint tex_id, GLuint unit) {
     //get texture id and bind it
     glActiveTexture(GL_TEXTURE0 + unit);
     glBindTexture(GL_TEXTURE_2D, tex_id);
+    RenderStats::add(RenderStats::TEXTURE_BINDS);
     // tell sampler which slot its in
     GLint loc = getUniformLocation(id);
     if (loc != -1) {
@@ -78,6 +84,21 @@ bool Shader::setTextureCube(UniformID id, GLuint tex_id, GLuint unit) {
     //get texture id and bind it
     glActiveTexture(GL_TEXTURE0 + unit);
     glBindTexture(GL_TEXTURE_CUBE_MAP, tex_id);
+    RenderStats::add(RenderStats::TEXTURE_BINDS);
+    // tell sampler which slot its in
+    GLint loc = getUniformLocation(id);
+    if (loc != -1) {
+        glUniform1i(loc, unit);
+        return true;
+    }
+    return false;
+}
+//2D texture array
+bool Shader::setTextureArray(UniformID id, GLuint tex_id, GLuint unit) {
+    //get texture id and bind it
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, tex_id);
+    RenderStats::add(RenderStats::TEXTURE_BINDS);
     // tell sampler which slot its in
     GLint loc = getUniformLocation(id);
     if (loc != -1) {
@@ -101,59 +122,119 @@ Shader::Shader(std::string vertSource, std::string fragSource) {
     
 	std::string vertexShaderSourceCode=readFile(vertSource);
 	std::string fragmentShaderSourceCode=readFile(fragSource);
-    makeShaderProgram(makeVertexShader(vertexShaderSourceCode.c_str()), makeFragmentShader(fragmentShaderSourceCode.c_str()));
+    startProgram_(vertexShaderSourceCode, fragmentShaderSourceCode);
+}
+
+Shader::~Shader() {
+    pending_shaders_.erase(std::remove(pending_shaders_.begin(), pending_shaders_.end(), this), pending_shaders_.end());
 }
 
 GLuint Shader::compileFromStrings(std::string vsh, std::string fsh) {
-	makeShaderProgram(makeVertexShader(vsh.c_str()), makeFragmentShader(fsh.c_str()));
+	startProgram_(vsh, fsh);
 	return 1;
 }
 
-GLuint Shader::makeVertexShader(const char* shaderSource)
-{
-    GLuint vertexShaderID=glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShaderID,1,(const GLchar**)&shaderSource, NULL);
-    glCompileShader(vertexShaderID);
-    
+//loads the program from the shader cache or, on a miss, starts compiling and
+//linking it. Results are not queried here, so with parallel shader compile the
+//driver keeps working while the engine loads the rest of the scene
+void Shader::startProgram_(const std::string& vsh, const std::string& fsh) {
+    cache_key_ = ShaderCache::hashSources(vsh, fsh);
+    program = glCreateProgram();
+    if (ShaderCache::loadProgram(program, cache_key_)) {
+        linked_ = true;
+        initUniforms_();
+        return;
+    }
+    //a rejected binary leaves the program in an undefined state, start again
+    glDeleteProgram(program);
+    program = glCreateProgram();
+
+    vertex_shader_ = createShader_(GL_VERTEX_SHADER, vsh.c_str());
+    fragment_shader_ = createShader_(GL_FRAGMENT_SHADER, fsh.c_str());
+    glAttachShader(program, vertex_shader_);
+    glAttachShader(program, fragment_shader_);
+    ShaderCache::prepareProgram(program);
+    glLinkProgram(program);
+
+    vertex_source_ = vsh;
+    fragment_source_ = fsh;
+    pending_ = true;
+    pending_shaders_.push_back(this);
+    if (!ShaderCache::parallelCompile()) finishLink();
+}
+
+bool Shader::finishLink() {
+    if (!pending_) return linked_;
+    pending_ = false;
+    pending_shaders_.erase(std::remove(pending_shaders_.begin(), pending_shaders_.end(), this), pending_shaders_.end());
+
+    checkShader_(vertex_shader_, vertex_source_);
+    checkShader_(fragment_shader_, fragment_source_);
+    GLint link_ok = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
+    linked_ = link_ok == GL_TRUE;
+    if (!linked_) {
+        fprintf(stderr, "glLinkProgram:");
+        saveProgramInfoLog(program);
+    }
+    else {
+        ShaderCache::storeProgram(program, cache_key_);
+    }
+
+    //the linked program keeps everything it needs
+    glDetachShader(program, vertex_shader_);
+    glDetachShader(program, fragment_shader_);
+    glDeleteShader(vertex_shader_);
+    glDeleteShader(fragment_shader_);
+    vertex_shader_ = fragment_shader_ = 0;
+    vertex_source_.clear();
+    fragment_source_.clear();
+
+    initUniforms_();
+    return linked_;
+}
+
+void Shader::finishPending() {
+    //finishLink removes the shader from the list
+    while (!pending_shaders_.empty())
+        pending_shaders_.back()->finishLink();
+    ShaderCache::save();
+}
+
+GLuint Shader::createShader_(GLenum type, const char* shaderSource) {
+    GLuint shaderID=glCreateShader(type);
+    glShaderSource(shaderID,1,(const GLchar**)&shaderSource, NULL);
+    glCompileShader(shaderID);
+    return shaderID;
+}
+
+//prints log and code of shaders which failed to compile
+bool Shader::checkShader_(GLuint shaderID, const std::string& shaderSource) {
     GLint compile=0;
-    glGetShaderiv(vertexShaderID,GL_COMPILE_STATUS,&compile);
+    glGetShaderiv(shaderID,GL_COMPILE_STATUS,&compile);
     
     //we want to see the compile log if we are in debug (to check warnings)
     if (!compile)
     {
-        saveShaderInfoLog(vertexShaderID);
+        saveShaderInfoLog(shaderID);
         std::cout << "Shader code:\n " << std::endl;
-        std::string code = shaderSource;
-        std::vector<std::string> lines = split( code, '\n' );
+        std::vector<std::string> lines = split( shaderSource, '\n' );
         for( size_t i = 0; i < lines.size(); ++i)
             std::cout << i << "  " << lines[i] << std::endl;
-    
     }
-    
-    
+    return compile != 0;
+}
+
+GLuint Shader::makeVertexShader(const char* shaderSource)
+{
+    GLuint vertexShaderID = createShader_(GL_VERTEX_SHADER, shaderSource);
+    checkShader_(vertexShaderID, shaderSource);
     return vertexShaderID;
 }
 GLuint Shader::makeFragmentShader(const char* shaderSource)
 {
-    GLuint fragmentShaderID=glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShaderID,1,(const GLchar**)&shaderSource, NULL);
-    glCompileShader(fragmentShaderID);
-    
-    GLint compile=0;
-    glGetShaderiv(fragmentShaderID,GL_COMPILE_STATUS,&compile);
-    
-    //we want to see the compile log if we are in debug (to check warnings)
-    if (!compile)
-    {
-        saveShaderInfoLog(fragmentShaderID);
-        std::cout << "Shader code:\n " << std::endl;
-        std::string code = shaderSource;
-        std::vector<std::string> lines = split( code, '\n' );
-        for( size_t i = 0; i < lines.size(); ++i)
-            std::cout << i << "  " << lines[i] << std::endl;
-        
-    }
-    
+    GLuint fragmentShaderID = createShader_(GL_FRAGMENT_SHADER, shaderSource);
+    checkShader_(fragmentShaderID, shaderSource);
     return fragmentShaderID;
 }
 
@@ -206,6 +287,7 @@ void Shader::makeShaderProgram(GLuint vertexShaderID,GLuint fragmentShaderID)
         fprintf(stderr, "glLinkProgram:");
         saveProgramInfoLog(program);
     }
+    linked_ = link_ok == GL_TRUE;
     
     //init uniforms
     initUniforms_();
@@ -238,6 +320,7 @@ void Shader::initUniforms_() {
 
 //Returns location of uniform with given enum
 GLuint Shader::getUniformLocation(UniformID name) {
+	if (pending_) finishLink();
 	return uniform_locations_[name];
 }
 
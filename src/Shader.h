@@ -3,6 +3,7 @@
 #include "includes.h"
 #include <unordered_map>
 #include <vector>
+#include <cstdint>
 
 //Uniform IDs are global so that we can access them in Graphics System
 enum UniformID {
@@ -19,9 +20,19 @@ enum UniformID {
 	U_SPECULAR_GLOSS,
 	U_USE_DIFFUSE_MAP,
 	U_DIFFUSE_MAP,
+	U_SPECULAR_MAP,
 	U_SKYBOX,
 	U_USE_REFLECTION_MAP,
 	U_NUM_LIGHTS,
+	U_LIGHT_DATA,
+	U_LIGHT_GRID,
+	U_LIGHT_INDICES,
+	U_CLUSTER_Z,
+	U_VIEWPORT,
+	U_CAM_FORWARD,
+	U_MATERIAL,
+	U_MATERIAL_DATA,
+	U_ICON,
 	UNIFORMS_COUNT
 };
 
@@ -40,9 +51,19 @@ const std::unordered_map<std::string, UniformID> uniform_string2id_ = {
 	{ "u_specular_gloss", U_SPECULAR_GLOSS },
 	{ "u_use_diffuse_map", U_USE_DIFFUSE_MAP },
 	{ "u_diffuse_map", U_DIFFUSE_MAP },
+	{ "u_specular_map", U_SPECULAR_MAP },
 	{ "u_skybox", U_SKYBOX },
 	{ "u_use_reflection_map", U_USE_REFLECTION_MAP },
-	{ "u_num_lights", U_NUM_LIGHTS }
+	{ "u_num_lights", U_NUM_LIGHTS },
+	{ "u_light_data", U_LIGHT_DATA },
+	{ "u_light_grid", U_LIGHT_GRID },
+	{ "u_light_indices", U_LIGHT_INDICES },
+	{ "u_cluster_z", U_CLUSTER_Z },
+	{ "u_viewport", U_VIEWPORT },
+	{ "u_cam_forward", U_CAM_FORWARD },
+	{ "u_material", U_MATERIAL },
+	{ "u_material_data", U_MATERIAL_DATA },
+	{ "u_icon", U_ICON }
 };
 
 
@@ -51,12 +72,26 @@ private:
 	//stores, for each uniform enum, it's location
 	std::vector<GLuint> uniform_locations_;
 	void initUniforms_();
+
+	//programs started but not finished linking (see finishLink)
+	static std::vector<Shader*> pending_shaders_;
+	bool pending_ = false;
+	bool linked_ = false;
+	uint64_t cache_key_ = 0;
+	GLuint vertex_shader_ = 0;
+	GLuint fragment_shader_ = 0;
+	std::string vertex_source_;
+	std::string fragment_source_;
+	void startProgram_(const std::string& vsh, const std::string& fsh);
+	GLuint createShader_(GLenum type, const char* shaderSource);
+	bool checkShader_(GLuint shaderID, const std::string& shaderSource);
     
 public:
     GLuint program;
 	std::string name;
 	Shader();
     Shader(std::string vertSource, std::string fragSource);
+	~Shader();
     std::string readFile(std::string filename);
 	GLuint compileFromStrings(std::string vsh, std::string fsh);
     GLuint makeVertexShader(const char* shaderSource);
@@ -66,6 +101,14 @@ public:
     void saveProgramInfoLog(GLuint obj);
     void saveShaderInfoLog(GLuint obj);
     std::string log;
+
+	//checks compile and link results, stores the program in the shader cache
+	//and finds uniforms. Called automatically the first time a uniform is
+	//needed; calling it earlier waits for the driver to finish the program.
+	//Returns true if the program linked
+	bool finishLink();
+	//finishes all programs still being compiled in the background
+	static void finishPending();
     
 	//
     GLuint getUniformLocation(UniformID name);
@@ -76,6 +119,7 @@ public:
     bool setUniform(UniformID id, const lm::mat4& data);
     bool setTexture(UniformID id, GLuint tex_id, GLuint unit);
     bool setTextureCube(UniformID id, GLuint tex_id, GLuint unit);
+    bool setTextureArray(UniformID id, GLuint tex_id, GLuint unit);
     
     
 };
@@ -6,6 +6,7 @@
 #include "includes.h"
 #include "extern.h"
 #include "Game.h"
+#include "tools/Headless.h"
 
 #define WINDOW_WIDTH 1280
 #define WINDOW_HEIGHT 768
@@ -39,16 +40,37 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     //quit
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
         glfwSetWindowShouldClose(window, 1);
+	EditorIdle::onInput(true);
 	GAME->key_callback(key, scancode, action, mods);
 }
 
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 {
+	EditorIdle::onInput(true);
 	GAME->mouse_button_callback(button, action, mods);
 }
 
-int main(void)
+//only wake the editor up, ImGui handles them (it chains to these callbacks)
+void scroll_callback(GLFWwindow* window, double x_offset, double y_offset)
 {
+	EditorIdle::onInput(false);
+}
+
+void char_callback(GLFWwindow* window, unsigned int codepoint)
+{
+	EditorIdle::onInput(false);
+}
+
+int main(int argc, char** argv)
+{
+    //--headless runs a fixed number of frames without showing the window
+    Headless::Options headless;
+    if (!Headless::parseArgs(argc, argv, headless))
+        return -1;
+    //runs without a window or GL context
+    if (headless.check_traversal)
+        return Headless::checkTraversal();
+
     // register the error call-back function before doing anything else
     glfwSetErrorCallback(glfw_error_callback);
     
@@ -66,6 +88,8 @@ int main(void)
 #ifdef __APPLE__
 	glfwWindowHint(GLFW_TRANSPARENT_FRAMEBUFFER, GLFW_TRUE);
 #endif
+    if (headless.enabled)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
     
     // Create a windowed mode window and its OpenGL context
     window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "MVD Engine. 2018-2019", NULL, NULL);
@@ -90,6 +114,8 @@ int main(void)
     //input callbacks
     glfwSetKeyCallback(window, key_callback);
     glfwSetMouseButtonCallback(window, mouse_button_callback);
+    glfwSetScrollCallback(window, scroll_callback);
+    glfwSetCharCallback(window, char_callback);
     glfwSetInputMode(window, GLFW_STICKY_KEYS, 1);
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     
@@ -117,8 +143,19 @@ int main(void)
 
 	//create game singleton and initialise it
 	GAME = new Game();
+	GAME->headless = headless.enabled;
 	GAME->init(WINDOW_WIDTH, WINDOW_HEIGHT);
 	GAME->update_viewports(WINDOW_WIDTH, WINDOW_HEIGHT);
+
+	int result = 0;
+	if (headless.enabled) {
+		//frames are not limited by vsync
+		glfwSwapInterval(0);
+		GAME->getGraphicsSystem().setNullBackend(headless.null_render);
+		result = Headless::run(*GAME, window, headless);
+		glfwSetWindowShouldClose(window, 1);
+	}
+
 	//stores difference in time between each frame
 	float dt = 0.0f;
 	double curr_time = 0.0, prev_time = glfwGetTime();
@@ -142,9 +179,13 @@ int main(void)
 			frame_counter_time = 0.0;
 		}
 
-        // Poll events update mouse position
-        glfwPollEvents();
+        // Poll events update mouse position. An idle editor waits for them instead
+        double wait = GAME->getEventWait();
+        if (wait > 0.0) glfwWaitEventsTimeout(wait);
+        else glfwPollEvents();
+        double prev_mouse_x = mouse_x, prev_mouse_y = mouse_y;
         glfwGetCursorPos(window, &mouse_x, &mouse_y);
+        if (mouse_x != prev_mouse_x || mouse_y != prev_mouse_y) EditorIdle::onInput(false);
 		GAME->updateMousePosition((int)mouse_x, (int)mouse_y);
 
 		//update game
@@ -163,7 +204,7 @@ int main(void)
 
     //terminate glfw and exit
     glfwTerminate();
-    return 0;
+    return result;
 }
 
 
@@ -0,0 +1,250 @@
+#include "CompressedTexture.h"
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+static uint32_t fourCC(const char* s) {
+    return (uint32_t)s[0] | ((uint32_t)s[1] << 8) | ((uint32_t)s[2] << 16) | ((uint32_t)s[3] << 24);
+}
+
+//DDS file layout, see the DirectX documentation of DDS_HEADER
+struct DDSPixelFormat {
+    uint32_t size;
+    uint32_t flags;
+    uint32_t four_cc;
+    uint32_t rgb_bit_count;
+    uint32_t masks[4];
+};
+
+struct DDSHeader {
+    uint32_t size;
+    uint32_t flags;
+    uint32_t height;
+    uint32_t width;
+    uint32_t linear_size;
+    uint32_t depth;
+    uint32_t mip_count;
+    uint32_t reserved1[11];
+    DDSPixelFormat format;
+    uint32_t caps[4];
+    uint32_t reserved2;
+};
+
+struct DDSHeaderDX10 {
+    uint32_t dxgi_format;
+    uint32_t dimension;
+    uint32_t misc_flags;
+    uint32_t array_size;
+    uint32_t misc_flags2;
+};
+
+static const uint32_t kDDSMagic = 0x20534444; //"DDS "
+static const uint32_t kDDPFFourCC = 0x4;
+static const uint32_t kDDSDFlags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; //caps, size, format, mips, linear size
+static const uint32_t kDDSCaps = 0x1000 | 0x400000 | 0x8; //texture, mipmap, complex
+//in reserved1[0] of files written by saveDDS, whose rows are bottom-up
+static const uint32_t kDDSBottomUp = 0x50555442; //"BTUP"
+
+static const unsigned char kKTXIdentifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+size_t compressedBlockBytes(GLenum format) {
+    switch (format) {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        return 8;
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+    case GL_COMPRESSED_RG_RGTC2:
+        return 16;
+    }
+    return 0;
+}
+
+size_t compressedLevelSize(GLenum format, GLuint width, GLuint height) {
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * compressedBlockBytes(format);
+}
+
+bool compressedFormatSupported(GLenum format) {
+    if (format == GL_COMPRESSED_RG_RGTC2) return true; //core since 3.0
+    return compressedBlockBytes(format) && GLEW_EXT_texture_compression_s3tc;
+}
+
+//fills the level table of an image whose levels are stored back to back
+static bool setLevels(CompressedImage& image, GLuint num_levels, size_t data_size) {
+    if (!compressedBlockBytes(image.format) || !image.width || !image.height) return false;
+    image.levels.clear();
+    size_t offset = 0;
+    GLuint w = image.width, h = image.height;
+    for (GLuint l = 0; l < std::max(num_levels, 1u); l++) {
+        size_t size = compressedLevelSize(image.format, w, h);
+        if (offset + size > data_size) break;
+        image.levels.push_back({ w, h, offset, size });
+        offset += size;
+        if (w == 1 && h == 1) break;
+        w = std::max(1u, w / 2);
+        h = std::max(1u, h / 2);
+    }
+    return !image.levels.empty();
+}
+
+//BC1 colour block: two endpoints, then one byte of 2 bit indices per row
+static void flipBC1Block(unsigned char* block, GLuint rows) {
+    std::reverse(block + 4, block + 4 + rows);
+}
+
+//BC4 block (alpha of BC3, channels of BC5): two endpoints, then 48 bits of
+//3 bit indices, 12 bits per row
+static void flipBC4Block(unsigned char* block, GLuint rows) {
+    uint64_t bits = 0;
+    for (int i = 0; i < 6; i++) bits |= (uint64_t)block[2 + i] << (8 * i);
+    uint64_t flipped = bits;
+    for (GLuint r = 0; r < rows; r++) {
+        GLuint to = rows - 1 - r;
+        flipped &= ~(0xFFFULL << (12 * to));
+        flipped |= ((bits >> (12 * r)) & 0xFFF) << (12 * to);
+    }
+    for (int i = 0; i < 6; i++) block[2 + i] = (unsigned char)(flipped >> (8 * i));
+}
+
+//turns the levels of a top-down image upside down: block rows are swapped, and
+//texel rows inside each block. Levels less than 4 texels high only have their
+//first rows in use. Heights above 4 which are not a multiple of 4 would need
+//the blocks re-encoded, their padding rows end up at the top
+static void flipLevels(CompressedImage& image) {
+    size_t block_bytes = compressedBlockBytes(image.format);
+    for (auto& level : image.levels) {
+        GLuint blocks_x = (level.width + 3) / 4, blocks_y = (level.height + 3) / 4;
+        GLuint rows = std::min(level.height, 4u);
+        size_t row_bytes = blocks_x * block_bytes;
+        unsigned char* data = image.data.data() + level.offset;
+        for (GLuint y = 0; y < blocks_y / 2; y++)
+            std::swap_ranges(data + y * row_bytes, data + (y + 1) * row_bytes, data + (blocks_y - 1 - y) * row_bytes);
+        for (size_t b = 0; b < level.size; b += block_bytes) {
+            unsigned char* block = data + b;
+            switch (image.format) {
+            case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+            case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+                flipBC1Block(block, rows);
+                break;
+            case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+                flipBC4Block(block, rows);
+                flipBC1Block(block + 8, rows);
+                break;
+            case GL_COMPRESSED_RG_RGTC2:
+                flipBC4Block(block, rows);
+                flipBC4Block(block + 8, rows);
+                break;
+            }
+        }
+    }
+}
+
+bool loadDDS(const std::string& filename, CompressedImage& image) {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file) return false;
+    size_t file_size = (size_t)file.tellg();
+    file.seekg(0);
+
+    uint32_t magic = 0;
+    DDSHeader header;
+    if (!file.read((char*)&magic, 4) || magic != kDDSMagic) return false;
+    if (!file.read((char*)&header, sizeof(header)) || header.size != sizeof(header)) return false;
+    size_t data_start = 4 + sizeof(header);
+
+    image.format = 0;
+    if (header.format.flags & kDDPFFourCC) {
+        uint32_t cc = header.format.four_cc;
+        if (cc == fourCC("DXT1")) image.format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        else if (cc == fourCC("DXT5")) image.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        else if (cc == fourCC("ATI2") || cc == fourCC("BC5U")) image.format = GL_COMPRESSED_RG_RGTC2;
+        else if (cc == fourCC("DX10")) {
+            DDSHeaderDX10 dx10;
+            if (!file.read((char*)&dx10, sizeof(dx10))) return false;
+            data_start += sizeof(dx10);
+            switch (dx10.dxgi_format) {
+            case 71: case 72: image.format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; break; //BC1_UNORM(_SRGB)
+            case 77: case 78: image.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break; //BC3_UNORM(_SRGB)
+            case 83: image.format = GL_COMPRESSED_RG_RGTC2; break; //BC5_UNORM
+            }
+        }
+    }
+    if (!image.format) {
+        std::cerr << "ERROR: DDS format not supported (only BC1, BC3 and BC5): " << filename << std::endl;
+        return false;
+    }
+
+    image.width = header.width;
+    image.height = header.height;
+    image.data.resize(file_size - data_start);
+    if (!file.read((char*)image.data.data(), image.data.size())) return false;
+    if (!setLevels(image, header.mip_count, image.data.size())) return false;
+    if (header.reserved1[0] != kDDSBottomUp) flipLevels(image);
+    return true;
+}
+
+bool loadKTX(const std::string& filename, CompressedImage& image) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) return false;
+
+    unsigned char identifier[12];
+    uint32_t fields[13]; //endianness, type, type size, format, internal format, base format,
+                         //width, height, depth, array elements, faces, mip levels, key/value bytes
+    if (!file.read((char*)identifier, 12) || memcmp(identifier, kKTXIdentifier, 12) != 0) return false;
+    if (!file.read((char*)fields, sizeof(fields)) || fields[0] != 0x04030201) return false;
+    if (fields[8] > 1 || fields[9] > 1 || fields[10] != 1) {
+        std::cerr << "ERROR: Only 2D KTX textures are supported: " << filename << std::endl;
+        return false;
+    }
+    image.format = fields[4];
+    image.width = fields[6];
+    image.height = fields[7];
+    if (!compressedBlockBytes(image.format)) {
+        std::cerr << "ERROR: KTX format not supported (only BC1, BC3 and BC5): " << filename << std::endl;
+        return false;
+    }
+    file.seekg(fields[12], std::ios::cur);
+
+    //each level is preceded by its size. Block sizes keep levels 4 byte aligned
+    GLuint num_levels = std::max(fields[11], 1u);
+    image.data.clear();
+    for (GLuint l = 0; l < num_levels; l++) {
+        uint32_t size = 0;
+        if (!file.read((char*)&size, 4)) break;
+        size_t offset = image.data.size();
+        image.data.resize(offset + size);
+        if (!file.read((char*)image.data.data() + offset, size)) {
+            image.data.resize(offset);
+            break;
+        }
+    }
+    return setLevels(image, num_levels, image.data.size());
+}
+
+bool saveDDS(const std::string& filename, const CompressedImage& image) {
+    DDSHeader header;
+    memset(&header, 0, sizeof(header));
+    header.size = sizeof(header);
+    header.flags = kDDSDFlags;
+    header.width = image.width;
+    header.height = image.height;
+    header.linear_size = image.levels.empty() ? 0 : (uint32_t)image.levels[0].size;
+    header.mip_count = (uint32_t)image.levels.size();
+    header.format.size = sizeof(DDSPixelFormat);
+    header.format.flags = kDDPFFourCC;
+    switch (image.format) {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT: header.format.four_cc = fourCC("DXT1"); break;
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: header.format.four_cc = fourCC("DXT5"); break;
+    case GL_COMPRESSED_RG_RGTC2: header.format.four_cc = fourCC("ATI2"); break;
+    default: return false;
+    }
+    header.caps[0] = kDDSCaps;
+    header.reserved1[0] = kDDSBottomUp;
+
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (!file) return false;
+    file.write((const char*)&kDDSMagic, 4);
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)image.data.data(), image.data.size());
+    return (bool)file;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "../includes.h"
+#include <vector>
+
+// Block compressed textures.
+// Loads DDS and KTX (version 1) containers holding BC1, BC3 or BC5 (S3TC DXT1,
+// DXT5 and RGTC2) images with their mip chains, and saves DDS files for the
+// texture cooker (tools/TextureCooker). Images are kept with the first row at
+// the bottom, like the TGA sources and OpenGL, so they can be uploaded with
+// glCompressedTexImage2D as they are. KTX files and cooked DDS files (marked in
+// a reserved header field) are stored that way; other DDS files are written
+// top-down by DirectX tools, so their blocks are flipped on load.
+// Nothing here uses OpenGL, so loading can run on worker threads.
+
+struct CompressedLevel {
+    GLuint width;
+    GLuint height;
+    size_t offset; //in CompressedImage::data
+    size_t size;
+};
+
+struct CompressedImage {
+    GLenum format = 0; //GL internal format
+    GLuint width = 0;
+    GLuint height = 0;
+    std::vector<CompressedLevel> levels;
+    std::vector<unsigned char> data;
+};
+
+//bytes per 4x4 block of a compressed format, 0 if not supported
+size_t compressedBlockBytes(GLenum format);
+//size of a level in bytes
+size_t compressedLevelSize(GLenum format, GLuint width, GLuint height);
+//true if the driver can sample this format
+bool compressedFormatSupported(GLenum format);
+
+bool loadDDS(const std::string& filename, CompressedImage& image);
+bool loadKTX(const std::string& filename, CompressedImage& image);
+bool saveDDS(const std::string& filename, const CompressedImage& image);
@@ -0,0 +1,208 @@
+#include "DebugDraw.h"
+#include "RenderStats.h"
+#include "../Shader.h"
+#include "../shaders_default.h"
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+struct DebugVertex {
+    float x, y, z;
+    GLubyte color[4];
+};
+
+//line kept for several frames
+struct TimedLine {
+    DebugVertex a, b;
+    float time_left;
+    bool depth_test;
+};
+
+static std::mutex mutex_;
+static std::vector<DebugVertex> vertices_[2]; //depth tested, on top
+static std::vector<TimedLine> timed_lines_;
+static Shader* shader_ = nullptr;
+static GLuint vao_ = 0;
+static GLuint vbo_ = 0;
+static size_t vbo_size_ = 0; //bytes
+static int num_lines_ = 0;
+
+static DebugVertex makeVertex(const lm::vec3& p, const lm::vec3& color) {
+    DebugVertex v;
+    v.x = p.x; v.y = p.y; v.z = p.z;
+    v.color[0] = (GLubyte)(std::min(std::max(color.x, 0.0f), 1.0f) * 255.0f);
+    v.color[1] = (GLubyte)(std::min(std::max(color.y, 0.0f), 1.0f) * 255.0f);
+    v.color[2] = (GLubyte)(std::min(std::max(color.z, 0.0f), 1.0f) * 255.0f);
+    v.color[3] = 255;
+    return v;
+}
+
+//adds the lines between pairs of points, locking once per primitive
+static void addLines(const lm::vec3* points, const int* pairs, int num_lines,
+                     const lm::vec3& color, float duration, bool depth_test) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (duration > 0.0f) {
+        for (int i = 0; i < num_lines; i++)
+            timed_lines_.push_back({ makeVertex(points[pairs[i * 2]], color), makeVertex(points[pairs[i * 2 + 1]], color),
+                                     duration, depth_test });
+        return;
+    }
+    std::vector<DebugVertex>& vertices = vertices_[depth_test ? 0 : 1];
+    for (int i = 0; i < num_lines * 2; i++)
+        vertices.push_back(makeVertex(points[pairs[i]], color));
+}
+
+//edges of a cube with corners numbered as bits x, y, z
+static const int cube_edges[24] = {
+    0,1, 2,3, 4,5, 6,7, //along x
+    0,2, 1,3, 4,6, 5,7, //along y
+    0,4, 1,5, 2,6, 3,7  //along z
+};
+
+void DebugDraw::init() {
+    if (shader_) return;
+    shader_ = new Shader();
+    shader_->compileFromStrings(g_shader_debug_draw_vertex, g_shader_debug_draw_fragment);
+
+    glGenVertexArrays(1, &vao_);
+    glBindVertexArray(vao_);
+    glGenBuffers(1, &vbo_);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(DebugVertex), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(DebugVertex), (void*)offsetof(DebugVertex, color));
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void DebugDraw::shutdown() {
+    clear();
+    delete shader_;
+    shader_ = nullptr;
+    if (vbo_) glDeleteBuffers(1, &vbo_);
+    if (vao_) glDeleteVertexArrays(1, &vao_);
+    vbo_ = vao_ = 0;
+    vbo_size_ = 0;
+}
+
+void DebugDraw::line(const lm::vec3& a, const lm::vec3& b, const lm::vec3& color, float duration, bool depth_test) {
+    lm::vec3 points[2] = { a, b };
+    int pairs[2] = { 0, 1 };
+    addLines(points, pairs, 1, color, duration, depth_test);
+}
+
+void DebugDraw::box(const lm::vec3& center, const lm::vec3& half_width, const lm::vec3& color, float duration, bool depth_test) {
+    lm::vec3 points[8];
+    for (int i = 0; i < 8; i++)
+        points[i] = center + lm::vec3(i & 1 ? half_width.x : -half_width.x,
+                                      i & 2 ? half_width.y : -half_width.y,
+                                      i & 4 ? half_width.z : -half_width.z);
+    addLines(points, cube_edges, 12, color, duration, depth_test);
+}
+
+void DebugDraw::obb(const lm::mat4& model, const lm::vec3& color, float duration, bool depth_test) {
+    lm::vec3 points[8];
+    for (int i = 0; i < 8; i++)
+        points[i] = model * lm::vec3(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f);
+    addLines(points, cube_edges, 12, color, duration, depth_test);
+}
+
+void DebugDraw::sphere(const lm::vec3& center, float radius, const lm::vec3& color, float duration, bool depth_test) {
+    //circles in the xy, yz and zx planes
+    lm::vec3 points[SPHERE_SEGMENTS * 3];
+    int pairs[SPHERE_SEGMENTS * 6];
+    for (int i = 0; i < SPHERE_SEGMENTS; i++) {
+        float angle = 6.2831853f * i / SPHERE_SEGMENTS;
+        float c = cosf(angle) * radius, s = sinf(angle) * radius;
+        points[i] = center + lm::vec3(c, s, 0);
+        points[SPHERE_SEGMENTS + i] = center + lm::vec3(0, c, s);
+        points[SPHERE_SEGMENTS * 2 + i] = center + lm::vec3(s, 0, c);
+        for (int circle = 0; circle < 3; circle++) {
+            int* pair = &pairs[(circle * SPHERE_SEGMENTS + i) * 2];
+            pair[0] = circle * SPHERE_SEGMENTS + i;
+            pair[1] = circle * SPHERE_SEGMENTS + (i + 1) % SPHERE_SEGMENTS;
+        }
+    }
+    addLines(points, pairs, SPHERE_SEGMENTS * 3, color, duration, depth_test);
+}
+
+void DebugDraw::frustum(const lm::mat4& view_projection, const lm::vec3& color, float duration, bool depth_test) {
+    //corners of the NDC cube back to world space
+    lm::mat4 inv_vp = view_projection;
+    if (!inv_vp.inverse()) return;
+    lm::vec3 points[8];
+    for (int i = 0; i < 8; i++) {
+        lm::vec4 corner = inv_vp * lm::vec4(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f, 1.0f);
+        corner.normalize();
+        points[i] = lm::vec3(corner.x, corner.y, corner.z);
+    }
+    addLines(points, cube_edges, 12, color, duration, depth_test);
+}
+
+void DebugDraw::ray(const lm::vec3& origin, const lm::vec3& direction, float length, const lm::vec3& color, float duration, bool depth_test) {
+    lm::vec3 dir = direction;
+    if (dir.length() > 0.0f) dir.normalize();
+    line(origin, origin + dir * length, color, duration, depth_test);
+}
+
+void DebugDraw::flush(const lm::mat4& view_projection, float dt) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_lines_ = 0;
+    if (!shader_) return;
+
+    //timed lines are drawn this frame, then aged
+    for (auto& timed : timed_lines_) {
+        std::vector<DebugVertex>& vertices = vertices_[timed.depth_test ? 0 : 1];
+        vertices.push_back(timed.a);
+        vertices.push_back(timed.b);
+        timed.time_left -= dt;
+    }
+    timed_lines_.erase(std::remove_if(timed_lines_.begin(), timed_lines_.end(),
+                                      [](const TimedLine& timed) { return timed.time_left <= 0.0f; }),
+                       timed_lines_.end());
+
+    GLsizei num_depth = (GLsizei)vertices_[0].size();
+    GLsizei num_top = (GLsizei)vertices_[1].size();
+    if (num_depth + num_top == 0) return;
+
+    //the buffer only grows; orphaning it each frame avoids waiting on last frame's draws
+    size_t size = (num_depth + num_top) * sizeof(DebugVertex);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+    if (size > vbo_size_) vbo_size_ = std::max(size, vbo_size_ * 2);
+    glBufferData(GL_ARRAY_BUFFER, vbo_size_, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, num_depth * sizeof(DebugVertex), vertices_[0].data());
+    glBufferSubData(GL_ARRAY_BUFFER, num_depth * sizeof(DebugVertex), num_top * sizeof(DebugVertex), vertices_[1].data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    RenderStats::add(RenderStats::UPLOAD_BYTES, size);
+
+    glUseProgram(shader_->program);
+    shader_->setUniform(U_VP, view_projection);
+    RenderStats::add(RenderStats::SHADER_BINDS);
+    glBindVertexArray(vao_);
+    if (num_depth) glDrawArrays(GL_LINES, 0, num_depth);
+    if (num_top) {
+        glDisable(GL_DEPTH_TEST);
+        glDrawArrays(GL_LINES, num_depth, num_top);
+        glEnable(GL_DEPTH_TEST);
+    }
+    glBindVertexArray(0);
+    RenderStats::add(RenderStats::DRAW_CALLS, (num_depth ? 1 : 0) + (num_top ? 1 : 0));
+
+    num_lines_ = (num_depth + num_top) / 2;
+    vertices_[0].clear();
+    vertices_[1].clear();
+}
+
+void DebugDraw::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    vertices_[0].clear();
+    vertices_[1].clear();
+    timed_lines_.clear();
+}
+
+int DebugDraw::getNumLines() {
+    return num_lines_;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "../includes.h"
+
+// Debug draw.
+// Immediate mode lines for debugging. Any system, on any thread, adds
+// primitives during the frame; they are transformed to world space when added
+// and appended to one vertex array, so flush() draws everything with a single
+// glDrawArrays for depth tested lines and another for lines drawn on top.
+// Primitives last until the next flush, or for duration seconds.
+// Usage: DebugDraw::box(center, half_width, lm::vec3(0, 1, 0));
+
+namespace DebugDraw {
+    static const int SPHERE_SEGMENTS = 24; //segments of each of the three circles of a sphere
+
+    void init();
+    void shutdown();
+
+    void line(const lm::vec3& a, const lm::vec3& b, const lm::vec3& color, float duration = 0.0f, bool depth_test = true);
+    //axis aligned box
+    void box(const lm::vec3& center, const lm::vec3& half_width, const lm::vec3& color, float duration = 0.0f, bool depth_test = true);
+    //-1 to 1 cube transformed by model
+    void obb(const lm::mat4& model, const lm::vec3& color, float duration = 0.0f, bool depth_test = true);
+    void sphere(const lm::vec3& center, float radius, const lm::vec3& color, float duration = 0.0f, bool depth_test = true);
+    //frustum of a camera, from its view projection matrix
+    void frustum(const lm::mat4& view_projection, const lm::vec3& color, float duration = 0.0f, bool depth_test = true);
+    void ray(const lm::vec3& origin, const lm::vec3& direction, float length, const lm::vec3& color, float duration = 0.0f, bool depth_test = true);
+
+    //draws all primitives with the current framebuffer, and ages timed ones by dt
+    void flush(const lm::mat4& view_projection, float dt);
+    //forgets all primitives, e.g. when the scene changes
+    void clear();
+    //lines drawn by the last flush
+    int getNumLines();
+}
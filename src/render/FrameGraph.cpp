@@ -0,0 +1,201 @@
+#include "FrameGraph.h"
+#include "RenderStats.h"
+#include "../tools/Profiler.h"
+#include <algorithm>
+#include <climits>
+
+void FrameGraph::reset() {
+    //outputs were kept after execute
+    for (auto& slot : slots_)
+        if (slot.target) pool_.Release(slot.target);
+    resources_.clear();
+    passes_.clear();
+    slots_.clear();
+}
+
+FrameResource FrameGraph::importWindow(int width, int height) {
+    Resource resource;
+    resource.name = "window";
+    resource.width = window_width_ = width;
+    resource.height = window_height_ = height;
+    resource.format = 0;
+    resource.window = true;
+    resource.output = true;
+    resources_.push_back(resource);
+    return (FrameResource)resources_.size() - 1;
+}
+
+FrameResource FrameGraph::importTarget(const char* name, RenderToTexture* target) {
+    Resource resource;
+    resource.name = name;
+    resource.width = target->GetWidth();
+    resource.height = target->GetHeight();
+    resource.format = target->GetFormat();
+    resource.imported = target;
+    resources_.push_back(resource);
+    return (FrameResource)resources_.size() - 1;
+}
+
+FrameResource FrameGraph::createTarget(const char* name, int width, int height, GLenum format) {
+    Resource resource;
+    resource.name = name;
+    resource.width = std::max(width, 1);
+    resource.height = std::max(height, 1);
+    resource.format = format;
+    resources_.push_back(resource);
+    return (FrameResource)resources_.size() - 1;
+}
+
+void FrameGraph::setOutput(FrameResource resource) {
+    resources_[resource].output = true;
+}
+
+void FrameGraph::addPass(const char* name, const std::vector<FrameResource>& reads, const std::vector<FrameResource>& writes,
+                         PassFunction function, bool side_effects) {
+    Pass pass;
+    pass.name = name;
+    pass.reads = reads;
+    pass.writes = writes;
+    pass.function = function;
+    pass.side_effects = side_effects;
+    passes_.push_back(pass);
+}
+
+void FrameGraph::compile() {
+    //culling: walking back from the outputs, a pass is needed if it writes a
+    //needed resource, and then what it reads is needed too
+    std::vector<bool> needed(resources_.size());
+    for (size_t r = 0; r < resources_.size(); r++)
+        needed[r] = resources_[r].output;
+    for (int p = (int)passes_.size() - 1; p >= 0; p--) {
+        Pass& pass = passes_[p];
+        pass.culled = !pass.side_effects;
+        for (FrameResource w : pass.writes)
+            if (needed[w]) pass.culled = false;
+        if (pass.culled) continue;
+        for (FrameResource r : pass.reads)
+            needed[r] = true;
+    }
+
+    //lifetimes, in passes which survived
+    for (int p = 0; p < (int)passes_.size(); p++) {
+        Pass& pass = passes_[p];
+        if (pass.culled) continue;
+        for (FrameResource r : pass.reads) {
+            Resource& resource = resources_[r];
+            if (resource.first_pass == -1 && !resource.window && !resource.imported)
+                std::cerr << "ERROR: Frame graph pass " << pass.name << " reads " << resource.name << " before any pass writes it" << std::endl;
+        }
+        auto use = [&](FrameResource r) {
+            Resource& resource = resources_[r];
+            if (resource.first_pass == -1) resource.first_pass = p;
+            resource.last_pass = p;
+        };
+        for (FrameResource r : pass.writes) use(r);
+        for (FrameResource r : pass.reads) use(r);
+    }
+
+    //aliasing: in order of first use, each target takes a free slot with its
+    //size and format, or a new one
+    std::vector<int> order;
+    for (size_t r = 0; r < resources_.size(); r++)
+        if (!resources_[r].window && !resources_[r].imported && resources_[r].first_pass != -1) order.push_back((int)r);
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        return resources_[a].first_pass < resources_[b].first_pass;
+    });
+    for (int r : order) {
+        Resource& resource = resources_[r];
+        //outputs stay alive until reset
+        int last_pass = resource.output ? INT_MAX : resource.last_pass;
+        for (size_t s = 0; s < slots_.size() && resource.slot == -1; s++) {
+            Slot& slot = slots_[s];
+            if (slot.width == resource.width && slot.height == resource.height &&
+                slot.format == resource.format && slot.last_pass < resource.first_pass) {
+                resource.slot = (int)s;
+                slot.last_pass = last_pass;
+            }
+        }
+        if (resource.slot == -1) {
+            slots_.push_back({ resource.width, resource.height, resource.format, resource.first_pass, last_pass });
+            resource.slot = (int)slots_.size() - 1;
+        }
+    }
+}
+
+//binds the first target a pass writes, clearing it if the pass is the first to write it
+void FrameGraph::bindOutput_(int p) {
+    const Pass& pass = passes_[p];
+    if (pass.writes.empty() || resources_[pass.writes[0]].window) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, window_width_, window_height_);
+        return;
+    }
+    const Resource& resource = resources_[pass.writes[0]];
+    RenderToTexture* target = resource.imported ? resource.imported : slots_[resource.slot].target;
+    if (resource.first_pass == p) target->Activate();
+    else target->Bind();
+}
+
+void FrameGraph::execute() {
+    for (int p = 0; p < (int)passes_.size(); p++) {
+        if (passes_[p].culled) continue;
+        for (auto& slot : slots_)
+            if (slot.first_pass == p) slot.target = pool_.Acquire(slot.width, slot.height, slot.format);
+
+        {
+            Profiler::Zone zone(passes_[p].name.c_str());
+            RenderStats::beginPass(passes_[p].name.c_str());
+            bindOutput_(p);
+            passes_[p].function(*this);
+            RenderStats::endPass();
+        }
+
+        //a target released here may be taken by the next slot with its size
+        for (auto& slot : slots_) {
+            if (slot.last_pass != p) continue;
+            pool_.Release(slot.target);
+            slot.target = nullptr;
+        }
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, window_width_, window_height_);
+}
+
+RenderToTexture* FrameGraph::getTarget(FrameResource resource) {
+    const Resource& r = resources_[resource];
+    if (r.imported) return r.imported;
+    return r.slot == -1 ? nullptr : slots_[r.slot].target;
+}
+
+int FrameGraph::getNumCulled() const {
+    int culled = 0;
+    for (auto& pass : passes_)
+        if (pass.culled) culled++;
+    return culled;
+}
+
+void FrameGraph::dump(std::ostream& out) const {
+    for (size_t p = 0; p < passes_.size(); p++) {
+        const Pass& pass = passes_[p];
+        out << "pass " << p << " " << pass.name << (pass.culled ? " (culled)" : "");
+        if (!pass.reads.empty()) {
+            out << " reads";
+            for (FrameResource r : pass.reads) out << " " << resources_[r].name;
+        }
+        if (!pass.writes.empty()) {
+            out << " writes";
+            for (FrameResource w : pass.writes) out << " " << resources_[w].name;
+        }
+        out << "\n";
+    }
+    for (auto& resource : resources_) {
+        out << "resource " << resource.name << " " << resource.width << "x" << resource.height;
+        if (resource.window) out << " window";
+        else if (resource.imported) out << " imported";
+        else if (resource.first_pass == -1) out << " unused";
+        else out << " passes " << resource.first_pass << "-" << resource.last_pass << " slot " << resource.slot;
+        if (resource.output) out << " output";
+        out << "\n";
+    }
+    out << "passes: " << passes_.size() << " culled: " << getNumCulled() << " targets: " << slots_.size() << std::endl;
+}
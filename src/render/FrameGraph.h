@@ -0,0 +1,96 @@
+#pragma once
+#include "../includes.h"
+#include "RenderToTexture.h"
+#include <vector>
+#include <functional>
+#include <ostream>
+
+// Frame graph.
+// Every frame, the render passes are declared with the targets they read and
+// write, then the graph is compiled and executed:
+// - passes which do not lead to an output (the window, or a target marked
+//   with setOutput) are culled, unless they have side effects
+// - passes run in declaration order, which must put writers before readers;
+//   compile() reports reads of targets nothing wrote before
+// - each transient target lives from the first to the last pass using it.
+//   Targets with the same size and format whose lifetimes do not overlap get
+//   the same slot, and each slot takes one target from the RenderTargetPool,
+//   so adding passes (post-processing, extra views) only allocates when
+//   targets are alive at the same time
+// Imported targets belong to the caller and keep their contents between
+// frames, so a frame may read one without writing it.
+// Before a pass runs, its first written target is bound (and cleared, if
+// this is its first pass). dump() lists passes, resources and slots.
+
+typedef int FrameResource;
+
+class FrameGraph {
+public:
+    typedef std::function<void(FrameGraph&)> PassFunction;
+
+    FrameGraph(RenderTargetPool& pool) : pool_(pool) {}
+
+    //forgets the passes and resources of the last frame
+    void reset();
+    //the default framebuffer. Always an output
+    FrameResource importWindow(int width, int height);
+    //a target owned by the caller, whose contents are kept between frames.
+    //Passes may read it without a writer this frame
+    FrameResource importTarget(const char* name, RenderToTexture* target);
+    //a target which only exists while passes use it
+    FrameResource createTarget(const char* name, int width, int height, GLenum format = GL_RGB8);
+    //keeps the target, and the passes writing it, until reset()
+    void setOutput(FrameResource resource);
+    //- side_effects: pass is kept even if nothing reads what it writes
+    void addPass(const char* name, const std::vector<FrameResource>& reads, const std::vector<FrameResource>& writes,
+                 PassFunction function, bool side_effects = false);
+
+    void compile();
+    void execute();
+
+    //target of a resource while it is alive, nullptr for the window
+    RenderToTexture* getTarget(FrameResource resource);
+    int getNumCulled() const;
+    int getNumSlots() const { return (int)slots_.size(); }
+    void dump(std::ostream& out) const;
+
+private:
+    struct Resource {
+        std::string name;
+        int width;
+        int height;
+        GLenum format;
+        bool window = false;
+        RenderToTexture* imported = nullptr;
+        bool output = false;
+        int first_pass = -1;
+        int last_pass = -1;
+        int slot = -1;
+    };
+    struct Pass {
+        std::string name;
+        std::vector<FrameResource> reads;
+        std::vector<FrameResource> writes;
+        PassFunction function;
+        bool side_effects;
+        bool culled = false;
+    };
+    //physical target shared by resources with disjoint lifetimes
+    struct Slot {
+        int width;
+        int height;
+        GLenum format;
+        int first_pass;
+        int last_pass;
+        RenderToTexture* target = nullptr;
+    };
+
+    RenderTargetPool& pool_;
+    std::vector<Resource> resources_;
+    std::vector<Pass> passes_;
+    std::vector<Slot> slots_;
+    int window_width_ = 0;
+    int window_height_ = 0;
+
+    void bindOutput_(int pass);
+};
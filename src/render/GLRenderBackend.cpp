@@ -0,0 +1,242 @@
+#include "GLRenderBackend.h"
+#include "RenderStats.h"
+#include "../GraphicsSystem.h"
+#include "../shaders_default.h"
+
+GLRenderBackend::~GLRenderBackend() {
+    delete depth_shader_;
+    delete depth_multi_draw_shader_;
+    if (overdraw_queries_[0]) glDeleteQueries(NUM_OVERDRAW_QUERIES, overdraw_queries_);
+}
+
+void GLRenderBackend::addMultiDrawProgram(GLuint program, GLuint multi_draw_program) {
+    GLuint block = glGetProgramResourceIndex(multi_draw_program, GL_SHADER_STORAGE_BLOCK, "PerDrawBuffer");
+    if (block == GL_INVALID_INDEX) return;
+    glShaderStorageBlockBinding(multi_draw_program, block, IndirectDrawBuffer::PER_DRAW_BINDING);
+    multi_draw_programs_[program] = multi_draw_program;
+}
+
+bool GLRenderBackend::setMultiDraw(bool enable) {
+    if (enable && !multiDrawSupported()) return false;
+    if (enable && !indirect_.isInit()) indirect_.init();
+    multi_draw_ = enable;
+    return true;
+}
+
+void GLRenderBackend::execute(const RenderCommandBuffer& buffer) {
+    stats.reset();
+    GraphicsSystem& gs = graphics_system_;
+    int current_page = -1;
+    GLenum current_index_type = GL_UNSIGNED_INT;
+    //true while current pipeline draws through the indirect buffer
+    bool batching = false;
+    const DrawConstants* constants = nullptr;
+    bool prepass = buffer.view.depth_prepass;
+
+    if (multi_draw_) {
+        GLuint num_draws = 0;
+        for (auto& cmd : buffer.commands)
+            if (cmd.type == RenderCommandDraw) num_draws++;
+        //the pre-pass writes its own copy of the draws
+        indirect_.beginFrame(prepass ? num_draws * 2 : num_draws);
+        //buffer may have been recreated to fit the draws
+        if (indirect_.draw_id_buffer != bound_draw_id_buffer_) {
+            bound_draw_id_buffer_ = indirect_.draw_id_buffer;
+            gs.geometry_arena_.setInstanceAttribute(IndirectDrawBuffer::DRAW_ID_ATTRIBUTE, bound_draw_id_buffer_);
+        }
+    }
+
+    //overdraw is counted in the pass which writes depth
+    bool measuring = beginOverdrawQuery_();
+    if (prepass) {
+        depthPrepass_(buffer);
+        if (measuring) endOverdrawQuery_();
+        measuring = false;
+        //only the nearest surface passes, and depth is already written
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+    }
+
+    //draws everything batched since last state change
+    auto flush = [&]() {
+        if (batching && indirect_.submit(current_index_type)) {
+            stats.multi_draw_calls++;
+            RenderStats::add(RenderStats::DRAW_CALLS);
+        }
+    };
+
+    for (auto& cmd : buffer.commands) {
+        countCommand_(cmd);
+        switch (cmd.type) {
+        case RenderCommandSetPipeline: {
+            flush();
+            auto it = multi_draw_ ? multi_draw_programs_.find((GLuint)cmd.arg) : multi_draw_programs_.end();
+            batching = it != multi_draw_programs_.end();
+            gs.useShader(batching ? it->second : (GLuint)cmd.arg);
+            gs.current_material_ = -1;
+            //view constants are the same for all draws with this pipeline
+            gs.shader_->setUniform(U_VP, buffer.view.view_projection);
+            gs.shader_->setUniform(U_CAM_POS, buffer.view.cam_pos);
+            gs.setLightUniforms();
+            gs.shader_->setUniform(U_MATERIAL_DATA, (int)TextureAtlas::MATERIAL_DATA_UNIT);
+            break;
+        }
+        case RenderCommandBindMaterial:
+            flush();
+            gs.current_material_ = cmd.arg;
+            gs.setMaterialUniforms();
+            RenderStats::add(RenderStats::MATERIAL_BINDS);
+            break;
+        case RenderCommandSetConstants: {
+            const DrawConstants& c = buffer.constants[cmd.arg];
+            if (batching) {
+                //written with the draw
+                constants = &c;
+                break;
+            }
+            gs.shader_->setUniform(U_MVP, c.mvp);
+            gs.shader_->setUniform(U_MODEL, c.model);
+            gs.shader_->setUniform(U_NORMAL_MATRIX, c.normal_matrix);
+            gs.shader_->setUniform(U_MATERIAL, c.material);
+            break;
+        }
+        case RenderCommandDraw: {
+            Geometry& geom = gs.geometries_[cmd.arg];
+            if (!geom.num_tris) break;
+            const GeometryLOD& lod = geom.lods[std::min((int)cmd.lod, geom.num_lods - 1)];
+            //all geometry in a page shares one VAO, so only bind on page change
+            if (geom.range.page != current_page) {
+                flush();
+                current_page = geom.range.page;
+                glBindVertexArray(gs.geometry_arena_.getVAO(current_page));
+            }
+            //a multi-draw can only use one index type
+            if (geom.range.index_type != current_index_type) {
+                flush();
+                current_index_type = geom.range.index_type;
+            }
+            RenderStats::add(RenderStats::TRIANGLES, lod.num_indices / 3);
+            RenderStats::add(RenderStats::INSTANCES);
+            if (batching) {
+                indirect_.addDraw(lod.num_indices, geom.range.first_index + lod.first_index, geom.range.base_vertex,
+                    constants->model, constants->normal_matrix, (GLuint)constants->material);
+                break;
+            }
+            glDrawElementsBaseVertex(GL_TRIANGLES, lod.num_indices, geom.range.index_type,
+                (void*)(geom.range.indexOffset() + lod.first_index * geom.range.indexSize()), geom.range.base_vertex);
+            RenderStats::add(RenderStats::DRAW_CALLS);
+            break;
+        }
+        }
+    }
+    flush();
+    glBindVertexArray(0);
+    if (measuring) endOverdrawQuery_();
+    if (prepass) {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
+    if (multi_draw_) indirect_.endFrame();
+}
+
+void GLRenderBackend::initDepthPrepass_() {
+    depth_shader_ = new Shader();
+    depth_shader_->compileFromStrings(g_shader_depth_prepass_vertex, g_shader_depth_fragment);
+    if (!multiDrawSupported()) return;
+    depth_multi_draw_shader_ = new Shader();
+    depth_multi_draw_shader_->compileFromStrings(g_shader_depth_prepass_multi_draw_vertex, g_shader_depth_fragment);
+    GLuint block = glGetProgramResourceIndex(depth_multi_draw_shader_->program, GL_SHADER_STORAGE_BLOCK, "PerDrawBuffer");
+    glShaderStorageBlockBinding(depth_multi_draw_shader_->program, block, IndirectDrawBuffer::PER_DRAW_BINDING);
+}
+
+//draws every draw of the buffer with the depth program, ignoring materials.
+//Positions must be computed the way the lit pass computes them, or GL_EQUAL
+//fails: pipelines the lit pass batches use the multi-draw program, batched
+//until the page or index type changes, the rest use u_mvp
+void GLRenderBackend::depthPrepass_(const RenderCommandBuffer& buffer) {
+    if (!depth_shader_) initDepthPrepass_();
+    GraphicsSystem& gs = graphics_system_;
+    bool batching = false;
+    Shader* shader = depth_shader_;
+    gs.useShader(shader);
+    shader->setUniform(U_VP, buffer.view.view_projection);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+    int current_page = -1;
+    GLenum current_index_type = GL_UNSIGNED_INT;
+    const DrawConstants* constants = nullptr;
+    auto flush = [&]() {
+        if (batching && indirect_.submit(current_index_type)) RenderStats::add(RenderStats::DRAW_CALLS);
+    };
+
+    for (auto& cmd : buffer.commands) {
+        if (cmd.type == RenderCommandSetPipeline) {
+            bool batched = multi_draw_ && depth_multi_draw_shader_ &&
+                multi_draw_programs_.find((GLuint)cmd.arg) != multi_draw_programs_.end();
+            Shader* pipeline_shader = batched ? depth_multi_draw_shader_ : depth_shader_;
+            if (pipeline_shader == shader) continue;
+            flush();
+            batching = batched;
+            shader = pipeline_shader;
+            gs.useShader(shader);
+            shader->setUniform(U_VP, buffer.view.view_projection);
+            if (!batching && constants) shader->setUniform(U_MVP, constants->mvp);
+            continue;
+        }
+        if (cmd.type == RenderCommandSetConstants) {
+            constants = &buffer.constants[cmd.arg];
+            if (!batching) shader->setUniform(U_MVP, constants->mvp);
+            continue;
+        }
+        if (cmd.type != RenderCommandDraw) continue;
+        Geometry& geom = gs.geometries_[cmd.arg];
+        if (!geom.num_tris) continue;
+        const GeometryLOD& lod = geom.lods[std::min((int)cmd.lod, geom.num_lods - 1)];
+        if (geom.range.page != current_page) {
+            flush();
+            current_page = geom.range.page;
+            glBindVertexArray(gs.geometry_arena_.getVAO(current_page));
+        }
+        if (geom.range.index_type != current_index_type) {
+            flush();
+            current_index_type = geom.range.index_type;
+        }
+        RenderStats::add(RenderStats::TRIANGLES, lod.num_indices / 3);
+        RenderStats::add(RenderStats::INSTANCES);
+        if (batching) {
+            indirect_.addDraw(lod.num_indices, geom.range.first_index + lod.first_index, geom.range.base_vertex,
+                constants->model, constants->normal_matrix, (GLuint)constants->material);
+            continue;
+        }
+        glDrawElementsBaseVertex(GL_TRIANGLES, lod.num_indices, geom.range.index_type,
+            (void*)(geom.range.indexOffset() + lod.first_index * geom.range.indexSize()), geom.range.base_vertex);
+        RenderStats::add(RenderStats::DRAW_CALLS);
+    }
+    flush();
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+//reads the result of the query started NUM_OVERDRAW_QUERIES frames ago, if the
+//GPU has it, and starts a new one. Returns false if the slot is still in flight
+bool GLRenderBackend::beginOverdrawQuery_() {
+    if (!overdraw_queries_[0]) glGenQueries(NUM_OVERDRAW_QUERIES, overdraw_queries_);
+    GLuint query = overdraw_queries_[overdraw_query_];
+    if (overdraw_pixels_[overdraw_query_]) {
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) return false;
+        GLuint samples = 0;
+        glGetQueryObjectuiv(query, GL_QUERY_RESULT, &samples);
+        overdraw_ = (float)samples / overdraw_pixels_[overdraw_query_];
+    }
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    overdraw_pixels_[overdraw_query_] = std::max(viewport[2] * viewport[3], 1);
+    glBeginQuery(GL_SAMPLES_PASSED, query);
+    return true;
+}
+
+void GLRenderBackend::endOverdrawQuery_() {
+    glEndQuery(GL_SAMPLES_PASSED);
+    overdraw_query_ = (overdraw_query_ + 1) % NUM_OVERDRAW_QUERIES;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "RenderCommandBuffer.h"
+#include "IndirectDrawBuffer.h"
+#include <unordered_map>
+
+class GraphicsSystem;
+class Shader;
+
+//executes command buffers with OpenGL, using the resources (shaders,
+//materials, geometries) owned by the GraphicsSystem.
+//With multi-draw enabled, draws of pipelines which have a multi-draw program
+//are written to an IndirectDrawBuffer and each material bucket is drawn with
+//a single glMultiDrawElementsIndirect. Other pipelines use the draw loop.
+//If the view asks for a depth pre-pass, all draws are first drawn with a
+//position-only program and no colour writes, then lit with GL_EQUAL depth
+//test, so each pixel is shaded once. Overdraw is measured with a
+//GL_SAMPLES_PASSED query around whichever pass writes depth
+class GLRenderBackend : public RenderBackend {
+public:
+    static const int NUM_OVERDRAW_QUERIES = 3; //frames in flight before a result is read
+
+    GLRenderBackend(GraphicsSystem& graphics_system) : graphics_system_(graphics_system) {}
+    ~GLRenderBackend();
+    void execute(const RenderCommandBuffer& buffer) override;
+
+    //program must read per-draw data from IndirectDrawBuffer (see the INSTANCING variant of phong.vert)
+    void addMultiDrawProgram(GLuint program, GLuint multi_draw_program);
+    //returns false if multi-draw is not supported
+    bool setMultiDraw(bool enable);
+    bool isMultiDraw() { return multi_draw_; }
+    //fragments which passed the depth test per pixel, of a recent frame
+    float getOverdraw() { return overdraw_; }
+private:
+    GraphicsSystem& graphics_system_;
+
+    Shader* depth_shader_ = nullptr;
+    Shader* depth_multi_draw_shader_ = nullptr;
+    void initDepthPrepass_();
+    void depthPrepass_(const RenderCommandBuffer& buffer);
+
+    GLuint overdraw_queries_[NUM_OVERDRAW_QUERIES] = {};
+    GLint overdraw_pixels_[NUM_OVERDRAW_QUERIES] = {}; //viewport size of the query, 0 if not in flight
+    int overdraw_query_ = 0;
+    float overdraw_ = 0.0f;
+    bool beginOverdrawQuery_();
+    void endOverdrawQuery_();
+
+    bool multi_draw_ = false;
+    IndirectDrawBuffer indirect_;
+    GLuint bound_draw_id_buffer_ = 0;
+    std::unordered_map<GLuint, GLuint> multi_draw_programs_; //program -> multi-draw version
+};
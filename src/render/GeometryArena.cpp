@@ -0,0 +1,192 @@
+#include "GeometryArena.h"
+#include "RenderStats.h"
+#include <algorithm>
+#include <cstddef>
+
+void RangeAllocator::init(unsigned int capacity) {
+    capacity_ = capacity;
+    used_ = 0;
+    free_.clear();
+    free_[0] = capacity;
+}
+
+//first fit: takes the first free block which is big enough once aligned
+bool RangeAllocator::allocate(unsigned int count, unsigned int& offset, unsigned int alignment) {
+    for (auto it = free_.begin(); it != free_.end(); it++) {
+        unsigned int block_offset = it->first;
+        unsigned int block_size = it->second;
+        unsigned int padding = (alignment - block_offset % alignment) % alignment;
+        if (block_size < count + padding) continue;
+        offset = block_offset + padding;
+        unsigned int remaining = block_size - count - padding;
+        free_.erase(it);
+        //padding stays free
+        if (padding) free_[block_offset] = padding;
+        if (remaining) free_[offset + count] = remaining;
+        used_ += count;
+        return true;
+    }
+    return false;
+}
+
+//returns a block and merges it with free neighbours
+void RangeAllocator::free(unsigned int offset, unsigned int count) {
+    if (!count) return;
+    used_ -= count;
+    auto next = free_.lower_bound(offset);
+    //merge with next block
+    if (next != free_.end() && offset + count == next->first) {
+        count += next->second;
+        next = free_.erase(next);
+    }
+    //merge with previous block
+    if (next != free_.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            prev->second += count;
+            return;
+        }
+    }
+    free_[offset] = count;
+}
+
+GeometryArena::~GeometryArena() {
+    for (auto& page : pages_) {
+        glDeleteVertexArrays(1, &page.vao);
+        glDeleteBuffers(1, &page.vbo);
+        glDeleteBuffers(1, &page.ibo);
+    }
+}
+
+void GeometryArena::init(unsigned int vertices_per_page, unsigned int indices_per_page) {
+    vertices_per_page_ = vertices_per_page;
+    indices_per_page_ = indices_per_page;
+}
+
+//creates buffers for a new page and sets up its VAO
+int GeometryArena::createPage_(unsigned int num_vertices, unsigned int num_index_units) {
+    ArenaPage page;
+    page.vertices.init(num_vertices);
+    page.indices.init(num_index_units);
+
+    glGenVertexArrays(1, &page.vao);
+    glBindVertexArray(page.vao);
+
+    glGenBuffers(1, &page.vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, page.vbo);
+    glBufferData(GL_ARRAY_BUFFER, num_vertices * sizeof(Vertex), nullptr, GL_STATIC_DRAW);
+    //positions
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+    //texture coords
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, uv));
+    //normals
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+
+    //indices - element buffer binding is stored in the VAO
+    glGenBuffers(1, &page.ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, page.ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, num_index_units * sizeof(GLushort), nullptr, GL_STATIC_DRAW);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    bindInstanceAttribute_(page);
+    pages_.push_back(page);
+    return (int)pages_.size() - 1;
+}
+
+void GeometryArena::setInstanceAttribute(GLuint location, GLuint buffer) {
+    //disable the old attribute first, in case location changes
+    if (instance_buffer_) {
+        for (auto& page : pages_) {
+            glBindVertexArray(page.vao);
+            glDisableVertexAttribArray(instance_location_);
+        }
+        glBindVertexArray(0);
+    }
+    instance_location_ = location;
+    instance_buffer_ = buffer;
+    for (auto& page : pages_) bindInstanceAttribute_(page);
+}
+
+void GeometryArena::bindInstanceAttribute_(ArenaPage& page) {
+    if (!instance_buffer_) return;
+    glBindVertexArray(page.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer_);
+    glEnableVertexAttribArray(instance_location_);
+    glVertexAttribIPointer(instance_location_, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+    //one value per instance, so the attribute is fetched with baseInstance
+    glVertexAttribDivisor(instance_location_, 1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+bool GeometryArena::allocate(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, ArenaAllocation& out) {
+    if (vertices.empty() || indices.empty()) return false;
+
+    unsigned int num_vertices = (unsigned int)vertices.size();
+    unsigned int num_indices = (unsigned int)indices.size();
+    //16-bit indices halve index memory and bandwidth
+    bool short_indices = num_vertices < 65536;
+    unsigned int units = short_indices ? num_indices : num_indices * 2;
+    unsigned int alignment = short_indices ? 1 : 2;
+    unsigned int vertex_offset = 0, index_offset = 0;
+
+    //find a page with room for both ranges
+    int page_id = -1;
+    for (size_t i = 0; i < pages_.size() && page_id == -1; i++) {
+        ArenaPage& page = pages_[i];
+        if (!page.vertices.allocate(num_vertices, vertex_offset)) continue;
+        if (!page.indices.allocate(units, index_offset, alignment)) {
+            page.vertices.free(vertex_offset, num_vertices);
+            continue;
+        }
+        page_id = (int)i;
+    }
+
+    //no room: create a new page, big enough for this geometry
+    if (page_id == -1) {
+        page_id = createPage_(std::max(num_vertices, vertices_per_page_), std::max(units, indices_per_page_ * 2));
+        pages_[page_id].vertices.allocate(num_vertices, vertex_offset);
+        pages_[page_id].indices.allocate(units, index_offset, alignment);
+    }
+
+    //upload
+    ArenaPage& page = pages_[page_id];
+    glBindBuffer(GL_ARRAY_BUFFER, page.vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, vertex_offset * sizeof(Vertex), num_vertices * sizeof(Vertex), vertices.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    //bind the VAO so that we don't break the element buffer binding of another VAO
+    glBindVertexArray(page.vao);
+    if (short_indices) {
+        std::vector<GLushort> short_data(indices.begin(), indices.end());
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, index_offset * sizeof(GLushort), num_indices * sizeof(GLushort), short_data.data());
+    }
+    else {
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, index_offset * sizeof(GLushort), num_indices * sizeof(GLuint), indices.data());
+    }
+    glBindVertexArray(0);
+    RenderStats::add(RenderStats::UPLOAD_BYTES, num_vertices * sizeof(Vertex) +
+        num_indices * (short_indices ? sizeof(GLushort) : sizeof(GLuint)));
+
+    out.page = page_id;
+    out.base_vertex = (GLint)vertex_offset;
+    out.num_vertices = num_vertices;
+    out.index_type = short_indices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    out.first_index = short_indices ? index_offset : index_offset / 2;
+    out.num_indices = num_indices;
+    return true;
+}
+
+void GeometryArena::free(ArenaAllocation& allocation) {
+    if (allocation.page < 0) return;
+    ArenaPage& page = pages_[allocation.page];
+    page.vertices.free(allocation.base_vertex, allocation.num_vertices);
+    //index allocator works in 16-bit units
+    unsigned int unit_scale = allocation.indexSize() / sizeof(GLushort);
+    page.indices.free(allocation.first_index * unit_scale, allocation.num_indices * unit_scale);
+    allocation = ArenaAllocation();
+}
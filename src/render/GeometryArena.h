@@ -0,0 +1,86 @@
+#pragma once
+#include "../includes.h"
+#include <vector>
+#include <map>
+
+// Geometry arena.
+// All geometry shares a few large interleaved vertex buffers and index buffers
+// ("pages"). Each geometry is just a range inside a page, and each page has a
+// single VAO, so draws use glDrawElementsBaseVertex without switching VAOs.
+// Geometry with fewer than 65536 vertices is stored with 16-bit indices, so
+// index pages are allocated in 16-bit units and 32-bit ranges are 4-byte aligned.
+
+//interleaved vertex format for all arena geometry
+struct Vertex {
+    float position[3];
+    float uv[2];
+    float normal[3];
+};
+
+//first-fit free list allocator, in elements
+class RangeAllocator {
+public:
+    void init(unsigned int capacity);
+    bool allocate(unsigned int count, unsigned int& offset, unsigned int alignment = 1);
+    void free(unsigned int offset, unsigned int count);
+    unsigned int capacity() const { return capacity_; }
+    unsigned int used() const { return used_; }
+private:
+    std::map<unsigned int, unsigned int> free_; //offset -> count, sorted so neighbours can merge
+    unsigned int capacity_ = 0;
+    unsigned int used_ = 0;
+};
+
+//range of a geometry inside the arena
+struct ArenaAllocation {
+    int page = -1;
+    GLint base_vertex = 0;
+    GLuint num_vertices = 0;
+    GLuint first_index = 0; //in elements of index_type
+    GLuint num_indices = 0;
+    GLenum index_type = GL_UNSIGNED_INT;
+
+    GLuint indexSize() const { return index_type == GL_UNSIGNED_SHORT ? 2 : 4; }
+    //byte offset of first index, as passed to glDrawElements
+    GLsizeiptr indexOffset() const { return (GLsizeiptr)first_index * indexSize(); }
+};
+
+//vertex + index buffer pair, with a VAO set up for the Vertex format
+struct ArenaPage {
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint ibo = 0;
+    RangeAllocator vertices;
+    RangeAllocator indices; //in 16-bit units
+};
+
+class GeometryArena {
+public:
+    ~GeometryArena();
+
+    void init(unsigned int vertices_per_page = 1 << 18, unsigned int indices_per_page = 3 << 18);
+
+    //allocates space for the geometry and uploads it, with 16-bit indices if
+    //possible. Returns false on failure
+    bool allocate(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, ArenaAllocation& out);
+    //returns ranges of geometry to the arena
+    void free(ArenaAllocation& allocation);
+
+    //binds an instanced uint attribute (divisor 1) to every page VAO, e.g. the
+    //draw id used by the multi-draw path. Pass 0 to disable it
+    void setInstanceAttribute(GLuint location, GLuint buffer);
+
+    GLuint getVAO(int page) { return pages_[page].vao; }
+    GLuint getIndexBuffer(int page) { return pages_[page].ibo; }
+    const std::vector<ArenaPage>& getPages() { return pages_; }
+
+private:
+    std::vector<ArenaPage> pages_;
+    unsigned int vertices_per_page_ = 0;
+    unsigned int indices_per_page_ = 0;
+    GLuint instance_location_ = 0;
+    GLuint instance_buffer_ = 0;
+
+    int createPage_(unsigned int num_vertices, unsigned int num_index_units);
+    void bindInstanceAttribute_(ArenaPage& page);
+};
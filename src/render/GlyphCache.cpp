@@ -0,0 +1,285 @@
+#include "GlyphCache.h"
+#include "RenderStats.h"
+#include "../Parallel.h"
+#include <algorithm>
+#include <cmath>
+
+//TextureAtlas.cpp and imgui_draw.cpp have their own static copies
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "../imstb_rectpack.h"
+
+//glyph rendered at high resolution, waiting for its distance field
+struct PendingGlyph {
+    int x, y; //in the atlas
+    int width, height; //distance field size
+    int bitmap_width, bitmap_height; //high resolution, with the spread around it
+    std::vector<unsigned char> bitmap;
+    std::vector<unsigned char> sdf;
+};
+
+struct GlyphCache::Atlas {
+    stbrp_context context;
+    std::vector<stbrp_node> nodes;
+    std::vector<PendingGlyph> pending;
+};
+
+FT_Library GlyphCache::library_ = nullptr;
+std::unordered_map<std::string, std::unique_ptr<GlyphCache>> GlyphCache::caches_;
+
+static const float kInfinity = 1e20f;
+
+//squared distance transform of a row (Felzenszwalb and Huttenlocher)
+//- f: 0 on features, kInfinity elsewhere. d: output. v, z: scratch of n and n + 1
+static void distanceTransform1D(const float* f, int n, float* d, int* v, float* z) {
+    int k = 0;
+    v[0] = 0;
+    z[0] = -kInfinity;
+    z[1] = kInfinity;
+    for (int q = 1; q < n; q++) {
+        float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+        while (s <= z[k]) {
+            k--;
+            s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+        }
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = kInfinity;
+    }
+    k = 0;
+    for (int q = 0; q < n; q++) {
+        while (z[k + 1] < q) k++;
+        d[q] = (float)((q - v[k]) * (q - v[k])) + f[v[k]];
+    }
+}
+
+//squared distance of each pixel to the nearest feature, in place: columns, then rows
+static void distanceTransform2D(std::vector<float>& grid, int width, int height) {
+    int n = std::max(width, height);
+    std::vector<float> f(n), d(n), z(n + 1);
+    std::vector<int> v(n);
+    for (int x = 0; x < width; x++) {
+        for (int y = 0; y < height; y++) f[y] = grid[y * width + x];
+        distanceTransform1D(f.data(), height, d.data(), v.data(), z.data());
+        for (int y = 0; y < height; y++) grid[y * width + x] = d[y];
+    }
+    for (int y = 0; y < height; y++) {
+        distanceTransform1D(&grid[y * width], width, d.data(), v.data(), z.data());
+        std::copy(d.begin(), d.begin() + width, grid.begin() + y * width);
+    }
+}
+
+//signed distance to the outline at the center of each output texel, from
+//the distances to the nearest pixel outside and inside the glyph
+static void computeSdf(PendingGlyph& glyph) {
+    const int U = GlyphCache::SDF_UPSAMPLE;
+    int count = glyph.bitmap_width * glyph.bitmap_height;
+    std::vector<float> to_inside(count), to_outside(count);
+    for (int i = 0; i < count; i++) {
+        bool inside = glyph.bitmap[i] > 127;
+        to_inside[i] = inside ? 0.0f : kInfinity;
+        to_outside[i] = inside ? kInfinity : 0.0f;
+    }
+    distanceTransform2D(to_inside, glyph.bitmap_width, glyph.bitmap_height);
+    distanceTransform2D(to_outside, glyph.bitmap_width, glyph.bitmap_height);
+
+    glyph.sdf.resize(glyph.width * glyph.height);
+    for (int y = 0; y < glyph.height; y++) {
+        for (int x = 0; x < glyph.width; x++) {
+            int hx = std::min(x * U + U / 2, glyph.bitmap_width - 1);
+            int hy = std::min(y * U + U / 2, glyph.bitmap_height - 1);
+            int i = hy * glyph.bitmap_width + hx;
+            //in pixels of SDF_SIZE, positive outside
+            float distance = (sqrtf(to_inside[i]) - sqrtf(to_outside[i])) / U;
+            float value = 0.5f - distance / (2.0f * GlyphCache::SDF_SPREAD);
+            glyph.sdf[y * glyph.width + x] = (unsigned char)(std::min(std::max(value, 0.0f), 1.0f) * 255.0f);
+        }
+    }
+    glyph.bitmap.clear();
+}
+
+GlyphCache* GlyphCache::get(const std::string& font_path, int size, bool sdf) {
+    std::string key = font_path + "#" + (sdf ? std::string("sdf") : std::to_string(size));
+    auto it = caches_.find(key);
+    if (it == caches_.end()) {
+        if (!library_ && FT_Init_FreeType(&library_)) {
+            std::cerr << "ERROR: Could not initialise FreeType" << std::endl;
+            library_ = nullptr;
+            return nullptr;
+        }
+        //failed fonts are kept too, so they are not loaded again every frame
+        it = caches_.emplace(key, std::unique_ptr<GlyphCache>(new GlyphCache(font_path, size, sdf))).first;
+    }
+    return it->second->isValid() ? it->second.get() : nullptr;
+}
+
+void GlyphCache::shutdown() {
+    caches_.clear();
+    if (library_) FT_Done_FreeType(library_);
+    library_ = nullptr;
+}
+
+GlyphCache::GlyphCache(const std::string& font_path, int size, bool sdf) :
+    sdf_(sdf), size_(sdf ? SDF_SIZE : size), atlas_(new Atlas) {
+    if (FT_New_Face(library_, font_path.c_str(), 0, &face_)) {
+        std::cerr << "ERROR: Could not load font " << font_path << std::endl;
+        face_ = nullptr;
+        return;
+    }
+    //width of 0 = automatic. Distance fields come from a high resolution render
+    int scale = sdf_ ? SDF_UPSAMPLE : 1;
+    FT_Set_Pixel_Sizes(face_, 0, size_ * scale);
+    //Freetype units are 1/64th of a pixel
+    line_height_ = (face_->size->metrics.height >> 6) / (float)scale;
+    ascender_ = (face_->size->metrics.ascender >> 6) / (float)scale;
+
+    atlas_->nodes.resize(ATLAS_SIZE);
+    stbrp_init_target(&atlas_->context, ATLAS_SIZE, ATLAS_SIZE, atlas_->nodes.data(), ATLAS_SIZE);
+
+    //cleared, so padding between glyphs stays empty
+    std::vector<unsigned char> empty_data(ATLAS_SIZE * ATLAS_SIZE, 0);
+    glGenTextures(1, &texture_);
+    glBindTexture(GL_TEXTURE_2D, texture_);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, ATLAS_SIZE, ATLAS_SIZE, 0, GL_RED, GL_UNSIGNED_BYTE, empty_data.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+GlyphCache::~GlyphCache() {
+    if (face_) FT_Done_Face(face_);
+    if (texture_) glDeleteTextures(1, &texture_);
+}
+
+bool GlyphCache::pack_(int width, int height, int& x, int& y) {
+    stbrp_rect rect;
+    rect.id = 0;
+    rect.w = width + PADDING;
+    rect.h = height + PADDING;
+    if (!stbrp_pack_rects(&atlas_->context, &rect, 1)) return false;
+    x = rect.x;
+    y = rect.y;
+    return true;
+}
+
+const GlyphCache::Glyph& GlyphCache::getGlyph(unsigned int code) {
+    auto it = glyphs_.find(code);
+    if (it != glyphs_.end()) return it->second;
+
+    //a glyph which fails to load or pack is remembered as empty
+    Glyph& glyph = glyphs_[code];
+    if (FT_Load_Char(face_, code, FT_LOAD_RENDER)) return glyph;
+    FT_GlyphSlot slot = face_->glyph;
+    int bitmap_width = (int)slot->bitmap.width;
+    int bitmap_height = (int)slot->bitmap.rows;
+    int scale = sdf_ ? SDF_UPSAMPLE : 1;
+    glyph.advance = (slot->advance.x >> 6) / (float)scale;
+    if (bitmap_width == 0 || bitmap_height == 0) return glyph; //e.g. space
+
+    //distance fields extend SDF_SPREAD around the glyph
+    int border = sdf_ ? SDF_SPREAD * SDF_UPSAMPLE : 0;
+    int width = (bitmap_width + 2 * border + scale - 1) / scale;
+    int height = (bitmap_height + 2 * border + scale - 1) / scale;
+    int x, y;
+    if (!pack_(width, height, x, y)) {
+        std::cerr << "ERROR: Glyph atlas full, can't add glyph " << code << std::endl;
+        return glyph;
+    }
+    glyph.width = (float)width;
+    glyph.height = (float)height;
+    glyph.bearing_x = (slot->bitmap_left - border) / (float)scale;
+    glyph.bearing_y = (slot->bitmap_top + border) / (float)scale;
+    glyph.u0 = (float)x / ATLAS_SIZE;
+    glyph.v0 = (float)y / ATLAS_SIZE;
+    glyph.u1 = (float)(x + width) / ATLAS_SIZE;
+    glyph.v1 = (float)(y + height) / ATLAS_SIZE;
+
+    if (sdf_) {
+        //the slot is reused by the next glyph, so keep a copy with the border
+        PendingGlyph pending;
+        pending.x = x;
+        pending.y = y;
+        pending.width = width;
+        pending.height = height;
+        pending.bitmap_width = bitmap_width + 2 * border;
+        pending.bitmap_height = bitmap_height + 2 * border;
+        pending.bitmap.resize(pending.bitmap_width * pending.bitmap_height, 0);
+        for (int row = 0; row < bitmap_height; row++)
+            std::copy(slot->bitmap.buffer + row * slot->bitmap.pitch,
+                      slot->bitmap.buffer + row * slot->bitmap.pitch + bitmap_width,
+                      pending.bitmap.begin() + (row + border) * pending.bitmap_width + border);
+        atlas_->pending.push_back(std::move(pending));
+        return glyph;
+    }
+
+    //freetype bitmaps are single byte greyscale, not 4-byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, slot->bitmap.pitch);
+    glBindTexture(GL_TEXTURE_2D, texture_);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RED, GL_UNSIGNED_BYTE, slot->bitmap.buffer);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    RenderStats::add(RenderStats::UPLOAD_BYTES, width * height);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    return glyph;
+}
+
+void GlyphCache::generatePending() {
+    std::vector<PendingGlyph>& pending = atlas_->pending;
+    if (pending.empty()) return;
+    parallelFor((int)pending.size(), 4, [&](int begin, int end, int) {
+        for (int i = begin; i < end; i++) computeSdf(pending[i]);
+    });
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, texture_);
+    for (auto& glyph : pending) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, glyph.x, glyph.y, glyph.width, glyph.height, GL_RED, GL_UNSIGNED_BYTE, glyph.sdf.data());
+        RenderStats::add(RenderStats::UPLOAD_BYTES, glyph.sdf.size());
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    pending.clear();
+}
+
+lm::vec2 GlyphCache::buildText(const std::string& text, int font_size, float x, float y, int wrap_width,
+                               const lm::vec3& color, std::vector<TextVertex>& vertices) {
+    //bitmap glyphs are only drawn at their size
+    float scale = sdf_ ? (float)font_size / size_ : 1.0f;
+    float line_height = line_height_ * scale;
+    float pen_x = 0;
+    float line_top = 0;
+    float width = 0;
+    for (char c : text) {
+        if (c == '\r') continue;
+        if (c == '\n') {
+            pen_x = 0;
+            line_top += line_height;
+            continue;
+        }
+        const Glyph& glyph = getGlyph((unsigned char)c);
+        float advance = glyph.advance * scale;
+        if (wrap_width > 0 && pen_x > 0 && pen_x + advance > wrap_width) {
+            pen_x = 0;
+            line_top += line_height;
+        }
+        if (glyph.width > 0) {
+            float x0 = x + pen_x + glyph.bearing_x * scale;
+            float y0 = y + line_top + (ascender_ - glyph.bearing_y) * scale;
+            float x1 = x0 + glyph.width * scale;
+            float y1 = y0 + glyph.height * scale;
+            TextVertex tl = { x0, y0, glyph.u0, glyph.v0, color.x, color.y, color.z };
+            TextVertex tr = { x1, y0, glyph.u1, glyph.v0, color.x, color.y, color.z };
+            TextVertex bl = { x0, y1, glyph.u0, glyph.v1, color.x, color.y, color.z };
+            TextVertex br = { x1, y1, glyph.u1, glyph.v1, color.x, color.y, color.z };
+            vertices.insert(vertices.end(), { bl, br, tr, bl, tr, tl });
+        }
+        pen_x += advance;
+        width = std::max(width, pen_x);
+    }
+    generatePending();
+    return lm::vec2(width, line_top + line_height);
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include "../includes.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include "ft2build.h"
+#include FT_FREETYPE_H
+
+// Glyph cache.
+// Shared by every text using a font. Glyphs are rasterized by FreeType the
+// first time they are needed and packed with stb_rect_pack into a
+// single-channel ATLAS_SIZE texture, so changing a text only costs building
+// its quads (see buildText), never a FreeType round trip or a texture upload
+// for glyphs seen before. All caches share one FT_Library.
+// There are two kinds of caches:
+// - bitmap: one per (font, size), glyphs are coverage at that size
+// - signed distance field: one per font, for all sizes. Glyphs are rendered
+//   at SDF_SIZE * SDF_UPSAMPLE pixels, and the distance to the outline,
+//   up to SDF_SPREAD pixels of SDF_SIZE, is stored at SDF_SIZE resolution
+//   (0.5 on the outline, more inside). Distance fields of new glyphs are
+//   computed on worker threads. Text is scaled from SDF_SIZE to its size and
+//   shaded with a threshold on the distance, so it stays sharp at any scale
+
+//vertex of a text quad, in pixels
+struct TextVertex {
+    float x, y;
+    float u, v;
+    float r, g, b;
+};
+
+class GlyphCache {
+public:
+    static const int ATLAS_SIZE = 1024;
+    static const int PADDING = 1; //texels between glyphs, so filtering does not bleed
+    static const int SDF_SIZE = 32;
+    static const int SDF_UPSAMPLE = 4;
+    static const int SDF_SPREAD = 4;
+
+    //metrics in pixels of the cache size (SDF_SIZE for distance fields)
+    struct Glyph {
+        float u0 = 0, v0 = 0, u1 = 0, v1 = 0;
+        float width = 0;
+        float height = 0;
+        float bearing_x = 0;
+        float bearing_y = 0; //from baseline to top of bitmap
+        float advance = 0;
+    };
+
+    //shared cache of a font, for a pixel size or, with sdf, for all sizes.
+    //nullptr if the font can't be loaded
+    static GlyphCache* get(const std::string& font_path, int size, bool sdf = false);
+    //destroys all caches and the FreeType library
+    static void shutdown();
+
+    GlyphCache(const std::string& font_path, int size, bool sdf);
+    ~GlyphCache();
+
+    //rasterizes the glyph on first use. Distance fields are pending until
+    //generatePending() (buildText calls it)
+    const Glyph& getGlyph(unsigned int code);
+    //computes the distance fields of new glyphs in parallel and uploads them
+    void generatePending();
+    //appends quads for text at font_size, top left at (x, y) with y growing
+    //down, breaking lines at '\n' and, if wrap_width is not 0, at wrap_width.
+    //Returns size of the text
+    lm::vec2 buildText(const std::string& text, int font_size, float x, float y, int wrap_width,
+                       const lm::vec3& color, std::vector<TextVertex>& vertices);
+
+    bool isValid() const { return face_ != nullptr; }
+    bool isSdf() const { return sdf_; }
+    GLuint getTexture() const { return texture_; }
+    int getNumGlyphs() const { return (int)glyphs_.size(); }
+
+private:
+    static FT_Library library_;
+    static std::unordered_map<std::string, std::unique_ptr<GlyphCache>> caches_;
+
+    FT_Face face_ = nullptr;
+    bool sdf_;
+    int size_;
+    GLuint texture_ = 0;
+    float line_height_ = 0;
+    float ascender_ = 0;
+    struct Atlas; //stb_rect_pack state and glyphs waiting for their distance field
+    std::unique_ptr<Atlas> atlas_;
+    std::unordered_map<unsigned int, Glyph> glyphs_;
+
+    bool pack_(int width, int height, int& x, int& y);
+};
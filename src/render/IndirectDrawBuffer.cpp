@@ -0,0 +1,124 @@
+#include "IndirectDrawBuffer.h"
+#include "RenderStats.h"
+#include <algorithm>
+#include <cstring>
+
+bool multiDrawSupported() {
+    //the instanced shaders are GLSL 4.30
+    return GLEW_VERSION_4_3 && GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance &&
+           GLEW_ARB_buffer_storage && GLEW_ARB_shader_storage_buffer_object &&
+           GLEW_ARB_program_interface_query;
+}
+
+IndirectDrawBuffer::~IndirectDrawBuffer() {
+    destroyBuffers_();
+}
+
+void IndirectDrawBuffer::init(GLuint draws_per_region) {
+    createBuffers_(draws_per_region);
+}
+
+//creates the ring buffers and maps them for the lifetime of the buffer
+void IndirectDrawBuffer::createBuffers_(GLuint draws_per_region) {
+    draws_per_region_ = draws_per_region;
+    GLuint total = draws_per_region * NUM_REGIONS;
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    glGenBuffers(1, &command_buffer_);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer_);
+    glBufferStorage(GL_DRAW_INDIRECT_BUFFER, total * sizeof(DrawElementsIndirectCommand), nullptr, flags);
+    commands_ = (DrawElementsIndirectCommand*)glMapBufferRange(GL_DRAW_INDIRECT_BUFFER, 0, total * sizeof(DrawElementsIndirectCommand), flags);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    glGenBuffers(1, &per_draw_buffer_);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, per_draw_buffer_);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, total * sizeof(PerDrawData), nullptr, flags);
+    per_draw_ = (PerDrawData*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, total * sizeof(PerDrawData), flags);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    //draw ids never change, so this is a normal static buffer
+    std::vector<GLuint> ids(total);
+    for (GLuint i = 0; i < total; i++) ids[i] = i;
+    glGenBuffers(1, &draw_id_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, draw_id_buffer);
+    glBufferData(GL_ARRAY_BUFFER, total * sizeof(GLuint), ids.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    region_ = 0;
+    cursor_ = submitted_ = 0;
+}
+
+void IndirectDrawBuffer::destroyBuffers_() {
+    for (auto& region : regions_) waitFence_(region);
+    if (commands_) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer_);
+        glUnmapBuffer(GL_DRAW_INDIRECT_BUFFER);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, per_draw_buffer_);
+        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        glDeleteBuffers(1, &command_buffer_);
+        glDeleteBuffers(1, &per_draw_buffer_);
+        glDeleteBuffers(1, &draw_id_buffer);
+    }
+    commands_ = nullptr;
+    per_draw_ = nullptr;
+    command_buffer_ = per_draw_buffer_ = draw_id_buffer = 0;
+}
+
+//blocks until the GPU has finished with a region
+void IndirectDrawBuffer::waitFence_(Region& region) {
+    if (!region.fence) return;
+    while (true) {
+        GLenum result = glClientWaitSync(region.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        if (result != GL_TIMEOUT_EXPIRED) break;
+    }
+    glDeleteSync(region.fence);
+    region.fence = nullptr;
+}
+
+void IndirectDrawBuffer::beginFrame(GLuint num_draws) {
+    //grow if this frame does not fit. Only happens when the scene grows
+    if (num_draws > draws_per_region_) {
+        destroyBuffers_();
+        createBuffers_(std::max(num_draws, draws_per_region_ * 2));
+    }
+    region_ = (region_ + 1) % NUM_REGIONS;
+    waitFence_(regions_[region_]);
+    cursor_ = submitted_ = region_ * draws_per_region_;
+}
+
+void IndirectDrawBuffer::endFrame() {
+    Region& region = regions_[region_];
+    if (region.fence) glDeleteSync(region.fence);
+    region.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void IndirectDrawBuffer::addDraw(GLuint count, GLuint first_index, GLint base_vertex, const lm::mat4& model, const lm::mat4& normal_matrix, GLuint material) {
+    if (cursor_ >= (GLuint)(region_ + 1) * draws_per_region_) return;
+
+    DrawElementsIndirectCommand& cmd = commands_[cursor_];
+    cmd.count = count;
+    cmd.instance_count = 1;
+    cmd.first_index = first_index;
+    cmd.base_vertex = base_vertex;
+    cmd.base_instance = cursor_; //draw id attribute is fetched with this
+
+    PerDrawData& data = per_draw_[cursor_];
+    data.model = model;
+    memcpy(data.normal_matrix, normal_matrix.m, sizeof(data.normal_matrix));
+    data.material = material;
+    cursor_++;
+    //written straight to the persistently mapped buffers
+    RenderStats::add(RenderStats::UPLOAD_BYTES, sizeof(DrawElementsIndirectCommand) + sizeof(PerDrawData));
+}
+
+bool IndirectDrawBuffer::submit(GLenum index_type) {
+    if (cursor_ == submitted_) return false;
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PER_DRAW_BINDING, per_draw_buffer_);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, index_type,
+        (void*)(submitted_ * sizeof(DrawElementsIndirectCommand)), cursor_ - submitted_, 0);
+    submitted_ = cursor_;
+    return true;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include "../includes.h"
+#include <vector>
+
+// Indirect draw buffer.
+// Persistently mapped ring of indirect draw commands and per-draw data, used by
+// the multi-draw path of the GL backend. The ring is split in regions, one per
+// frame in flight, each protected by a fence so the CPU never writes data the
+// GPU is still reading. The per-draw data is read in the vertex shader from an
+// SSBO, indexed by a draw id attribute which is fetched with the baseInstance
+// of each command (see draw_id_buffer).
+
+//layout fixed by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+};
+
+//per-draw data, std430 layout - must match PerDraw in phong.vert
+struct PerDrawData {
+    lm::mat4 model;
+    float normal_matrix[12]; //3 columns, padded to vec4
+    GLuint material;
+    GLuint pad[3];
+};
+
+//returns true if the driver supports everything the multi-draw path needs
+bool multiDrawSupported();
+
+class IndirectDrawBuffer {
+public:
+    ~IndirectDrawBuffer();
+
+    //creates the buffers, with room for draws_per_region draws per frame
+    void init(GLuint draws_per_region = 4096);
+    bool isInit() { return commands_ != nullptr; }
+
+    //waits for next region to be free and makes sure it can hold num_draws
+    void beginFrame(GLuint num_draws);
+    //fences the current region
+    void endFrame();
+
+    //writes a draw into the mapped buffers. ~150 bytes, no GL calls
+    void addDraw(GLuint count, GLuint first_index, GLint base_vertex, const lm::mat4& model, const lm::mat4& normal_matrix, GLuint material);
+    //draws every command added since last submit with one glMultiDrawElementsIndirect.
+    //All of them must use index_type. Returns false if there was nothing to draw
+    bool submit(GLenum index_type);
+
+    //vertex buffer with 0, 1, 2... used as instanced draw id attribute
+    GLuint draw_id_buffer = 0;
+    //binding point of the per-draw SSBO
+    static const GLuint PER_DRAW_BINDING = 0;
+    static const GLuint DRAW_ID_ATTRIBUTE = 3;
+
+private:
+    static const int NUM_REGIONS = 3;
+    struct Region {
+        GLsync fence = nullptr;
+    };
+    Region regions_[NUM_REGIONS];
+    int region_ = 0;
+
+    GLuint draws_per_region_ = 0;
+    GLuint command_buffer_ = 0;
+    GLuint per_draw_buffer_ = 0;
+    DrawElementsIndirectCommand* commands_ = nullptr; //mapped
+    PerDrawData* per_draw_ = nullptr; //mapped
+
+    GLuint cursor_ = 0; //next draw in the whole ring
+    GLuint submitted_ = 0; //first draw not yet submitted
+
+    void createBuffers_(GLuint draws_per_region);
+    void destroyBuffers_();
+    void waitFence_(Region& region);
+};
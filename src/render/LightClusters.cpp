@@ -0,0 +1,153 @@
+#include "LightClusters.h"
+#include "RenderStats.h"
+#include "../Parallel.h"
+#include <algorithm>
+#include <cmath>
+
+LightClusters::~LightClusters() {
+    glDeleteTextures(3, textures_);
+    glDeleteBuffers(3, buffers_);
+}
+
+//converts a view space x (or y) interval between two depths to a tile range.
+//- scale: projection scale of this axis (1/tan(fov/2), over aspect for x)
+static void tileRange(float v0, float v1, float z0, float z1, float scale, int dim, int& first, int& last) {
+    //the extreme projections are at the nearest or farthest depth, depending on the sign
+    float ndc0 = (v0 > 0 ? v0 / z1 : v0 / z0) * scale;
+    float ndc1 = (v1 > 0 ? v1 / z0 : v1 / z1) * scale;
+    first = (int)floorf((ndc0 * 0.5f + 0.5f) * dim);
+    last = (int)floorf((ndc1 * 0.5f + 0.5f) * dim);
+    first = std::max(first, 0);
+    last = std::min(last, dim - 1);
+}
+
+void LightClusters::buildLightData(const std::vector<ClusterLight>& lights) {
+    light_data_.resize(lights.size() * 8);
+    for (size_t i = 0; i < lights.size(); i++) {
+        const ClusterLight& light = lights[i];
+        float* data = &light_data_[i * 8];
+        data[0] = light.position.x; data[1] = light.position.y; data[2] = light.position.z; data[3] = light.radius;
+        data[4] = light.color.x; data[5] = light.color.y; data[6] = light.color.z; data[7] = 0.0f;
+    }
+    //clusters are not used
+    grid_.clear();
+    indices_.clear();
+}
+
+void LightClusters::build(const std::vector<ClusterLight>& lights, const lm::mat4& view_matrix, const lm::mat4& projection_matrix) {
+    const lm::mat4& proj = projection_matrix;
+    bool perspective = proj.m[15] == 0.0f;
+
+    //near and far planes from the projection matrix
+    float near_plane, far_plane;
+    if (perspective) {
+        near_plane = proj.m[14] / (proj.m[10] - 1.0f);
+        far_plane = proj.m[14] / (proj.m[10] + 1.0f);
+    }
+    else {
+        near_plane = (proj.m[14] + 1.0f) / proj.m[10];
+        far_plane = (proj.m[14] - 1.0f) / proj.m[10];
+    }
+    near_plane = std::max(near_plane, 0.001f);
+    far_plane = std::max(far_plane, near_plane * 2.0f);
+
+    float log_ratio = logf(far_plane / near_plane);
+    z_scale_ = DIM_Z / log_ratio;
+    z_bias_ = -DIM_Z * logf(near_plane) / log_ratio;
+
+    //light data, and view space light spheres
+    buildLightData(lights);
+    size_t num_lights = lights.size();
+    std::vector<lm::vec4> view_spheres(num_lights);
+    for (size_t i = 0; i < num_lights; i++) {
+        lm::vec3 p = view_matrix * lights[i].position;
+        view_spheres[i] = lm::vec4(p.x, p.y, -p.z, lights[i].radius); //z is depth
+    }
+
+    //each z slice is independent, so slices are built in parallel
+    grid_.assign(NUM_CLUSTERS * 2, 0);
+    slice_indices_.resize(DIM_Z);
+    int min_batch = num_lights < 64 ? DIM_Z : 2;
+    parallelFor(DIM_Z, min_batch, [&](int begin, int end, int) {
+        std::vector<GLuint> tile_counts(DIM_X * DIM_Y);
+        std::vector<int> ranges; //light, x0, x1, y0, y1 for each light in slice
+        for (int s = begin; s < end; s++) {
+            float slice_near = near_plane * powf(far_plane / near_plane, (float)s / DIM_Z);
+            float slice_far = near_plane * powf(far_plane / near_plane, (float)(s + 1) / DIM_Z);
+
+            //tile ranges of lights touching this slice
+            ranges.clear();
+            std::fill(tile_counts.begin(), tile_counts.end(), 0);
+            for (size_t i = 0; i < num_lights; i++) {
+                const lm::vec4& sphere = view_spheres[i];
+                if (sphere.z + sphere.w < slice_near || sphere.z - sphere.w > slice_far) continue;
+                int x0 = 0, x1 = DIM_X - 1, y0 = 0, y1 = DIM_Y - 1;
+                if (perspective) {
+                    float z0 = std::max(slice_near, sphere.z - sphere.w);
+                    float z1 = std::min(slice_far, sphere.z + sphere.w);
+                    tileRange(sphere.x - sphere.w, sphere.x + sphere.w, z0, z1, proj.m[0], DIM_X, x0, x1);
+                    tileRange(sphere.y - sphere.w, sphere.y + sphere.w, z0, z1, proj.m[5], DIM_Y, y0, y1);
+                    if (x0 > x1 || y0 > y1) continue;
+                }
+                ranges.insert(ranges.end(), { (int)i, x0, x1, y0, y1 });
+                for (int y = y0; y <= y1; y++)
+                    for (int x = x0; x <= x1; x++) tile_counts[y * DIM_X + x]++;
+            }
+
+            //offsets of each cluster in the slice list, then fill it
+            std::vector<GLuint>& list = slice_indices_[s];
+            GLuint* grid = &grid_[s * DIM_X * DIM_Y * 2];
+            GLuint offset = 0;
+            for (int t = 0; t < DIM_X * DIM_Y; t++) {
+                grid[t * 2] = offset;
+                grid[t * 2 + 1] = 0;
+                offset += tile_counts[t];
+            }
+            list.resize(offset);
+            for (size_t r = 0; r < ranges.size(); r += 5) {
+                for (int y = ranges[r + 3]; y <= ranges[r + 4]; y++) {
+                    for (int x = ranges[r + 1]; x <= ranges[r + 2]; x++) {
+                        GLuint* cluster = &grid[(y * DIM_X + x) * 2];
+                        list[cluster[0] + cluster[1]++] = (GLuint)ranges[r];
+                    }
+                }
+            }
+        }
+    });
+
+    //merge slice lists into a single list, offsetting the grid
+    indices_.clear();
+    for (int s = 0; s < DIM_Z; s++) {
+        GLuint base = (GLuint)indices_.size();
+        GLuint* grid = &grid_[s * DIM_X * DIM_Y * 2];
+        for (int t = 0; t < DIM_X * DIM_Y; t++) grid[t * 2] += base;
+        indices_.insert(indices_.end(), slice_indices_[s].begin(), slice_indices_[s].end());
+    }
+}
+
+//uploads data to a buffer, creating it and its buffer texture if needed,
+//and binds the texture to a unit
+void LightClusters::uploadBuffer_(int i, GLenum format, const void* data, size_t bytes, GLuint unit) {
+    if (!buffers_[i]) {
+        glGenBuffers(1, &buffers_[i]);
+        glGenTextures(1, &textures_[i]);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, buffers_[i]);
+    //orphan the old storage so we don't wait for the GPU. Buffer textures can't be empty
+    glBufferData(GL_TEXTURE_BUFFER, std::max(bytes, (size_t)16), nullptr, GL_STREAM_DRAW);
+    if (bytes) glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    RenderStats::add(RenderStats::UPLOAD_BYTES, bytes);
+
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_BUFFER, textures_[i]);
+    RenderStats::add(RenderStats::TEXTURE_BINDS);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, buffers_[i]);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void LightClusters::upload() {
+    uploadBuffer_(0, GL_RGBA32F, light_data_.data(), light_data_.size() * sizeof(float), LIGHT_DATA_UNIT);
+    uploadBuffer_(1, GL_RG32UI, grid_.data(), grid_.size() * sizeof(GLuint), GRID_UNIT);
+    uploadBuffer_(2, GL_R32UI, indices_.data(), indices_.size() * sizeof(GLuint), INDICES_UNIT);
+}
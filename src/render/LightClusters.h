@@ -0,0 +1,61 @@
+#pragma once
+#include "../includes.h"
+#include <vector>
+
+// Clustered light assignment.
+// The view frustum is split in a grid of clusters: screen tiles in x and y, and
+// slices in z which grow exponentially with view depth. Each frame, every point
+// light is added to the clusters its bounding sphere touches (on the CPU, one
+// z slice per worker), and the result is uploaded to three buffer textures:
+// - light data: 2 RGBA32F texels per light, (position, radius) and (color, 0)
+// - grid: 1 RG32UI texel per cluster, (offset in index list, number of lights)
+// - indices: 1 R32UI texel per light reference
+// phong.frag finds the cluster of each fragment and only loops its lights.
+
+//point light as seen by the clustering
+struct ClusterLight {
+    lm::vec3 position; //world space
+    float radius;
+    lm::vec3 color;
+};
+
+class LightClusters {
+public:
+    static const int DIM_X = 16;
+    static const int DIM_Y = 8;
+    static const int DIM_Z = 24;
+    static const int NUM_CLUSTERS = DIM_X * DIM_Y * DIM_Z;
+
+    //texture units used by the buffer textures
+    static const GLuint LIGHT_DATA_UNIT = 4;
+    static const GLuint GRID_UNIT = 5;
+    static const GLuint INDICES_UNIT = 6;
+
+    ~LightClusters();
+
+    //assigns lights to clusters. Does not use OpenGL
+    void build(const std::vector<ClusterLight>& lights, const lm::mat4& view_matrix, const lm::mat4& projection_matrix);
+    //only fills the light data, for shaders which loop all lights (see ShaderVariants)
+    void buildLightData(const std::vector<ClusterLight>& lights);
+    //uploads result of build() and binds the buffer textures
+    void upload();
+
+    //z slice of view depth d is log(d) * z_scale + z_bias
+    float getZScale() const { return z_scale_; }
+    float getZBias() const { return z_bias_; }
+    size_t getNumLightIndices() const { return indices_.size(); }
+    const std::vector<GLuint>& getGrid() const { return grid_; }
+    const std::vector<GLuint>& getIndices() const { return indices_; }
+
+private:
+    std::vector<float> light_data_;
+    std::vector<GLuint> grid_; //offset, count per cluster
+    std::vector<GLuint> indices_;
+    std::vector<std::vector<GLuint>> slice_indices_; //per z slice, merged into indices_
+    float z_scale_ = 0;
+    float z_bias_ = 0;
+
+    GLuint buffers_[3] = { 0, 0, 0 };
+    GLuint textures_[3] = { 0, 0, 0 };
+    void uploadBuffer_(int i, GLenum format, const void* data, size_t bytes, GLuint unit);
+};
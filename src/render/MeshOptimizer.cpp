@@ -0,0 +1,276 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+void MeshOptimizerStats::print(const std::string& name) const {
+    printf("Mesh optimizer %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+        name.c_str(), acmr_before, acmr_after, atvr_before, atvr_after);
+}
+
+//simulates a FIFO post-transform cache
+void MeshOptimizer::computeCacheStats(const std::vector<unsigned int>& indices, unsigned int num_vertices,
+                                      float& acmr, float& atvr, unsigned int cache_size) {
+    acmr = atvr = 0;
+    if (indices.empty() || !num_vertices) return;
+
+    //timestamp of when each vertex entered the cache
+    std::vector<unsigned int> cache_time(num_vertices, 0);
+    unsigned int time = cache_size + 1;
+    unsigned int misses = 0;
+    for (unsigned int index : indices) {
+        if (time - cache_time[index] > cache_size) {
+            cache_time[index] = time++;
+            misses++;
+        }
+    }
+    acmr = (float)misses / (indices.size() / 3);
+    atvr = (float)misses / num_vertices;
+}
+
+//***********************************
+// Forsyth vertex cache optimisation
+// https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+//***********************************
+
+namespace {
+    const int kCacheSize = 32;
+    const int kMaxValence = 32; //valence scores are clamped from here
+
+    struct ScoreTable {
+        float cache[kCacheSize];
+        float valence[kMaxValence + 1];
+        ScoreTable() {
+            for (int i = 0; i < kCacheSize; i++) {
+                //the last triangle's vertices get a fixed score, so that we do not
+                //prefer the triangle we just drew (strips are not better on modern GPUs)
+                if (i < 3) cache[i] = 0.75f;
+                else cache[i] = powf(1.0f - (float)(i - 3) / (kCacheSize - 3), 1.5f);
+            }
+            valence[0] = 0;
+            //boost vertices with few triangles left, to avoid leaving lone triangles
+            for (int i = 1; i <= kMaxValence; i++)
+                valence[i] = 2.0f * powf((float)i, -0.5f);
+        }
+    };
+    const ScoreTable score_table;
+
+    float vertexScore(int cache_pos, unsigned int valence) {
+        if (valence == 0) return -1.0f;
+        float score = cache_pos >= 0 ? score_table.cache[cache_pos] : 0.0f;
+        return score + score_table.valence[std::min(valence, (unsigned int)kMaxValence)];
+    }
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<unsigned int>& indices, unsigned int num_vertices) {
+    size_t num_tris = indices.size() / 3;
+    if (num_tris < 2) return;
+
+    //triangle adjacency of each vertex, as offsets into one array
+    std::vector<unsigned int> valence(num_vertices, 0);
+    for (unsigned int index : indices) valence[index]++;
+    std::vector<unsigned int> adjacency_offset(num_vertices + 1, 0);
+    for (unsigned int v = 0; v < num_vertices; v++)
+        adjacency_offset[v + 1] = adjacency_offset[v] + valence[v];
+    std::vector<unsigned int> adjacency(indices.size());
+    {
+        std::vector<unsigned int> fill(adjacency_offset.begin(), adjacency_offset.end() - 1);
+        for (size_t t = 0; t < num_tris; t++)
+            for (int k = 0; k < 3; k++)
+                adjacency[fill[indices[t * 3 + k]]++] = (unsigned int)t;
+    }
+
+    std::vector<int> cache_pos(num_vertices, -1);
+    std::vector<float> vertex_score(num_vertices);
+    for (unsigned int v = 0; v < num_vertices; v++)
+        vertex_score[v] = vertexScore(-1, valence[v]);
+
+    std::vector<bool> tri_added(num_tris, false);
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+
+    //cache has room for the 3 new vertices before old ones are evicted
+    std::vector<unsigned int> cache, new_cache;
+    cache.reserve(kCacheSize + 3);
+    new_cache.reserve(kCacheSize + 3);
+
+    size_t scan_cursor = 0; //first triangle which may not be added yet
+    int best = -1;
+    for (size_t emitted = 0; emitted < num_tris; emitted++) {
+        //no candidate from the cache: take next triangle in input order
+        if (best == -1) {
+            while (tri_added[scan_cursor]) scan_cursor++;
+            best = (int)scan_cursor;
+        }
+
+        //emit triangle
+        tri_added[best] = true;
+        const unsigned int* tri = &indices[best * 3];
+        new_cache.clear();
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = tri[k];
+            result.push_back(v);
+            new_cache.push_back(v);
+            //remove triangle from vertex adjacency, so valence is triangles still to draw
+            unsigned int* adj_begin = &adjacency[adjacency_offset[v]];
+            unsigned int* adj_end = adj_begin + valence[v];
+            std::swap(*std::find(adj_begin, adj_end, (unsigned int)best), *(adj_end - 1));
+            valence[v]--;
+        }
+        for (unsigned int v : cache)
+            if (v != tri[0] && v != tri[1] && v != tri[2]) new_cache.push_back(v);
+        std::swap(cache, new_cache);
+
+        //update vertex scores of everything in cache, including the evicted ones
+        for (size_t i = 0; i < cache.size(); i++) {
+            unsigned int v = cache[i];
+            cache_pos[v] = i < kCacheSize ? (int)i : -1;
+            vertex_score[v] = vertexScore(cache_pos[v], valence[v]);
+        }
+        if (cache.size() > kCacheSize) cache.resize(kCacheSize);
+
+        //update triangle scores of triangles touching the cache, and pick the best one
+        best = -1;
+        float best_score = -1.0f;
+        for (unsigned int v : cache) {
+            for (unsigned int a = adjacency_offset[v]; a < adjacency_offset[v] + valence[v]; a++) {
+                unsigned int t = adjacency[a];
+                float score = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+                if (score > best_score) {
+                    best_score = score;
+                    best = (int)t;
+                }
+            }
+        }
+    }
+
+    indices.swap(result);
+}
+
+//***********************************
+// Overdraw optimisation
+//***********************************
+
+void MeshOptimizer::optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<float>& positions, float threshold) {
+    size_t num_tris = indices.size() / 3;
+    unsigned int num_vertices = (unsigned int)positions.size() / 3;
+    if (num_tris < 2) return;
+
+    float acmr_original, atvr;
+    computeCacheStats(indices, num_vertices, acmr_original, atvr);
+
+    //split into clusters where the cache is 'reset', i.e. a triangle has no
+    //vertex in the cache. Reordering clusters then costs little cache efficiency
+    std::vector<size_t> cluster_start;
+    std::vector<unsigned int> cache_time(num_vertices, 0);
+    unsigned int time = STATS_CACHE_SIZE + 1;
+    const size_t min_cluster = 32; //triangles
+    for (size_t t = 0; t < num_tris; t++) {
+        int misses = 0;
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = indices[t * 3 + k];
+            if (time - cache_time[v] > STATS_CACHE_SIZE) {
+                cache_time[v] = time++;
+                misses++;
+            }
+        }
+        if (t == 0 || (misses == 3 && t - cluster_start.back() >= min_cluster))
+            cluster_start.push_back(t);
+    }
+    if (cluster_start.size() < 2) return;
+    cluster_start.push_back(num_tris);
+
+    //mesh centroid
+    float mesh_center[3] = { 0, 0, 0 };
+    for (unsigned int v = 0; v < num_vertices; v++)
+        for (int k = 0; k < 3; k++) mesh_center[k] += positions[v * 3 + k];
+    for (int k = 0; k < 3; k++) mesh_center[k] /= num_vertices;
+
+    //sort key of each cluster: how much the cluster faces away from the center.
+    //Outer clusters are more likely to occlude the rest, so they are drawn first
+    struct Cluster { size_t begin, end; float key; };
+    std::vector<Cluster> clusters;
+    for (size_t c = 0; c + 1 < cluster_start.size(); c++) {
+        float center[3] = { 0, 0, 0 }, normal[3] = { 0, 0, 0 };
+        float area = 0;
+        for (size_t t = cluster_start[c]; t < cluster_start[c + 1]; t++) {
+            const float* p0 = &positions[indices[t * 3] * 3];
+            const float* p1 = &positions[indices[t * 3 + 1] * 3];
+            const float* p2 = &positions[indices[t * 3 + 2] * 3];
+            float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            //cross product length is twice the area, so this is an area weighted normal
+            float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            float tri_area = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int k = 0; k < 3; k++) {
+                normal[k] += n[k];
+                center[k] += (p0[k] + p1[k] + p2[k]) / 3.0f * tri_area;
+            }
+            area += tri_area;
+        }
+        float key = 0;
+        if (area > 0) {
+            for (int k = 0; k < 3; k++) key += (center[k] / area - mesh_center[k]) * normal[k];
+            key /= area;
+        }
+        clusters.push_back({ cluster_start[c], cluster_start[c + 1], key });
+    }
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+        return a.key > b.key;
+    });
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (auto& cluster : clusters)
+        result.insert(result.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+
+    //only keep the new order if cache efficiency stays within threshold
+    float acmr_new;
+    computeCacheStats(result, num_vertices, acmr_new, atvr);
+    if (acmr_new <= acmr_original * threshold)
+        indices.swap(result);
+}
+
+//***********************************
+// Vertex fetch optimisation
+//***********************************
+
+unsigned int MeshOptimizer::optimizeVertexFetch(std::vector<unsigned int>& indices, unsigned int num_vertices, std::vector<unsigned int>& remap) {
+    remap.assign(num_vertices, ~0u);
+    unsigned int next = 0;
+    for (unsigned int& index : indices) {
+        if (remap[index] == ~0u) remap[index] = next++;
+        index = remap[index];
+    }
+    return next;
+}
+
+void MeshOptimizer::remapVertexStream(std::vector<float>& stream, unsigned int stride, const std::vector<unsigned int>& remap, unsigned int new_num_vertices) {
+    if (stream.size() < remap.size() * stride) return; //missing stream
+    std::vector<float> result(new_num_vertices * stride);
+    for (size_t v = 0; v < remap.size(); v++) {
+        if (remap[v] == ~0u) continue;
+        std::copy(stream.begin() + v * stride, stream.begin() + (v + 1) * stride, result.begin() + remap[v] * stride);
+    }
+    stream.swap(result);
+}
+
+MeshOptimizerStats MeshOptimizer::optimizeMesh(std::vector<float>& vertices, std::vector<float>& uvs,
+                                               std::vector<float>& normals, std::vector<unsigned int>& indices) {
+    MeshOptimizerStats stats;
+    unsigned int num_vertices = (unsigned int)vertices.size() / 3;
+    computeCacheStats(indices, num_vertices, stats.acmr_before, stats.atvr_before);
+
+    optimizeVertexCache(indices, num_vertices);
+    optimizeOverdraw(indices, vertices);
+
+    std::vector<unsigned int> remap;
+    unsigned int new_num_vertices = optimizeVertexFetch(indices, num_vertices, remap);
+    remapVertexStream(vertices, 3, remap, new_num_vertices);
+    remapVertexStream(uvs, 2, remap, new_num_vertices);
+    remapVertexStream(normals, 3, remap, new_num_vertices);
+
+    computeCacheStats(indices, new_num_vertices, stats.acmr_after, stats.atvr_after);
+    return stats;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <vector>
+#include <string>
+
+// Mesh optimizer.
+// Reorders triangles and vertices of a triangle list so that the GPU does less
+// work per draw:
+// - vertex cache: triangles ordered (Forsyth) so vertices are reused while still
+//   in the post-transform cache
+// - overdraw: clusters of the cache-ordered triangles are sorted so that
+//   outward facing clusters are drawn first, as long as the cache efficiency
+//   does not get worse than a threshold
+// - vertex fetch: vertices are reordered by first use, so vertex fetch reads
+//   memory linearly. Unused vertices are removed
+// Stats use the ACMR (average cache miss ratio, transformed vertices per triangle)
+// and ATVR (average transformed vertex ratio, transformed vertices per vertex).
+
+struct MeshOptimizerStats {
+    float acmr_before = 0;
+    float atvr_before = 0;
+    float acmr_after = 0;
+    float atvr_after = 0;
+    void print(const std::string& name) const;
+};
+
+namespace MeshOptimizer {
+    //size of the simulated FIFO cache used for stats
+    const unsigned int STATS_CACHE_SIZE = 16;
+
+    void computeCacheStats(const std::vector<unsigned int>& indices, unsigned int num_vertices,
+                           float& acmr, float& atvr, unsigned int cache_size = STATS_CACHE_SIZE);
+
+    //reorders triangles for the post-transform cache
+    void optimizeVertexCache(std::vector<unsigned int>& indices, unsigned int num_vertices);
+
+    //reorders clusters of a cache-optimized index list to reduce overdraw.
+    //- positions: 3 floats per vertex
+    //- threshold: max allowed ACMR increase, e.g. 1.05 allows 5% worse ACMR
+    void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<float>& positions, float threshold = 1.05f);
+
+    //builds a remap table ordering vertices by first use, and rewrites indices.
+    //Returns number of used vertices; unused vertices get remap value of ~0u
+    unsigned int optimizeVertexFetch(std::vector<unsigned int>& indices, unsigned int num_vertices, std::vector<unsigned int>& remap);
+    //applies a remap table to a vertex stream with given number of floats per vertex
+    void remapVertexStream(std::vector<float>& stream, unsigned int stride, const std::vector<unsigned int>& remap, unsigned int new_num_vertices);
+
+    //runs all the passes over a mesh with separate vertex streams. uvs and normals may be empty
+    MeshOptimizerStats optimizeMesh(std::vector<float>& vertices, std::vector<float>& uvs,
+                                    std::vector<float>& normals, std::vector<unsigned int>& indices);
+}
@@ -0,0 +1,236 @@
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <unordered_map>
+
+namespace {
+    //symmetric 4x4 matrix, upper triangle
+    struct Quadric {
+        double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+        double a11 = 0, a12 = 0, a13 = 0;
+        double a22 = 0, a23 = 0;
+        double a33 = 0;
+        double weight = 0;
+
+        //adds quadric of plane n.p + d = 0
+        void addPlane(const double n[3], double d, double weight) {
+            a00 += weight * n[0] * n[0]; a01 += weight * n[0] * n[1]; a02 += weight * n[0] * n[2]; a03 += weight * n[0] * d;
+            a11 += weight * n[1] * n[1]; a12 += weight * n[1] * n[2]; a13 += weight * n[1] * d;
+            a22 += weight * n[2] * n[2]; a23 += weight * n[2] * d;
+            a33 += weight * d * d;
+            this->weight += weight;
+        }
+        void add(const Quadric& q) {
+            a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+            a11 += q.a11; a12 += q.a12; a13 += q.a13;
+            a22 += q.a22; a23 += q.a23;
+            a33 += q.a33;
+            weight += q.weight;
+        }
+        //squared distance to planes, averaged by area
+        double error(const float* p) const {
+            if (weight == 0) return 0;
+            double x = p[0], y = p[1], z = p[2];
+            return (a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+                 + a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+                 + a22 * z * z + 2 * a23 * z
+                 + a33) / weight;
+        }
+    };
+
+    struct PositionKey {
+        uint32_t x, y, z;
+        bool operator==(const PositionKey& o) const { return x == o.x && y == o.y && z == o.z; }
+    };
+    struct PositionKeyHash {
+        size_t operator()(const PositionKey& k) const { return (k.x * 73856093u) ^ (k.y * 19349663u) ^ (k.z * 83492791u); }
+    };
+
+    void triangleNormal(const float* p0, const float* p1, const float* p2, double n[3]) {
+        double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    }
+
+    struct Collapse {
+        unsigned int from, to;
+        float error;
+    };
+}
+
+std::vector<unsigned int> MeshSimplifier::simplify(const std::vector<unsigned int>& indices, const std::vector<float>& positions,
+                                                   size_t target_index_count, float max_error, float* result_error) {
+    std::vector<unsigned int> result = indices;
+    if (result_error) *result_error = 0;
+    unsigned int num_vertices = (unsigned int)positions.size() / 3;
+    if (result.size() <= target_index_count || !num_vertices) return result;
+
+    //normalize positions so errors are relative to mesh size
+    float min[3] = { positions[0], positions[1], positions[2] }, max[3] = { min[0], min[1], min[2] };
+    for (unsigned int v = 0; v < num_vertices; v++) {
+        for (int k = 0; k < 3; k++) {
+            min[k] = std::min(min[k], positions[v * 3 + k]);
+            max[k] = std::max(max[k], positions[v * 3 + k]);
+        }
+    }
+    float extent = std::max(max[0] - min[0], std::max(max[1] - min[1], max[2] - min[2]));
+    float inv_extent = extent > 0 ? 1.0f / extent : 0.0f;
+    std::vector<float> pos(positions.size());
+    for (unsigned int v = 0; v < num_vertices; v++)
+        for (int k = 0; k < 3; k++) pos[v * 3 + k] = (positions[v * 3 + k] - min[k]) * inv_extent;
+
+    //vertices which share a position are on an attribute seam, so they are locked.
+    //position_id maps each vertex to the first vertex with its position
+    std::vector<unsigned int> position_id(num_vertices);
+    std::vector<char> locked(num_vertices, 0);
+    {
+        std::unordered_map<PositionKey, unsigned int, PositionKeyHash> first_with_position;
+        for (unsigned int v = 0; v < num_vertices; v++) {
+            PositionKey key;
+            memcpy(&key, &positions[v * 3], sizeof(key));
+            auto it = first_with_position.find(key);
+            if (it == first_with_position.end()) {
+                first_with_position[key] = v;
+                position_id[v] = v;
+            }
+            else {
+                position_id[v] = it->second;
+                locked[v] = locked[it->second] = 1;
+            }
+        }
+    }
+
+    //edges with only one triangle are on an open border, so they are locked too.
+    //Edges are counted by position, so seams don't count as borders
+    {
+        std::unordered_map<uint64_t, int> edge_count;
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (int k = 0; k < 3; k++) {
+                unsigned int a = position_id[result[i + k]], b = position_id[result[i + (k + 1) % 3]];
+                uint64_t key = ((uint64_t)std::min(a, b) << 32) | std::max(a, b);
+                edge_count[key]++;
+            }
+        }
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (int k = 0; k < 3; k++) {
+                unsigned int a = result[i + k], b = result[i + (k + 1) % 3];
+                unsigned int pa = position_id[a], pb = position_id[b];
+                uint64_t key = ((uint64_t)std::min(pa, pb) << 32) | std::max(pa, pb);
+                if (edge_count[key] == 1) locked[a] = locked[b] = 1;
+            }
+        }
+    }
+
+    //vertex quadrics: sum of planes of adjacent triangles, weighted by area
+    std::vector<Quadric> quadrics(num_vertices);
+    for (size_t i = 0; i < result.size(); i += 3) {
+        const float* p0 = &pos[result[i] * 3];
+        double n[3];
+        triangleNormal(p0, &pos[result[i + 1] * 3], &pos[result[i + 2] * 3], n);
+        double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length == 0) continue;
+        for (int k = 0; k < 3; k++) n[k] /= length;
+        double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+        for (int k = 0; k < 3; k++)
+            quadrics[result[i + k]].addPlane(n, d, length * 0.5);
+    }
+
+    double error_limit = (double)max_error * max_error;
+    double reached_error = 0;
+    std::vector<Collapse> collapses;
+    std::vector<char> touched(num_vertices);
+    std::vector<unsigned int> remap(num_vertices);
+    std::vector<unsigned int> adjacency_offset(num_vertices + 1), adjacency;
+
+    //each pass does a batch of independent collapses, cheapest first
+    while (result.size() > target_index_count) {
+        size_t num_tris = result.size() / 3;
+
+        //vertex -> triangle adjacency, to check for flipped triangles
+        std::fill(adjacency_offset.begin(), adjacency_offset.end(), 0);
+        for (unsigned int index : result) adjacency_offset[index + 1]++;
+        for (unsigned int v = 0; v < num_vertices; v++) adjacency_offset[v + 1] += adjacency_offset[v];
+        adjacency.resize(result.size());
+        {
+            std::vector<unsigned int> fill(adjacency_offset.begin(), adjacency_offset.end() - 1);
+            for (size_t t = 0; t < num_tris; t++)
+                for (int k = 0; k < 3; k++) adjacency[fill[result[t * 3 + k]]++] = (unsigned int)t;
+        }
+
+        //candidate collapses, cheapest direction of each edge
+        collapses.clear();
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (int k = 0; k < 3; k++) {
+                unsigned int a = result[i + k], b = result[i + (k + 1) % 3];
+                if (a > b) continue; //each interior edge is found twice
+                if (locked[a] && locked[b]) continue;
+                Quadric q = quadrics[a];
+                q.add(quadrics[b]);
+                double error_ab = locked[a] ? 1e30 : q.error(&pos[b * 3]);
+                double error_ba = locked[b] ? 1e30 : q.error(&pos[a * 3]);
+                if (error_ab <= error_ba) collapses.push_back({ a, b, (float)std::max(0.0, error_ab) });
+                else collapses.push_back({ b, a, (float)std::max(0.0, error_ba) });
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+            return a.error < b.error;
+        });
+
+        //each collapse removes about two triangles
+        size_t needed = (result.size() - target_index_count) / 6 + 1;
+        size_t done = 0;
+        std::fill(touched.begin(), touched.end(), 0);
+        for (unsigned int v = 0; v < num_vertices; v++) remap[v] = v;
+
+        for (const Collapse& c : collapses) {
+            if (c.error > error_limit) break;
+            if (touched[c.from] || touched[c.to]) continue;
+
+            //reject collapse if it flips a triangle around 'from'
+            bool flips = false;
+            for (unsigned int a = adjacency_offset[c.from]; a < adjacency_offset[c.from + 1] && !flips; a++) {
+                const unsigned int* tri = &result[adjacency[a] * 3];
+                if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) continue; //removed by collapse
+                const float* p[3], *q[3];
+                for (int k = 0; k < 3; k++) {
+                    p[k] = &pos[tri[k] * 3];
+                    q[k] = tri[k] == c.from ? &pos[c.to * 3] : p[k];
+                }
+                double n0[3], n1[3];
+                triangleNormal(p[0], p[1], p[2], n0);
+                triangleNormal(q[0], q[1], q[2], n1);
+                if (n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0) flips = true;
+            }
+            if (flips) continue;
+
+            remap[c.from] = c.to;
+            quadrics[c.to].add(quadrics[c.from]);
+            reached_error = std::max(reached_error, (double)c.error);
+            //neighbours of 'from' are touched, so flip checks in this pass stay valid
+            for (unsigned int a = adjacency_offset[c.from]; a < adjacency_offset[c.from + 1]; a++)
+                for (int k = 0; k < 3; k++) touched[result[adjacency[a] * 3 + k]] = 1;
+            touched[c.to] = 1;
+
+            if (++done >= needed) break;
+        }
+        if (!done) break;
+
+        //apply collapses and remove degenerate triangles
+        size_t write = 0;
+        for (size_t i = 0; i < result.size(); i += 3) {
+            unsigned int a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+            if (a == b || b == c || a == c) continue;
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+
+    if (result_error) *result_error = (float)sqrt(reached_error);
+    return result;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+
+// Mesh simplifier.
+// Quadric error edge collapse (Garland & Heckbert), collapsing vertices onto
+// existing vertices so that every LOD can share the vertex data of the original
+// mesh and only needs its own index range.
+// Vertices on open borders and on attribute seams (several vertices with the
+// same position) never move, so UVs and normals are not torn apart.
+
+namespace MeshSimplifier {
+    //returns simplified copy of indices with at most target_index_count indices
+    //(if reachable without exceeding max_error).
+    //- positions: 3 floats per vertex
+    //- max_error: max collapse error, relative to mesh size (0.01 = 1% of mesh extent)
+    //- result_error: if not null, receives the error reached, relative to mesh size
+    std::vector<unsigned int> simplify(const std::vector<unsigned int>& indices, const std::vector<float>& positions,
+                                       size_t target_index_count, float max_error, float* result_error = nullptr);
+}
@@ -0,0 +1,208 @@
+#include "OcclusionCuller.h"
+#include <algorithm>
+#include <cmath>
+#include <xmmintrin.h>
+
+//vertices closer than this (in clip w) are treated as behind the camera
+static const float kNearW = 1e-4f;
+
+OcclusionCuller::OcclusionCuller() {
+    int w = WIDTH, h = HEIGHT;
+    while (true) {
+        levels_.push_back(std::vector<float>(w * h, 1.0f));
+        level_width_.push_back(w);
+        level_height_.push_back(h);
+        if (w == 1 && h == 1) break;
+        w = std::max(1, w / 2);
+        h = std::max(1, h / 2);
+    }
+}
+
+void OcclusionCuller::begin(const lm::mat4& view_projection) {
+    view_projection_ = view_projection;
+    std::fill(levels_[0].begin(), levels_[0].end(), 1.0f);
+    occluder_triangles_ = 0;
+}
+
+//transforms occluder vertices to screen space. The matrix columns are kept in
+//SSE registers, so each vertex is 3 multiply-adds
+void OcclusionCuller::transformVertices_(const std::vector<float>& positions, const lm::mat4& mvp) {
+    size_t num_vertices = positions.size() / 3;
+    xs_.resize(num_vertices);
+    ys_.resize(num_vertices);
+    zs_.resize(num_vertices);
+    ws_.resize(num_vertices);
+
+    __m128 col0 = _mm_loadu_ps(&mvp.m[0]);
+    __m128 col1 = _mm_loadu_ps(&mvp.m[4]);
+    __m128 col2 = _mm_loadu_ps(&mvp.m[8]);
+    __m128 col3 = _mm_loadu_ps(&mvp.m[12]);
+    for (size_t v = 0; v < num_vertices; v++) {
+        const float* p = &positions[v * 3];
+        __m128 clip = _mm_add_ps(_mm_add_ps(_mm_mul_ps(col0, _mm_set1_ps(p[0])), _mm_mul_ps(col1, _mm_set1_ps(p[1]))),
+                                 _mm_add_ps(_mm_mul_ps(col2, _mm_set1_ps(p[2])), col3));
+        float c[4];
+        _mm_storeu_ps(c, clip);
+        ws_[v] = c[3];
+        if (c[3] < kNearW) continue;
+        float inv_w = 1.0f / c[3];
+        xs_[v] = (c[0] * inv_w * 0.5f + 0.5f) * WIDTH;
+        ys_[v] = (c[1] * inv_w * 0.5f + 0.5f) * HEIGHT;
+        zs_[v] = c[2] * inv_w * 0.5f + 0.5f;
+    }
+}
+
+void OcclusionCuller::renderOccluder(const std::vector<float>& positions, const std::vector<unsigned int>& indices, const lm::mat4& model) {
+    lm::mat4 mvp = view_projection_ * model;
+    transformVertices_(positions, mvp);
+
+    std::vector<float>& depth = levels_[0];
+    size_t num_tris = indices.size() / 3;
+
+    //triangle setup for four triangles at once
+    for (size_t first = 0; first < num_tris; first += 4) {
+        float x[3][4], y[3][4], z[3][4];
+        int valid = 0;
+        for (int lane = 0; lane < 4; lane++) {
+            size_t t = first + lane;
+            bool in_front = t < num_tris;
+            for (int k = 0; k < 3 && in_front; k++) {
+                unsigned int v = indices[t * 3 + k];
+                in_front = ws_[v] >= kNearW;
+                x[k][lane] = xs_[v];
+                y[k][lane] = ys_[v];
+                z[k][lane] = zs_[v];
+            }
+            //triangles crossing the near plane are skipped. Drawing less of an
+            //occluder is always safe, it only culls less
+            if (in_front) valid |= 1 << lane;
+            else for (int k = 0; k < 3; k++) x[k][lane] = y[k][lane] = z[k][lane] = 0.0f;
+        }
+        if (!valid) continue;
+
+        __m128 x0 = _mm_loadu_ps(x[0]), x1 = _mm_loadu_ps(x[1]), x2 = _mm_loadu_ps(x[2]);
+        __m128 y0 = _mm_loadu_ps(y[0]), y1 = _mm_loadu_ps(y[1]), y2 = _mm_loadu_ps(y[2]);
+        __m128 z0 = _mm_loadu_ps(z[0]), z1 = _mm_loadu_ps(z[1]), z2 = _mm_loadu_ps(z[2]);
+        __m128 dx1 = _mm_sub_ps(x1, x0), dx2 = _mm_sub_ps(x2, x0);
+        __m128 dy1 = _mm_sub_ps(y1, y0), dy2 = _mm_sub_ps(y2, y0);
+        __m128 dz1 = _mm_sub_ps(z1, z0), dz2 = _mm_sub_ps(z2, z0);
+
+        //twice the signed area. Back facing and degenerate triangles have area <= 0
+        __m128 area = _mm_sub_ps(_mm_mul_ps(dx1, dy2), _mm_mul_ps(dx2, dy1));
+        int front = _mm_movemask_ps(_mm_cmpgt_ps(area, _mm_setzero_ps()));
+        valid &= front;
+        if (!valid) continue;
+
+        //depth plane gradients
+        __m128 inv_area = _mm_div_ps(_mm_set1_ps(1.0f), area);
+        __m128 dzdx = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(dz1, dy2), _mm_mul_ps(dz2, dy1)), inv_area);
+        __m128 dzdy = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(dx1, dz2), _mm_mul_ps(dx2, dz1)), inv_area);
+
+        //bounding boxes, clamped to the screen
+        __m128 min_x = _mm_max_ps(_mm_min_ps(x0, _mm_min_ps(x1, x2)), _mm_setzero_ps());
+        __m128 min_y = _mm_max_ps(_mm_min_ps(y0, _mm_min_ps(y1, y2)), _mm_setzero_ps());
+        __m128 max_x = _mm_min_ps(_mm_max_ps(x0, _mm_max_ps(x1, x2)), _mm_set1_ps((float)WIDTH - 1));
+        __m128 max_y = _mm_min_ps(_mm_max_ps(y0, _mm_max_ps(y1, y2)), _mm_set1_ps((float)HEIGHT - 1));
+
+        float s_dzdx[4], s_dzdy[4], s_min_x[4], s_min_y[4], s_max_x[4], s_max_y[4];
+        _mm_storeu_ps(s_dzdx, dzdx);
+        _mm_storeu_ps(s_dzdy, dzdy);
+        _mm_storeu_ps(s_min_x, min_x);
+        _mm_storeu_ps(s_min_y, min_y);
+        _mm_storeu_ps(s_max_x, max_x);
+        _mm_storeu_ps(s_max_y, max_y);
+
+        //scan conversion, one triangle at a time
+        for (int lane = 0; lane < 4; lane++) {
+            if (!(valid & (1 << lane))) continue;
+            occluder_triangles_++;
+            int bx0 = (int)s_min_x[lane], by0 = (int)s_min_y[lane];
+            int bx1 = (int)s_max_x[lane], by1 = (int)s_max_y[lane];
+            if (bx0 > bx1 || by0 > by1) continue;
+
+            //edge functions, evaluated at pixel centers
+            float ex[3] = { x[0][lane], x[1][lane], x[2][lane] };
+            float ey[3] = { y[0][lane], y[1][lane], y[2][lane] };
+            float step_x[3], step_y[3], row[3];
+            float px = bx0 + 0.5f, py = by0 + 0.5f;
+            for (int e = 0; e < 3; e++) {
+                int a = e, b = (e + 1) % 3;
+                step_x[e] = -(ey[b] - ey[a]);
+                step_y[e] = ex[b] - ex[a];
+                row[e] = (ex[b] - ex[a]) * (py - ey[a]) - (ey[b] - ey[a]) * (px - ex[a]);
+            }
+            float z_row = z[0][lane] + s_dzdx[lane] * (px - ex[0]) + s_dzdy[lane] * (py - ey[0]);
+
+            for (int py_i = by0; py_i <= by1; py_i++) {
+                float e0 = row[0], e1 = row[1], e2 = row[2];
+                float z_px = z_row;
+                float* depth_row = &depth[py_i * WIDTH];
+                for (int px_i = bx0; px_i <= bx1; px_i++) {
+                    if (e0 >= 0 && e1 >= 0 && e2 >= 0 && z_px < depth_row[px_i])
+                        depth_row[px_i] = std::max(z_px, 0.0f);
+                    e0 += step_x[0]; e1 += step_x[1]; e2 += step_x[2];
+                    z_px += s_dzdx[lane];
+                }
+                for (int e = 0; e < 3; e++) row[e] += step_y[e];
+                z_row += s_dzdy[lane];
+            }
+        }
+    }
+}
+
+//each texel of a level stores the farthest depth of the four texels below it
+void OcclusionCuller::end() {
+    for (size_t l = 1; l < levels_.size(); l++) {
+        const std::vector<float>& src = levels_[l - 1];
+        std::vector<float>& dst = levels_[l];
+        int src_w = level_width_[l - 1], src_h = level_height_[l - 1];
+        int w = level_width_[l], h = level_height_[l];
+        for (int y = 0; y < h; y++) {
+            int sy0 = std::min(y * 2, src_h - 1), sy1 = std::min(y * 2 + 1, src_h - 1);
+            for (int x = 0; x < w; x++) {
+                int sx0 = std::min(x * 2, src_w - 1), sx1 = std::min(x * 2 + 1, src_w - 1);
+                dst[y * w + x] = std::max(std::max(src[sy0 * src_w + sx0], src[sy0 * src_w + sx1]),
+                                          std::max(src[sy1 * src_w + sx0], src[sy1 * src_w + sx1]));
+            }
+        }
+    }
+}
+
+bool OcclusionCuller::isVisible(const lm::vec3& center, const lm::vec3& half_width, const lm::mat4& model_view_projection) const {
+    //screen space bounding rectangle and nearest depth of the box corners
+    float min_x = 1e30f, min_y = 1e30f, max_x = -1e30f, max_y = -1e30f, min_z = 1e30f;
+    for (int i = 0; i < 8; i++) {
+        lm::vec4 corner(center.x + (i & 1 ? half_width.x : -half_width.x),
+                        center.y + (i & 2 ? half_width.y : -half_width.y),
+                        center.z + (i & 4 ? half_width.z : -half_width.z), 1.0f);
+        lm::vec4 clip = model_view_projection * corner;
+        //box crosses near plane, so camera may be inside it
+        if (clip.w < kNearW) return true;
+        float inv_w = 1.0f / clip.w;
+        float sx = (clip.x * inv_w * 0.5f + 0.5f) * WIDTH;
+        float sy = (clip.y * inv_w * 0.5f + 0.5f) * HEIGHT;
+        min_x = std::min(min_x, sx); max_x = std::max(max_x, sx);
+        min_y = std::min(min_y, sy); max_y = std::max(max_y, sy);
+        min_z = std::min(min_z, clip.z * inv_w * 0.5f + 0.5f);
+    }
+    //off screen boxes are left for the frustum test
+    if (max_x < 0 || max_y < 0 || min_x >= WIDTH || min_y >= HEIGHT) return true;
+    if (min_z <= 0) return true;
+
+    int x0 = std::max(0, (int)min_x), y0 = std::max(0, (int)min_y);
+    int x1 = std::min(WIDTH - 1, (int)max_x), y1 = std::min(HEIGHT - 1, (int)max_y);
+
+    //pick the level where the rectangle covers a few texels
+    size_t level = 0;
+    int size = std::max(x1 - x0, y1 - y0);
+    while (size > 4 && level + 1 < levels_.size()) {
+        size >>= 1;
+        level++;
+    }
+    const std::vector<float>& depth = levels_[level];
+    int w = level_width_[level];
+    for (int y = y0 >> level; y <= (y1 >> level); y++)
+        for (int x = x0 >> level; x <= (x1 >> level); x++)
+            if (min_z <= depth[y * w + x]) return true;
+    return false;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "../linmath.h"
+#include <vector>
+
+// Software occlusion culler.
+// Occluder meshes (big, simple geometry such as ground and walls) are rasterized
+// on the CPU into a small depth buffer. A hierarchical-Z pyramid (farthest depth
+// per texel) is built from it, and each candidate mesh is culled if the nearest
+// depth of its screen space bounding box is behind everything in the pyramid
+// texels it covers.
+// Triangle setup is done four triangles at a time with SSE. Nothing here uses
+// OpenGL, so it can run (and be tested) without a GL context.
+
+class OcclusionCuller {
+public:
+    static const int WIDTH = 256;
+    static const int HEIGHT = 128;
+
+    OcclusionCuller();
+
+    //clears depth buffer and sets the camera used by following calls
+    void begin(const lm::mat4& view_projection);
+    //rasterizes an occluder into the depth buffer.
+    //- positions: 3 floats per vertex, in object space
+    void renderOccluder(const std::vector<float>& positions, const std::vector<unsigned int>& indices, const lm::mat4& model);
+    //builds the hierarchical-Z pyramid. Must be called after all occluders are rendered
+    void end();
+
+    //returns false if the object space box is hidden behind the occluders.
+    //Thread safe after end()
+    bool isVisible(const lm::vec3& center, const lm::vec3& half_width, const lm::mat4& model_view_projection) const;
+
+    //depth buffer, WIDTH * HEIGHT values between 0 (near) and 1 (far)
+    const std::vector<float>& getDepth() const { return levels_[0]; }
+    int getOccluderTriangles() const { return occluder_triangles_; }
+
+private:
+    lm::mat4 view_projection_;
+    //level 0 is the depth buffer, level i is half the size of level i - 1
+    std::vector<std::vector<float>> levels_;
+    std::vector<int> level_width_, level_height_;
+    int occluder_triangles_ = 0;
+
+    //screen space vertices of the occluder being rendered, SoA, w <= 0 if behind camera
+    std::vector<float> xs_, ys_, zs_, ws_;
+
+    void transformVertices_(const std::vector<float>& positions, const lm::mat4& mvp);
+    void rasterizeTriangle_(const float x[3], const float y[3], const float z[3]);
+};
@@ -0,0 +1,102 @@
+#include "RenderCommandBuffer.h"
+#include <algorithm>
+
+//adds a draw to the queue and returns it, so caller can fill constants in place
+DrawItem& RenderQueue::push(int pipeline, int material, int geometry, int lod, uint32_t variant) {
+    items.emplace_back();
+    DrawItem& item = items.back();
+    item.pipeline = pipeline;
+    item.material = material;
+    item.geometry = geometry;
+    item.lod = lod;
+    item.variant = variant;
+    item.sort_key = makeSortKey(variant, pipeline, material, geometry);
+    return item;
+}
+
+void RenderQueue::sort() {
+    std::sort(items.begin(), items.end(), [](const DrawItem& a, const DrawItem& b) {
+        return a.sort_key < b.sort_key;
+    });
+}
+
+void RenderCommandBuffer::clear() {
+    commands.clear();
+    constants.clear();
+    current_pipeline_ = -1;
+    current_material_ = -1;
+}
+
+void RenderCommandBuffer::setPipeline(int program) {
+    if (program == current_pipeline_) return;
+    commands.push_back({ RenderCommandSetPipeline, 0, program });
+    current_pipeline_ = program;
+    //a new pipeline needs its material uniforms set again
+    current_material_ = -1;
+}
+
+void RenderCommandBuffer::bindMaterial(int material) {
+    if (material == current_material_) return;
+    commands.push_back({ RenderCommandBindMaterial, 0, material });
+    current_material_ = material;
+}
+
+void RenderCommandBuffer::setConstants(const DrawConstants& draw_constants) {
+    constants.push_back(draw_constants);
+    commands.push_back({ RenderCommandSetConstants, 0, (int)constants.size() - 1 });
+}
+
+void RenderCommandBuffer::draw(int geometry, int lod) {
+    commands.push_back({ RenderCommandDraw, (uint8_t)lod, geometry });
+}
+
+//k-way merge of the sorted queues. Number of queues is the number of workers (small)
+//so a linear scan for the smallest head is cheaper than a heap
+void RenderCommandBuffer::merge(std::vector<RenderQueue>& queues) {
+    std::vector<size_t> heads(queues.size(), 0);
+    while (true) {
+        int best = -1;
+        for (size_t q = 0; q < queues.size(); q++) {
+            if (heads[q] == queues[q].items.size()) continue;
+            if (best == -1 || queues[q].items[heads[q]].sort_key < queues[best].items[heads[best]].sort_key)
+                best = (int)q;
+        }
+        if (best == -1) break;
+
+        const DrawItem& item = queues[best].items[heads[best]++];
+        setPipeline(item.pipeline);
+        bindMaterial(item.material);
+        setConstants(item.constants);
+        draw(item.geometry, item.lod);
+    }
+}
+
+void RenderBackend::countCommand_(const RenderCommand& cmd) {
+    stats.commands++;
+    switch (cmd.type) {
+    case RenderCommandSetPipeline: stats.pipeline_changes++; break;
+    case RenderCommandBindMaterial: stats.material_changes++; break;
+    case RenderCommandDraw: stats.draw_calls++; break;
+    default: break;
+    }
+}
+
+void NullRenderBackend::execute(const RenderCommandBuffer& buffer) {
+    stats.reset();
+    recorded = buffer.commands;
+    recorded_constants = buffer.constants;
+    for (auto& cmd : buffer.commands)
+        countCommand_(cmd);
+}
+
+//writes recorded commands as text, one per line
+void NullRenderBackend::dump(std::ostream& out) const {
+    static const char* names[] = { "SetPipeline", "BindMaterial", "SetConstants", "Draw" };
+    for (auto& cmd : recorded) {
+        out << names[cmd.type] << " " << cmd.arg;
+        if (cmd.type == RenderCommandDraw) out << " lod " << (int)cmd.lod;
+        out << "\n";
+    }
+    out << "commands: " << stats.commands << " pipelines: " << stats.pipeline_changes
+        << " materials: " << stats.material_changes << " draws: " << stats.draw_calls << std::endl;
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include "../includes.h"
+#include <vector>
+#include <cstdint>
+#include <ostream>
+
+// Render command buffer.
+// Scene traversal produces DrawItems into one RenderQueue per worker thread,
+// the queues are sorted and merged into a RenderCommandBuffer, and a RenderBackend
+// executes the buffer. Traversal never touches OpenGL, so it can run in parallel
+// and can be tested with the NullRenderBackend without a GL context
+// (--check-traversal, see Headless::checkTraversal).
+
+enum RenderCommandType : uint8_t {
+    RenderCommandSetPipeline,   //arg: shader program id
+    RenderCommandBindMaterial,  //arg: index in GraphicsSystem::materials_, first of its bucket (see Material::bucket)
+    RenderCommandSetConstants,  //arg: index in RenderCommandBuffer::constants
+    RenderCommandDraw           //arg: index in GraphicsSystem::geometries_, lod: level of detail
+};
+
+struct RenderCommand {
+    RenderCommandType type;
+    uint8_t lod; //only used by draws
+    int arg;
+};
+
+//per-draw constants
+struct DrawConstants {
+    lm::mat4 mvp;
+    lm::mat4 model;
+    lm::mat4 normal_matrix;
+    int material; //index in GraphicsSystem::materials_, for shaders which read the material data
+};
+
+//per-view constants, shared by every draw in a buffer
+struct ViewConstants {
+    lm::mat4 view_projection;
+    lm::vec3 cam_pos;
+    bool depth_prepass = false; //draw depth only first, then light with GL_EQUAL
+};
+
+//a draw produced by scene traversal, before sorting
+struct DrawItem {
+    uint64_t sort_key;
+    int pipeline;
+    int material; //bound material: materials of a bucket share the first one's binding
+    int geometry;
+    int lod;
+    uint32_t variant; //shader variant key of the material, see ShaderVariants.h
+    DrawConstants constants;
+};
+
+//sort key orders draws by shader variant, pipeline, then material, then geometry,
+//so draws of programs with the same features stay together
+//- variant: 8 bits, pipeline: 12 bits, material: 20 bits, geometry: 24 bits
+inline uint64_t makeSortKey(uint32_t variant, int pipeline, int material, int geometry) {
+    return ((uint64_t)(variant & 0xFF) << 56) |
+           ((uint64_t)(pipeline & 0xFFF) << 44) |
+           ((uint64_t)(material & 0xFFFFF) << 24) |
+           (uint64_t)(geometry & 0xFFFFFF);
+}
+
+//sub-buffer of draws, filled by a single traversal worker
+class RenderQueue {
+public:
+    std::vector<DrawItem> items;
+    //meshes rejected during traversal
+    int frustum_culled = 0;
+    int occlusion_culled = 0;
+
+    void clear() { items.clear(); frustum_culled = occlusion_culled = 0; }
+    DrawItem& push(int pipeline, int material, int geometry, int lod = 0, uint32_t variant = 0);
+    void sort();
+};
+
+//compact list of commands for one view
+class RenderCommandBuffer {
+public:
+    ViewConstants view;
+    std::vector<RenderCommand> commands;
+    std::vector<DrawConstants> constants;
+
+    void clear();
+    void setPipeline(int program);
+    void bindMaterial(int material);
+    void setConstants(const DrawConstants& draw_constants);
+    void draw(int geometry, int lod = 0);
+
+    //merges *sorted* queues in sort order, skipping redundant pipeline and material changes
+    void merge(std::vector<RenderQueue>& queues);
+
+private:
+    int current_pipeline_ = -1;
+    int current_material_ = -1;
+};
+
+//counters filled by backends while executing a buffer
+struct RenderBackendStats {
+    int commands = 0;
+    int pipeline_changes = 0;
+    int material_changes = 0;
+    int draw_calls = 0;
+    int multi_draw_calls = 0; //glMultiDrawElementsIndirect calls, each covering several draws
+    void reset() { commands = pipeline_changes = material_changes = draw_calls = multi_draw_calls = 0; }
+};
+
+//executes command buffers
+class RenderBackend {
+public:
+    virtual ~RenderBackend() {}
+    virtual void execute(const RenderCommandBuffer& buffer) = 0;
+    RenderBackendStats stats;
+protected:
+    void countCommand_(const RenderCommand& cmd);
+};
+
+//backend which records the commands it receives instead of executing them.
+//Does not need a GL context, so can run headless (e.g. on a build machine)
+class NullRenderBackend : public RenderBackend {
+public:
+    std::vector<RenderCommand> recorded;
+    std::vector<DrawConstants> recorded_constants;
+
+    void execute(const RenderCommandBuffer& buffer) override;
+    void dump(std::ostream& out) const;
+};
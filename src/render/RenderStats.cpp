@@ -0,0 +1,103 @@
+#include "RenderStats.h"
+#include <fstream>
+
+static const char* counter_names_[RenderStats::NUM_COUNTERS] = {
+    "draw_calls", "triangles", "instances", "shader_binds", "material_binds",
+    "texture_binds", "upload_bytes", "visible", "frustum_culled", "occlusion_culled"
+};
+
+static std::vector<RenderStats::PassStats> frame_; //being counted
+static std::vector<RenderStats::PassStats> last_;
+static RenderStats::PassStats other_;
+static RenderStats::PassStats totals_;
+static int current_ = -1; //pass in frame_, -1 outside passes
+static int frame_index_ = 0;
+static std::ofstream dump_;
+
+static void writeLine(const RenderStats::PassStats& pass) {
+    dump_ << frame_index_ << "," << pass.name;
+    for (int c = 0; c < RenderStats::NUM_COUNTERS; c++)
+        dump_ << "," << pass.counters[c];
+    dump_ << "\n";
+}
+
+const char* RenderStats::getName(Counter counter) {
+    return counter_names_[counter];
+}
+
+void RenderStats::beginFrame() {
+    frame_.clear();
+    current_ = -1;
+}
+
+void RenderStats::endFrame() {
+    current_ = -1;
+    bool other_used = false;
+    for (int c = 0; c < NUM_COUNTERS; c++)
+        if (other_.counters[c]) other_used = true;
+    if (other_used) {
+        other_.name = "other";
+        frame_.push_back(other_);
+        other_ = PassStats();
+    }
+
+    totals_ = PassStats();
+    totals_.name = "total";
+    for (auto& pass : frame_)
+        for (int c = 0; c < NUM_COUNTERS; c++)
+            totals_.counters[c] += pass.counters[c];
+    last_.swap(frame_);
+
+    if (dump_.is_open()) {
+        for (auto& pass : last_) writeLine(pass);
+        writeLine(totals_);
+    }
+    frame_index_++;
+}
+
+void RenderStats::beginPass(const char* name) {
+    frame_.emplace_back();
+    frame_.back().name = name;
+    current_ = (int)frame_.size() - 1;
+}
+
+void RenderStats::endPass() {
+    current_ = -1;
+}
+
+void RenderStats::add(Counter counter, int64_t value) {
+    PassStats& pass = current_ == -1 ? other_ : frame_[current_];
+    pass.counters[counter] += value;
+}
+
+const std::vector<RenderStats::PassStats>& RenderStats::getPasses() {
+    return last_;
+}
+
+const RenderStats::PassStats& RenderStats::getTotals() {
+    return totals_;
+}
+
+int RenderStats::getFrame() {
+    return frame_index_;
+}
+
+bool RenderStats::startDump(const std::string& path) {
+    stopDump();
+    dump_.open(path);
+    if (!dump_) return false;
+    dump_ << "frame,pass";
+    for (int c = 0; c < NUM_COUNTERS; c++)
+        dump_ << "," << counter_names_[c];
+    dump_ << "\n";
+    return true;
+}
+
+void RenderStats::stopDump() {
+    if (dump_.is_open()) dump_.close();
+    dump_.clear();
+}
+
+bool RenderStats::isDumping() {
+    return dump_.is_open();
+}
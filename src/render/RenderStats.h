@@ -0,0 +1,57 @@
+#pragma once
+#include "../includes.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Render statistics.
+// Counters of the work the renderer gives the GPU, kept per pass of the frame
+// graph so batching and culling changes can be measured where they happen.
+// Systems add to the counters at their GL calls, on the main thread;
+// counts made outside a pass (e.g. loading) go to an "other" entry. The last
+// frame is kept for ProfilerModule, and every frame can be appended to a CSV
+// file (one line per pass and one "total" line) for offline analysis.
+// Usage: RenderStats::add(RenderStats::DRAW_CALLS);
+namespace RenderStats {
+    enum Counter {
+        DRAW_CALLS, //a multi-draw is one call
+        TRIANGLES,
+        INSTANCES, //objects drawn, several per call when batched
+        SHADER_BINDS,
+        MATERIAL_BINDS,
+        TEXTURE_BINDS,
+        UPLOAD_BYTES, //buffer and texture data sent to the GPU
+        VISIBLE, //objects which passed culling
+        FRUSTUM_CULLED,
+        OCCLUSION_CULLED,
+        NUM_COUNTERS
+    };
+
+    struct PassStats {
+        std::string name;
+        int64_t counters[NUM_COUNTERS] = {};
+        int64_t operator[](Counter counter) const { return counters[counter]; }
+    };
+
+    const char* getName(Counter counter);
+
+    //frame boundaries, around all the passes
+    void beginFrame();
+    void endFrame();
+    void beginPass(const char* name);
+    void endPass();
+
+    void add(Counter counter, int64_t value = 1);
+
+    //passes of the last frame, in order
+    const std::vector<PassStats>& getPasses();
+    //sum of the passes of the last frame
+    const PassStats& getTotals();
+    int getFrame();
+
+    //appends every frame to a CSV file, with a header. Returns false if the
+    //file can't be opened
+    bool startDump(const std::string& path);
+    void stopDump();
+    bool isDumping();
+}
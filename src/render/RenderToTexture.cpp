@@ -1,4 +1,5 @@
 #include "RenderToTexture.h"
+#include <algorithm>
 
 // Temporal render to texture
 // This should be improved and move somewhere else
@@ -12,11 +13,12 @@ RenderToTexture::RenderToTexture()
     Init();
 }
 
-RenderToTexture::RenderToTexture(const char* name, int new_xres, int new_yres)
+RenderToTexture::RenderToTexture(const char* name, int new_xres, int new_yres, GLenum format)
 {
     name_ = name;
     xres_ = new_xres;
     yres_ = new_yres;
+    format_ = format;
 
     Init();
 }
@@ -39,11 +41,13 @@ bool RenderToTexture::Init() {
     glBindTexture(GL_TEXTURE_2D, colorbuffer_);
 
     // Give an empty image to OpenGL ( the last "0" )
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, xres_, yres_, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, format_, xres_, yres_, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
 
-    // Poor filtering. Needed !
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    // No mipmaps. Linear, as the texture may be shown scaled (dynamic resolution)
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
     // The depth buffer
     glGenRenderbuffers(1, &depthbuffer_);
@@ -59,21 +63,41 @@ bool RenderToTexture::Init() {
     glDrawBuffers(1, DrawBuffers); // "1" is the size of DrawBuffers
 
     // Always check that our framebuffer is ok
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        return false;
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    if (!complete)
+        std::cerr << "ERROR: Render target " << name_ << " is not complete" << std::endl;
+    return complete;
+}
 
-    return true;
+bool RenderToTexture::Resize(int new_xres, int new_yres)
+{
+    if (new_xres == xres_ && new_yres == yres_ && frambuffer_name_)
+        return true;
+    Destroy();
+    xres_ = new_xres;
+    yres_ = new_yres;
+    return Init();
 }
 
 // Activating render to texture
-// Everything rendered will be saved into this texture
+// Everything rendered will be saved into this texture, which covers the viewport
 void RenderToTexture::Activate()
 {
+    Bind();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+// Same as Activate, keeping what was rendered before
+void RenderToTexture::Bind()
+{
     glBindFramebuffer(GL_FRAMEBUFFER, frambuffer_name_);
+    glViewport(0, 0, xres_, yres_);
 }
 
-// Deactivate render to texture, so we are back to our main buffer
+// Deactivate render to texture, so we are back to our main buffer.
+// The caller restores the viewport of the window
 void RenderToTexture::Deactivate()
 {
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -81,6 +105,96 @@ void RenderToTexture::Deactivate()
 
 void RenderToTexture::Destroy()
 {
-    // Delete the framebuffer object
+    // Delete the framebuffer object and its attachments
+    glDeleteFramebuffers(1, &frambuffer_name_);
+    glDeleteTextures(1, &colorbuffer_);
+    glDeleteRenderbuffers(1, &depthbuffer_);
+    frambuffer_name_ = colorbuffer_ = depthbuffer_ = 0;
+}
+
+void RenderToTexture::BlitToScreen(int width, int height)
+{
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, frambuffer_name_);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, xres_, yres_, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Render target pool
 
+RenderToTexture* RenderTargetPool::Acquire(int xres, int yres, GLenum format)
+{
+    xres = std::max(xres, 1);
+    yres = std::max(yres, 1);
+    //targets already used this frame are not resized, so targets of different
+    //sizes used one after the other in a frame (see FrameGraph) keep their size
+    Entry* resizable = nullptr;
+    for (auto& entry : entries_) {
+        if (entry.in_use || entry.target->GetFormat() != format) continue;
+        if (entry.target->GetWidth() == xres && entry.target->GetHeight() == yres) {
+            resizable = &entry;
+            break;
+        }
+        if (!resizable && entry.last_used < frame_) resizable = &entry;
+    }
+
+    if (resizable)
+        resizable->target->Resize(xres, yres);
+    else {
+        entries_.emplace_back();
+        resizable = &entries_.back();
+        resizable->target.reset(new RenderToTexture("pooled", xres, yres, format));
+    }
+    resizable->in_use = true;
+    resizable->last_used = frame_;
+    return resizable->target.get();
+}
+
+void RenderTargetPool::Release(RenderToTexture* target)
+{
+    for (auto& entry : entries_)
+        if (entry.target.get() == target)
+            entry.in_use = false;
+}
+
+void RenderTargetPool::EndFrame()
+{
+    frame_++;
+    entries_.erase(std::remove_if(entries_.begin(), entries_.end(), [&](const Entry& entry) {
+        return !entry.in_use && frame_ - entry.last_used > kMaxIdleFrames;
+    }), entries_.end());
+}
+
+// Dynamic resolution
+
+static const float kScaleStep = 0.05f;
+static const int kFramesBetweenChanges = 15; //time for a change to show in the average
+
+void DynamicResolution::Update(float frame_ms)
+{
+    average_ms_ = average_ms_ > 0.0f ? average_ms_ * 0.9f + frame_ms * 0.1f : frame_ms;
+    if (!enabled || ++frames_since_change_ < kFramesBetweenChanges)
+        return;
+
+    float scale = scale_;
+    if (average_ms_ > target_ms * 1.05f)
+        scale -= kScaleStep;
+    else if (average_ms_ < target_ms * 0.85f)
+        scale += kScaleStep;
+    scale = std::min(std::max(scale, min_scale), max_scale);
+    if (scale != scale_) {
+        scale_ = scale;
+        frames_since_change_ = 0;
+    }
+}
+
+void DynamicResolution::SetScale(float scale)
+{
+    enabled = false;
+    scale_ = std::min(std::max(scale, 0.1f), 1.0f);
+}
+
+int DynamicResolution::Scaled(int size) const
+{
+    return std::max(1, (int)(size * scale_ + 0.5f));
 }
@@ -1,5 +1,7 @@
 #pragma once
 #include "../includes.h"
+#include <vector>
+#include <memory>
 
 // Render to texture.
 // We save the framebuffer to a texture
@@ -11,19 +13,24 @@ protected:
     // Identifiers for the gpu
     GLuint frambuffer_name_ = 0;
     // Color buffer, texture colormap
-    GLuint colorbuffer_;
+    GLuint colorbuffer_ = 0;
     // Depth map identifier
-    GLuint depthbuffer_;
+    GLuint depthbuffer_ = 0;
 
 public:
     RenderToTexture();
-    RenderToTexture(const char* name, int xres, int yres);
+    RenderToTexture(const char* name, int xres, int yres, GLenum format = GL_RGB8);
     ~RenderToTexture();
 
     bool Init();
+    // Recreates the buffers if the size changed
+    bool Resize(int xres, int yres);
     void Activate();
+    void Bind();
     void Deactivate();
     void Destroy();
+    // Copies the color buffer to the window, stretched to its size
+    void BlitToScreen(int width, int height);
 
     GLuint GetFrameBufferName() {
         return frambuffer_name_;
@@ -37,9 +44,70 @@ public:
         return depthbuffer_;
     }
 
+    int GetWidth() const { return xres_; }
+    int GetHeight() const { return yres_; }
+    GLenum GetFormat() const { return format_; }
+
 private:
 
     int xres_ = 0;
     int yres_ = 0;
+    GLenum format_ = GL_RGB8;
     const char* name_;
 };
+
+// Render target pool.
+// Targets are requested by size and color format every frame, and given back
+// with Release() once used. A free target with the same key is handed out
+// again, so steady frames allocate nothing. When the size changes (window or
+// editor viewport resize, dynamic resolution) a free target of the same
+// format, not used yet this frame, is resized in place. Targets not requested
+// for kMaxIdleFrames frames are destroyed in EndFrame().
+class RenderTargetPool
+{
+public:
+    static const int kMaxIdleFrames = 60;
+
+    RenderToTexture* Acquire(int xres, int yres, GLenum format = GL_RGB8);
+    void Release(RenderToTexture* target);
+    void EndFrame();
+    void Clear() { entries_.clear(); }
+    size_t GetSize() const { return entries_.size(); }
+
+private:
+    struct Entry {
+        std::unique_ptr<RenderToTexture> target;
+        bool in_use = false;
+        int last_used = 0; //frame
+    };
+    std::vector<Entry> entries_;
+    int frame_ = 0;
+};
+
+// Dynamic resolution.
+// Scale of the render size relative to the output size, picked from frame
+// times: while the average frame is slower than the target the scale goes
+// down, and when there is enough headroom it goes back up. Scales change in
+// steps, and not every frame, so the target is only resized now and then.
+class DynamicResolution
+{
+public:
+    bool enabled = false;
+    float target_ms = 16.6f;
+    float min_scale = 0.5f;
+    float max_scale = 1.0f;
+
+    // Feeds the duration of the last frame
+    void Update(float frame_ms);
+    // Fixed scale, disables automatic changes
+    void SetScale(float scale);
+    float GetScale() const { return scale_; }
+    float GetAverageMs() const { return average_ms_; }
+    // Size to render at for an output size
+    int Scaled(int size) const;
+
+private:
+    float scale_ = 1.0f;
+    float average_ms_ = 0.0f;
+    int frames_since_change_ = 0;
+};
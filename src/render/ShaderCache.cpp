@@ -0,0 +1,177 @@
+#include "ShaderCache.h"
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+//cache file starts with this, followed by the driver string and the entries
+static const uint32_t kMagic = 0x31434250; //"PBC1"
+
+struct ProgramBinary {
+    GLenum format;
+    std::vector<char> data;
+};
+
+static std::string filename_;
+static std::string driver_;
+static std::unordered_map<uint64_t, ProgramBinary> binaries_;
+static bool binaries_supported_ = false;
+static bool parallel_compile_ = false;
+static bool dirty_ = false;
+static int hits_ = 0;
+static int misses_ = 0;
+
+static std::string glString(GLenum name) {
+    const GLubyte* s = glGetString(name);
+    return s ? std::string((const char*)s) : std::string();
+}
+
+template<typename T>
+static bool readValue(std::ifstream& file, T& value) {
+    return (bool)file.read((char*)&value, sizeof(T));
+}
+
+template<typename T>
+static void writeValue(std::ofstream& file, const T& value) {
+    file.write((const char*)&value, sizeof(T));
+}
+
+void ShaderCache::init(const std::string& filename) {
+    filename_ = filename;
+    driver_ = glString(GL_VENDOR) + "|" + glString(GL_RENDERER) + "|" + glString(GL_VERSION);
+
+    //binaries need the extension (core in 4.1) and at least one binary format
+    GLint num_formats = 0;
+    if (GLEW_ARB_get_program_binary)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+    binaries_supported_ = num_formats > 0;
+
+    //let the driver decide how many compiler threads to use
+    if (GLEW_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        parallel_compile_ = true;
+    }
+    else if (GLEW_ARB_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+        parallel_compile_ = true;
+    }
+
+    std::cout << "Shader cache: program binaries " << (binaries_supported_ ? "on" : "not supported")
+              << ", parallel compile " << (parallel_compile_ ? "on" : "not supported") << std::endl;
+    if (!binaries_supported_) return;
+
+    std::ifstream file(filename_, std::ios::binary);
+    if (!file) return;
+
+    uint32_t magic = 0, driver_length = 0, count = 0;
+    if (!readValue(file, magic) || magic != kMagic) return;
+    if (!readValue(file, driver_length)) return;
+    std::string driver(driver_length, '\0');
+    if (!file.read(&driver[0], driver_length)) return;
+    if (driver != driver_) {
+        //written by another driver (or driver version), binaries would be rejected anyway
+        std::cout << "Shader cache: driver changed, cache discarded" << std::endl;
+        dirty_ = true;
+        return;
+    }
+    if (!readValue(file, count)) return;
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t key;
+        uint32_t format, size;
+        if (!readValue(file, key) || !readValue(file, format) || !readValue(file, size)) break;
+        ProgramBinary& binary = binaries_[key];
+        binary.format = format;
+        binary.data.resize(size);
+        if (!file.read(binary.data.data(), size)) {
+            binaries_.erase(key);
+            break;
+        }
+    }
+}
+
+void ShaderCache::save() {
+    if (!binaries_supported_ || !dirty_) return;
+    std::ofstream file(filename_, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "ERROR: Could not write shader cache " << filename_ << std::endl;
+        return;
+    }
+    writeValue(file, kMagic);
+    writeValue(file, (uint32_t)driver_.size());
+    file.write(driver_.data(), driver_.size());
+    writeValue(file, (uint32_t)binaries_.size());
+    for (auto& entry : binaries_) {
+        writeValue(file, entry.first);
+        writeValue(file, (uint32_t)entry.second.format);
+        writeValue(file, (uint32_t)entry.second.data.size());
+        file.write(entry.second.data.data(), entry.second.data.size());
+    }
+    dirty_ = false;
+}
+
+//FNV-1a over both sources, with a separator so that moving code from one
+//stage to the other changes the key
+uint64_t ShaderCache::hashSources(const std::string& vertex_source, const std::string& fragment_source) {
+    uint64_t hash = 14695981039346656037ULL;
+    auto add = [&hash](const std::string& s) {
+        for (char c : s) {
+            hash ^= (unsigned char)c;
+            hash *= 1099511628211ULL;
+        }
+        hash ^= 0xFF;
+        hash *= 1099511628211ULL;
+    };
+    add(vertex_source);
+    add(fragment_source);
+    return hash;
+}
+
+bool ShaderCache::loadProgram(GLuint program, uint64_t key) {
+    if (!binaries_supported_) return false;
+    auto it = binaries_.find(key);
+    if (it == binaries_.end()) {
+        misses_++;
+        return false;
+    }
+    const ProgramBinary& binary = it->second;
+    glProgramBinary(program, binary.format, binary.data.data(), (GLsizei)binary.data.size());
+    GLint link_ok = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
+    if (!link_ok) {
+        //driver rejected it, the program will be linked from source and stored again
+        binaries_.erase(it);
+        dirty_ = true;
+        misses_++;
+        return false;
+    }
+    hits_++;
+    return true;
+}
+
+void ShaderCache::prepareProgram(GLuint program) {
+    if (binaries_supported_)
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void ShaderCache::storeProgram(GLuint program, uint64_t key) {
+    if (!binaries_supported_) return;
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+    ProgramBinary& binary = binaries_[key];
+    binary.data.resize(length);
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &binary.format, binary.data.data());
+    binary.data.resize(written);
+    dirty_ = true;
+}
+
+bool ShaderCache::isEnabled() {
+    return binaries_supported_;
+}
+
+bool ShaderCache::parallelCompile() {
+    return parallel_compile_;
+}
+
+int ShaderCache::getHits() { return hits_; }
+int ShaderCache::getMisses() { return misses_; }
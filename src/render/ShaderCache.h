@@ -0,0 +1,41 @@
+#pragma once
+#include "../includes.h"
+#include <cstdint>
+
+// Program binary cache.
+// Linked programs are saved with glGetProgramBinary to a single cache file,
+// keyed by a hash of their sources. The file header stores the driver string
+// (vendor, renderer and version), and the whole cache is discarded if it was
+// written by a different driver. A binary the driver refuses to load is also
+// treated as a miss, so the caller always falls back to compiling from source.
+// When GL_KHR_parallel_shader_compile (or the ARB version) is available, the
+// driver is allowed to use all its compiler threads, and Shader does not wait
+// for compile or link results until the program is first used.
+
+namespace ShaderCache {
+    //reads the cache file and checks what the driver supports. Must be called
+    //after glewInit, and before the first shader is compiled
+    void init(const std::string& filename);
+    //writes the cache file, if any program was added since it was read or
+    //last saved. Cheap otherwise, so it can be called every frame
+    void save();
+    //false if the driver has no program binary formats, nothing is cached
+    bool isEnabled();
+
+    //64 bit hash of the program sources, used as cache key
+    uint64_t hashSources(const std::string& vertex_source, const std::string& fragment_source);
+
+    //loads binary of program with given key. Returns false on miss or if the
+    //driver rejects the binary, in which case program must be linked from source
+    bool loadProgram(GLuint program, uint64_t key);
+    //marks a program as retrievable. Must be called before linking it
+    void prepareProgram(GLuint program);
+    //stores binary of a linked program
+    void storeProgram(GLuint program, uint64_t key);
+
+    //true if the driver compiles and links in the background
+    bool parallelCompile();
+
+    int getHits();
+    int getMisses();
+}
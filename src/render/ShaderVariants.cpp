@@ -0,0 +1,85 @@
+#include "ShaderVariants.h"
+
+//light bucket values, stored in the SHADER_LIGHT_BUCKET bits
+static const int kBucketLights[] = { 0, 1, 2, 4, 8 };
+static const uint32_t kClusteredBucket = 5;
+static const int kLightShift = 2;
+
+ShaderVariants::ShaderVariants(const std::string& vertex_source, const std::string& fragment_source) :
+    vertex_source_(vertex_source), fragment_source_(fragment_source) {
+    auto uses = [&](const char* define) {
+        return vertex_source_.find(define) != std::string::npos || fragment_source_.find(define) != std::string::npos;
+    };
+    //textures and lights are read by the fragment stage. A shared vertex shader
+    //(e.g. phong.vert with texture.frag) mentioning them must not turn them on
+    auto fragment_uses = [&](const char* define) {
+        return fragment_source_.find(define) != std::string::npos;
+    };
+    if (fragment_uses("USE_DIFFUSE_MAP")) features_ |= SHADER_DIFFUSE_MAP;
+    if (fragment_uses("USE_SPECULAR_MAP")) features_ |= SHADER_SPECULAR_MAP;
+    if (fragment_uses("NUM_LIGHTS")) features_ |= SHADER_LIGHT_BUCKET;
+    if (uses("INSTANCING")) features_ |= SHADER_INSTANCING;
+    if (fragment_uses("TEXTURE_ARRAYS")) features_ |= SHADER_TEXTURE_ARRAYS;
+}
+
+uint32_t ShaderVariants::lightBucket(int num_lights) {
+    for (uint32_t b = 0; b < sizeof(kBucketLights) / sizeof(int); b++)
+        if (num_lights <= kBucketLights[b]) return b << kLightShift;
+    return kClusteredBucket << kLightShift;
+}
+
+int ShaderVariants::bucketLights(uint32_t key) {
+    uint32_t bucket = (key & SHADER_LIGHT_BUCKET) >> kLightShift;
+    return bucket < kClusteredBucket ? kBucketLights[bucket] : 0;
+}
+
+std::string ShaderVariants::getVertexSource(uint32_t key) const {
+    return addDefines_(vertex_source_, key);
+}
+
+std::string ShaderVariants::getFragmentSource(uint32_t key) const {
+    return addDefines_(fragment_source_, key);
+}
+
+std::string ShaderVariants::describe(uint32_t key) {
+    std::string s;
+    if (key & SHADER_DIFFUSE_MAP) s += "DIFFUSE_MAP,";
+    if (key & SHADER_SPECULAR_MAP) s += "SPECULAR_MAP,";
+    if ((key & SHADER_LIGHT_BUCKET) >> kLightShift == kClusteredBucket) s += "CLUSTERED_LIGHTS,";
+    else s += "LIGHTS_" + std::to_string(bucketLights(key)) + ",";
+    if (key & SHADER_INSTANCING) s += "INSTANCING,";
+    if (key & SHADER_TEXTURE_ARRAYS) s += "TEXTURE_ARRAYS,";
+    s.pop_back();
+    return "[" + s + "]";
+}
+
+int ShaderVariants::getProgram(uint32_t key) const {
+    auto it = programs_.find(key);
+    return it == programs_.end() ? -1 : it->second;
+}
+
+//defines go right after the #version line, which must stay first. Storage
+//buffers need GLSL 4.30, so instancing variants also get that version
+std::string ShaderVariants::addDefines_(const std::string& source, uint32_t key) const {
+    key &= features_;
+    std::string defines;
+    if (key & SHADER_DIFFUSE_MAP) defines += "#define USE_DIFFUSE_MAP\n";
+    if (key & SHADER_SPECULAR_MAP) defines += "#define USE_SPECULAR_MAP\n";
+    if (features_ & SHADER_LIGHT_BUCKET) {
+        if ((key & SHADER_LIGHT_BUCKET) >> kLightShift == kClusteredBucket) defines += "#define CLUSTERED_LIGHTS\n";
+        else defines += "#define NUM_LIGHTS " + std::to_string(bucketLights(key)) + "\n";
+    }
+    if (key & SHADER_INSTANCING) defines += "#define INSTANCING\n";
+    if (key & SHADER_TEXTURE_ARRAYS) defines += "#define TEXTURE_ARRAYS\n";
+    if (defines.empty()) return source;
+
+    size_t insert = 0;
+    std::string version;
+    if (source.compare(0, 8, "#version") == 0) {
+        insert = source.find('\n');
+        insert = insert == std::string::npos ? source.size() : insert + 1;
+        version = source.substr(0, insert);
+    }
+    if (key & SHADER_INSTANCING) version = "#version 430 core\n";
+    return version + defines + source.substr(insert);
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+
+// Shader variants.
+// A variant set holds the vertex and fragment sources of a shader, and builds
+// permutations of them from a key of feature bits: each bit adds a #define
+// after the #version line. A set only has the features whose define its
+// sources mention (the fragment source, for the texture and light features),
+// so sets of shaders without features have a single variant.
+// GraphicsSystem chooses the key of each Material from its textures (and
+// whether they are in the texture atlas) and the number of lights in the
+// scene, compiles the variant the first time it is needed and caches the
+// program in the set.
+
+enum ShaderFeature : uint32_t {
+    SHADER_DIFFUSE_MAP = 1 << 0,    //USE_DIFFUSE_MAP: material samples a diffuse texture
+    SHADER_SPECULAR_MAP = 1 << 1,   //USE_SPECULAR_MAP: material samples a specular texture
+    SHADER_LIGHT_BUCKET = 7 << 2,   //NUM_LIGHTS n or CLUSTERED_LIGHTS, see lightBucket()
+    SHADER_INSTANCING = 1 << 5,     //INSTANCING: per-draw data read from IndirectDrawBuffer
+    SHADER_TEXTURE_ARRAYS = 1 << 6, //TEXTURE_ARRAYS: textures and colours of the material read from TextureAtlas
+};
+
+class ShaderVariants {
+public:
+    //light counts up to kMaxLoopedLights are looped directly, padded up to the
+    //bucket size. Bigger counts use the light clusters
+    static const int kMaxLoopedLights = 8;
+
+    ShaderVariants(const std::string& vertex_source, const std::string& fragment_source);
+
+    //returns the light bits of a variant key for a number of lights
+    static uint32_t lightBucket(int num_lights);
+    //number of lights a looped variant expects (0 for clustered ones)
+    static int bucketLights(uint32_t key);
+
+    //features used by the sources. Keys should be masked with this
+    uint32_t getFeatures() const { return features_; }
+    //sources of a variant, with its defines
+    std::string getVertexSource(uint32_t key) const;
+    std::string getFragmentSource(uint32_t key) const;
+    //readable suffix for names, e.g. "[DIFFUSE_MAP,LIGHTS_4]"
+    static std::string describe(uint32_t key);
+
+    //compiled programs of this set, by key. -1 if not compiled
+    int getProgram(uint32_t key) const;
+    void setProgram(uint32_t key, int program) { programs_[key] = program; }
+
+private:
+    std::string vertex_source_;
+    std::string fragment_source_;
+    uint32_t features_ = 0;
+    std::unordered_map<uint32_t, int> programs_;
+
+    std::string addDefines_(const std::string& source, uint32_t key) const;
+};
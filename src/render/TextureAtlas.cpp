@@ -0,0 +1,263 @@
+#include "TextureAtlas.h"
+#include "RenderStats.h"
+#include "../GraphicsSystem.h"
+#include <algorithm>
+#include <map>
+#include <cstring>
+
+//imgui_draw.cpp has its own static copy
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "../imstb_rectpack.h"
+
+TextureAtlas::~TextureAtlas() {
+    clear();
+    glDeleteTextures(1, &material_texture_);
+    glDeleteBuffers(1, &material_buffer_);
+}
+
+void TextureAtlas::clear() {
+    for (auto& group : groups_) release_(group.second);
+    groups_.clear();
+    release_(pages_);
+    slots_.clear();
+}
+
+const AtlasSlot* TextureAtlas::find(GLuint texture) const {
+    auto it = slots_.find(texture);
+    return it == slots_.end() ? nullptr : &it->second;
+}
+
+size_t TextureAtlas::getNumArrays() const {
+    size_t count = pages_.arrays.size();
+    for (auto& group : groups_) count += group.second.arrays.size();
+    return count;
+}
+
+//size and format of level 0 of a texture. False for compressed textures, and
+//for the 1x1 placeholders of textures which failed to load
+static bool getPackableSize(GLuint texture, GLuint& width, GLuint& height, GLint& format) {
+    GLint w = 0, h = 0, compressed = 0;
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &w);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &h);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+    width = (GLuint)w;
+    height = (GLuint)h;
+    return !compressed && w > 1 && h > 1;
+}
+
+//level 0 of a texture as RGBA8
+static void readPixels(GLuint texture, GLuint width, GLuint height, std::vector<unsigned char>& pixels) {
+    pixels.resize((size_t)width * height * 4);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+}
+
+//copies an image into a page, surrounded by a border which wraps around
+//- x, y: corner of the border in the page
+static void copyPadded(const std::vector<unsigned char>& pixels, GLuint width, GLuint height,
+                       std::vector<unsigned char>& page, int x, int y) {
+    int pad = (int)TextureAtlas::PADDING, w = (int)width, h = (int)height;
+    auto wrap = [](int v, int size) { return (v % size + size) % size; };
+    for (int row = -pad; row < h + pad; row++) {
+        unsigned char* dst = &page[((size_t)(y + pad + row) * TextureAtlas::PAGE_SIZE + x) * 4];
+        const unsigned char* src = &pixels[(size_t)wrap(row, h) * w * 4];
+        for (int col = -pad; col < w + pad; col++, dst += 4)
+            memcpy(dst, src + wrap(col, w) * 4, 4);
+    }
+}
+
+GLuint TextureAtlas::createArray_(GLuint width, GLuint height, GLuint layers, GLint max_level, GLint format) {
+    GLuint array;
+    glGenTextures(1, &array);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, format, width, height, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, max_level);
+    return array;
+}
+
+void TextureAtlas::release_(Group& group) {
+    if (!group.arrays.empty()) glDeleteTextures((GLsizei)group.arrays.size(), group.arrays.data());
+    for (GLuint texture : group.textures) slots_.erase(texture);
+    group.arrays.clear();
+    group.textures.clear();
+}
+
+//one layer per texture. Copied on the GPU when the driver can, in the format of
+//the textures, otherwise read back and uploaded as RGBA8
+void TextureAtlas::buildLayers_(const GroupKey& key, Group& group, GLint max_layers) {
+    GLuint width = std::get<0>(key), height = std::get<1>(key);
+    bool copy = GLEW_VERSION_4_3 || GLEW_ARB_copy_image;
+    std::vector<unsigned char> pixels;
+    const std::vector<GLuint>& list = group.textures;
+    for (size_t first = 0; first < list.size(); first += max_layers) {
+        GLuint layers = (GLuint)std::min(list.size() - first, (size_t)max_layers);
+        GLuint array = createArray_(width, height, layers, 1000, copy ? std::get<2>(key) : GL_RGBA8);
+        group.arrays.push_back(array);
+        for (GLuint l = 0; l < layers; l++) {
+            if (copy) {
+                glCopyImageSubData(list[first + l], GL_TEXTURE_2D, 0, 0, 0, 0,
+                    array, GL_TEXTURE_2D_ARRAY, 0, 0, 0, l, width, height, 1);
+            }
+            else {
+                readPixels(list[first + l], width, height, pixels);
+                glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, l, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+            }
+            AtlasSlot& slot = slots_[list[first + l]];
+            slot.array = array;
+            slot.layer = (int)l;
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    }
+}
+
+void TextureAtlas::buildPages_(const std::vector<SmallTexture>& small, GLint max_layers) {
+    //padded sizes are multiples of the last mip size, so mips never mix two textures
+    const int align = 1 << PAGE_MAX_LEVEL;
+    std::vector<stbrp_rect> remaining(small.size());
+    for (size_t i = 0; i < small.size(); i++) {
+        remaining[i].id = (int)i;
+        remaining[i].w = (stbrp_coord)((small[i].second.first + 2 * PADDING + align - 1) & ~(align - 1));
+        remaining[i].h = (stbrp_coord)((small[i].second.second + 2 * PADDING + align - 1) & ~(align - 1));
+        pages_.textures.push_back(small[i].first);
+    }
+
+    //every rect fits in an empty page, so each page takes at least one
+    std::vector<std::vector<stbrp_rect>> pages;
+    std::vector<stbrp_node> nodes(PAGE_SIZE);
+    while (!remaining.empty() && (GLint)pages.size() < max_layers) {
+        stbrp_context context;
+        stbrp_init_target(&context, PAGE_SIZE, PAGE_SIZE, nodes.data(), (int)nodes.size());
+        stbrp_pack_rects(&context, remaining.data(), (int)remaining.size());
+        pages.emplace_back();
+        std::vector<stbrp_rect> left;
+        for (auto& rect : remaining)
+            (rect.was_packed ? pages.back() : left).push_back(rect);
+        remaining.swap(left);
+    }
+
+    //borders wrap around, so pages are assembled on the CPU
+    GLuint array = createArray_(PAGE_SIZE, PAGE_SIZE, (GLuint)pages.size(), PAGE_MAX_LEVEL, GL_RGBA8);
+    pages_.arrays.push_back(array);
+    std::vector<unsigned char> pixels;
+    std::vector<unsigned char> page((size_t)PAGE_SIZE * PAGE_SIZE * 4);
+    for (size_t p = 0; p < pages.size(); p++) {
+        std::fill(page.begin(), page.end(), 0);
+        for (auto& rect : pages[p]) {
+            GLuint texture = small[rect.id].first;
+            GLuint width = small[rect.id].second.first, height = small[rect.id].second.second;
+            readPixels(texture, width, height, pixels);
+            copyPadded(pixels, width, height, page, rect.x, rect.y);
+            AtlasSlot& slot = slots_[texture];
+            slot.array = array;
+            slot.layer = (int)p;
+            slot.rect = lm::vec4((rect.x + PADDING) / (float)PAGE_SIZE, (rect.y + PADDING) / (float)PAGE_SIZE,
+                width / (float)PAGE_SIZE, height / (float)PAGE_SIZE);
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, (GLint)p, PAGE_SIZE, PAGE_SIZE, 1, GL_RGBA, GL_UNSIGNED_BYTE, page.data());
+    }
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+}
+
+int TextureAtlas::build(const std::vector<GLuint>& textures) {
+    GLint max_layers = 256;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+
+    //group textures by size and format
+    std::vector<GLuint> unique = textures;
+    std::sort(unique.begin(), unique.end());
+    unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+    std::map<GroupKey, std::vector<GLuint>> by_size;
+    for (GLuint texture : unique) {
+        GLuint width, height;
+        GLint format;
+        if (getPackableSize(texture, width, height, format))
+            by_size[GroupKey(width, height, format)].push_back(texture);
+    }
+
+    //same size: one layer each. Single small textures are packed in pages
+    std::map<GroupKey, std::vector<GLuint>> layered;
+    std::vector<SmallTexture> small;
+    std::vector<GLuint> small_textures;
+    for (auto& group : by_size) {
+        GLuint width = std::get<0>(group.first), height = std::get<1>(group.first);
+        if (group.second.size() >= 2 && width <= MAX_LAYER_SIZE && height <= MAX_LAYER_SIZE)
+            layered[group.first] = group.second;
+        else if (group.second.size() == 1 && width <= MAX_PACKED_SIZE && height <= MAX_PACKED_SIZE) {
+            small.push_back({ group.second[0], { width, height } });
+            small_textures.push_back(group.second[0]);
+        }
+    }
+
+    //groups which changed are released before anything is built, so a texture
+    //which moved keeps its new slot
+    for (auto it = groups_.begin(); it != groups_.end();) {
+        auto found = layered.find(it->first);
+        if (found != layered.end() && found->second == it->second.textures) {
+            it++;
+            continue;
+        }
+        release_(it->second);
+        it = groups_.erase(it);
+    }
+    bool pages_changed = small_textures != pages_.textures;
+    if (pages_changed) release_(pages_);
+
+    for (auto& group : layered) {
+        if (groups_.count(group.first)) continue; //unchanged
+        Group& built = groups_[group.first];
+        built.textures = group.second;
+        buildLayers_(group.first, built, max_layers);
+    }
+    if (pages_changed && !small.empty()) buildPages_(small, max_layers);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    return (int)slots_.size();
+}
+
+void TextureAtlas::uploadMaterialData(const std::vector<Material>& materials) {
+    const AtlasSlot none;
+    material_data_.resize(materials.size() * MATERIAL_TEXELS * 4);
+    for (size_t i = 0; i < materials.size(); i++) {
+        const Material& mat = materials[i];
+        const AtlasSlot* diffuse = mat.diffuse_map != -1 ? find(mat.diffuse_map) : nullptr;
+        const AtlasSlot* specular = mat.specular_map != -1 ? find(mat.specular_map) : nullptr;
+        if (!diffuse) diffuse = &none;
+        if (!specular) specular = &none;
+
+        float* data = &material_data_[i * MATERIAL_TEXELS * 4];
+        data[0] = mat.ambient.x; data[1] = mat.ambient.y; data[2] = mat.ambient.z; data[3] = mat.specular_gloss;
+        data[4] = mat.diffuse.x; data[5] = mat.diffuse.y; data[6] = mat.diffuse.z; data[7] = (float)diffuse->layer;
+        data[8] = mat.specular.x; data[9] = mat.specular.y; data[10] = mat.specular.z; data[11] = (float)specular->layer;
+        memcpy(data + 12, diffuse->rect.value_, 4 * sizeof(float));
+        memcpy(data + 16, specular->rect.value_, 4 * sizeof(float));
+    }
+
+    if (!material_buffer_) {
+        glGenBuffers(1, &material_buffer_);
+        glGenTextures(1, &material_texture_);
+    }
+    size_t bytes = material_data_.size() * sizeof(float);
+    glBindBuffer(GL_TEXTURE_BUFFER, material_buffer_);
+    //orphan the old storage so we don't wait for the GPU. Buffer textures can't be empty
+    glBufferData(GL_TEXTURE_BUFFER, std::max(bytes, (size_t)16), nullptr, GL_STREAM_DRAW);
+    if (bytes) glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, material_data_.data());
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    RenderStats::add(RenderStats::UPLOAD_BYTES, bytes);
+
+    glActiveTexture(GL_TEXTURE0 + MATERIAL_DATA_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, material_texture_);
+    RenderStats::add(RenderStats::TEXTURE_BINDS);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, material_buffer_);
+    glActiveTexture(GL_TEXTURE0);
+}
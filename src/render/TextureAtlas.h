@@ -0,0 +1,91 @@
+#pragma once
+#include "../includes.h"
+#include <vector>
+#include <unordered_map>
+#include <map>
+#include <tuple>
+
+// Texture atlas.
+// Packs the textures of materials into 2D texture arrays, so that materials
+// which only differ by their textures share one texture binding, and can be
+// drawn in one bucket (one multi-draw with the multi-draw path):
+// - textures of the same size and format, up to MAX_LAYER_SIZE (at least two
+//   of them), become the layers of an array, and keep repeating with GL_REPEAT.
+//   Bigger ones stay 2D textures, as an array is a second copy of them
+// - other textures up to MAX_PACKED_SIZE are packed with stb_rect_pack into
+//   PAGE_SIZE pages, which are the layers of one more array. Each one has a
+//   border of PADDING texels copied from its opposite side, so repeating uvs
+//   and the first mips do not bleed into neighbours
+// Each packed texture gets a slot: its array, layer, and uv rectangle in the
+// layer. The TEXTURE_ARRAYS variant of phong.frag samples
+// offset + fract(uv) * scale, with the gradients of the unwrapped uv, and reads
+// the slots and colours of its material from a buffer texture (see
+// uploadMaterialData) indexed per draw, instead of from uniforms.
+// Layers are copied on the GPU with glCopyImageSubData where it is available,
+// pages and layers without it are read back from the source textures, so
+// build() must run once they are resident (see TextureStreamer). Only groups
+// whose textures changed are built again. Compressed textures are left alone,
+// as they are already cheap, and the source textures are kept for other users
+// (e.g. the editor and shaders without arrays).
+
+struct Material;
+
+struct AtlasSlot {
+    GLuint array = 0; //GL_TEXTURE_2D_ARRAY
+    int layer = 0;
+    lm::vec4 rect = lm::vec4(0, 0, 1, 1); //uv offset (xy) and scale (zw) in the layer
+};
+
+class TextureAtlas {
+public:
+    static const GLuint PAGE_SIZE = 1024;
+    static const GLuint MAX_PACKED_SIZE = 256;
+    static const GLuint MAX_LAYER_SIZE = 512;
+    static const GLuint PADDING = 4;
+    //mips of packed pages stop where the padding is one texel wide
+    static const GLuint PAGE_MAX_LEVEL = 2;
+
+    //texture unit of the material data
+    static const GLuint MATERIAL_DATA_UNIT = 7;
+    //RGBA32F texels per material in the material data, see uploadMaterialData
+    static const int MATERIAL_TEXELS = 5;
+
+    ~TextureAtlas();
+
+    //packs these 2D textures, building again the arrays of the groups whose
+    //textures changed since the last build. Returns number of textures in arrays
+    int build(const std::vector<GLuint>& textures);
+    void clear();
+
+    //slot of a texture, nullptr if it is not in an array
+    const AtlasSlot* find(GLuint texture) const;
+    size_t getNumArrays() const;
+    size_t getNumTextures() const { return slots_.size(); }
+
+    //uploads colours and slots of all materials and binds them to MATERIAL_DATA_UNIT:
+    //(ambient, gloss), (diffuse, diffuse layer), (specular, specular layer),
+    //diffuse rect, specular rect
+    void uploadMaterialData(const std::vector<Material>& materials);
+
+private:
+    //textures packed together, and the arrays they are in
+    struct Group {
+        std::vector<GLuint> textures;
+        std::vector<GLuint> arrays;
+    };
+    typedef std::tuple<GLuint, GLuint, GLint> GroupKey; //width, height, internal format
+    typedef std::pair<GLuint, std::pair<GLuint, GLuint>> SmallTexture; //texture, size
+
+    std::map<GroupKey, Group> groups_; //same size layers
+    Group pages_; //small textures
+    std::unordered_map<GLuint, AtlasSlot> slots_;
+
+    std::vector<float> material_data_;
+    GLuint material_buffer_ = 0;
+    GLuint material_texture_ = 0;
+
+    GLuint createArray_(GLuint width, GLuint height, GLuint layers, GLint max_level, GLint format);
+    void release_(Group& group);
+    void buildLayers_(const GroupKey& key, Group& group, GLint max_layers);
+    void buildPages_(const std::vector<SmallTexture>& small, GLint max_layers);
+};
@@ -0,0 +1,309 @@
+#include "TextureStreamer.h"
+#include "../Parsers.h"
+#include "../Parallel.h"
+#include "CompressedTexture.h"
+#include "RenderStats.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+struct TextureJob {
+    GLuint texture;
+    std::string filename;
+};
+
+//image decoded by a worker, waiting for upload. Either a TGA, or a cooked
+//compressed file. If decoding failed, the texture keeps its placeholder
+//(the loaders print the error)
+struct DecodedTexture {
+    GLuint texture;
+    TGAInfo info;
+    std::shared_ptr<CompressedImage> compressed;
+    size_t bytes;
+    bool valid() const { return info.data || compressed; }
+    const unsigned char* pixels() const { return compressed ? compressed->data.data() : info.data; }
+    void freePixels() {
+        free(info.data);
+        info.data = nullptr;
+        if (compressed) std::vector<unsigned char>().swap(compressed->data);
+    }
+};
+
+struct StreamRegion {
+    GLsync fence = nullptr;
+};
+
+//worker side, protected by mutex_
+static std::mutex mutex_;
+static std::condition_variable job_added_;
+static std::condition_variable texture_decoded_;
+static std::deque<TextureJob> jobs_;
+static std::deque<DecodedTexture> decoded_;
+static std::unordered_set<GLuint> pending_;
+static std::vector<std::thread> workers_;
+static bool running_ = false;
+
+//GL thread side
+static size_t budget_ = 8 * 1024 * 1024;
+static size_t uploaded_bytes_ = 0;
+static GLuint pbo_ = 0;
+static size_t region_size_ = 0;
+static unsigned char* mapped_ = nullptr; //whole ring, if persistently mapped
+static bool persistent_ = false;
+static StreamRegion regions_[TextureStreamer::NUM_REGIONS];
+static int region_ = 0;
+
+static void workerLoop() {
+    while (true) {
+        TextureJob job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            job_added_.wait(lock, [] { return !jobs_.empty() || !running_; });
+            if (!running_) return;
+            job = jobs_.front();
+            jobs_.pop_front();
+        }
+
+        DecodedTexture decoded = { job.texture, {}, nullptr, 0 };
+        //a cooked file next to the source is used instead of it
+        std::string base = job.filename.substr(0, job.filename.find_last_of('.'));
+        std::shared_ptr<CompressedImage> compressed = std::make_shared<CompressedImage>();
+        if ((loadDDS(base + ".dds", *compressed) || loadKTX(base + ".ktx", *compressed)) &&
+            compressedFormatSupported(compressed->format)) {
+            decoded.compressed = compressed;
+            decoded.bytes = compressed->data.size();
+        }
+        else if (TGAInfo* info = Parsers::loadTGA(job.filename)) {
+            decoded.info = *info;
+            decoded.bytes = (size_t)info->width * info->height * (info->bpp / 8);
+            delete info;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        decoded_.push_back(decoded);
+        texture_decoded_.notify_all();
+    }
+}
+
+//blocks until the GPU has finished with a region
+static void waitFence(StreamRegion& region) {
+    if (!region.fence) return;
+    while (glClientWaitSync(region.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+    glDeleteSync(region.fence);
+    region.fence = nullptr;
+}
+
+static void destroyBuffer() {
+    for (auto& region : regions_) waitFence(region);
+    if (!pbo_) return;
+    if (mapped_) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo_);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &pbo_);
+    pbo_ = 0;
+    mapped_ = nullptr;
+}
+
+//one region holds the budget of one frame
+static void createBuffer() {
+    region_size_ = budget_;
+    size_t total = region_size_ * TextureStreamer::NUM_REGIONS;
+    persistent_ = GLEW_ARB_buffer_storage != 0;
+    glGenBuffers(1, &pbo_);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo_);
+    if (persistent_) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, total, nullptr, flags);
+        mapped_ = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, total, flags);
+    }
+    else {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, total, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+//replaces the placeholder with the decoded image.
+//- pixels: pointer in client memory, or offset in the bound pixel buffer
+static void uploadTexture(const DecodedTexture& decoded, const unsigned char* pixels) {
+    if (decoded.compressed) {
+        //mips are in the file, so there is nothing to generate
+        const CompressedImage& image = *decoded.compressed;
+        glBindTexture(GL_TEXTURE_2D, decoded.texture);
+        for (size_t l = 0; l < image.levels.size(); l++) {
+            const CompressedLevel& level = image.levels[l];
+            glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)l, image.format, level.width, level.height, 0,
+                (GLsizei)level.size, pixels + level.offset);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return;
+    }
+
+    const TGAInfo& info = decoded.info;
+    GLenum internal_format = info.bpp == 24 ? GL_RGB : GL_RGBA;
+    GLenum format = info.bpp == 24 ? GL_BGR : GL_BGRA;
+    GLint bound_pbo = 0;
+    glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &bound_pbo);
+
+    glBindTexture(GL_TEXTURE_2D, decoded.texture);
+    //allocate the new size. Must not read from the pixel buffer
+    if (bound_pbo) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, info.width, info.height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+    if (bound_pbo) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, bound_pbo);
+    //24 bit rows are not 4 byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, info.width, info.height, format, GL_UNSIGNED_BYTE, pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void TextureStreamer::init() {
+    if (running_) return;
+    running_ = true;
+    int num_workers = std::max(1, std::min(workerCount() - 1, 4));
+    for (int i = 0; i < num_workers; i++)
+        workers_.emplace_back(workerLoop);
+}
+
+void TextureStreamer::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+        job_added_.notify_all();
+    }
+    for (auto& worker : workers_) worker.join();
+    workers_.clear();
+    for (auto& decoded : decoded_) decoded.freePixels();
+    decoded_.clear();
+    jobs_.clear();
+    pending_.clear();
+    destroyBuffer();
+}
+
+GLuint TextureStreamer::load(const std::string& filename) {
+    init();
+
+    GLuint texture_id;
+    glGenTextures(1, &texture_id);
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, 4);
+    //white, so it does not tint the material colours while loading
+    const GLubyte white[4] = { 255, 255, 255, 255 };
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_.push_back({ texture_id, filename });
+    pending_.insert(texture_id);
+    job_added_.notify_one();
+    return texture_id;
+}
+
+void TextureStreamer::update() {
+    uploaded_bytes_ = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (decoded_.empty()) return;
+    }
+
+    if (pbo_ && region_size_ != budget_) destroyBuffer();
+    if (!pbo_) createBuffer();
+
+    region_ = (region_ + 1) % NUM_REGIONS;
+    waitFence(regions_[region_]);
+    size_t region_offset = region_ * region_size_;
+    size_t offset = 0;
+    unsigned char* region_data = nullptr;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo_);
+    if (persistent_) region_data = mapped_ + region_offset;
+    else region_data = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, region_offset, region_size_,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+
+    //copy as many images as fit in the region
+    std::vector<DecodedTexture> batch;
+    std::vector<size_t> batch_offsets; //in the pixel buffer
+    std::vector<DecodedTexture> direct;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (!decoded_.empty()) {
+            DecodedTexture& decoded = decoded_.front();
+            if (decoded.valid() && decoded.bytes > region_size_) {
+                //too big for the ring: uploaded alone from client memory
+                if (offset > 0) break;
+                direct.push_back(decoded);
+                pending_.erase(decoded.texture);
+                decoded_.pop_front();
+                break;
+            }
+            if (decoded.valid()) {
+                if (offset + decoded.bytes > region_size_) break;
+                memcpy(region_data + offset, decoded.pixels(), decoded.bytes);
+                decoded.freePixels();
+                batch.push_back(decoded);
+                batch_offsets.push_back(region_offset + offset);
+                offset += (decoded.bytes + 15) & ~(size_t)15;
+            }
+            pending_.erase(decoded.texture);
+            decoded_.pop_front();
+        }
+    }
+
+    if (!persistent_) glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    for (size_t i = 0; i < batch.size(); i++) {
+        uploadTexture(batch[i], (const unsigned char*)batch_offsets[i]);
+        uploaded_bytes_ += batch[i].bytes;
+        RenderStats::add(RenderStats::UPLOAD_BYTES, batch[i].bytes);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (!batch.empty())
+        regions_[region_].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    for (auto& decoded : direct) {
+        uploadTexture(decoded, decoded.pixels());
+        decoded.freePixels();
+        uploaded_bytes_ += decoded.bytes;
+        RenderStats::add(RenderStats::UPLOAD_BYTES, decoded.bytes);
+    }
+}
+
+void TextureStreamer::finish(GLuint texture) {
+    DecodedTexture found = {};
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!pending_.count(texture)) return;
+        auto decoded = decoded_.end();
+        texture_decoded_.wait(lock, [&] {
+            decoded = std::find_if(decoded_.begin(), decoded_.end(), [&](const DecodedTexture& d) { return d.texture == texture; });
+            return decoded != decoded_.end();
+        });
+        found = *decoded;
+        decoded_.erase(decoded);
+        pending_.erase(texture);
+    }
+    if (!found.valid()) return;
+    uploadTexture(found, found.pixels());
+    RenderStats::add(RenderStats::UPLOAD_BYTES, found.bytes);
+    found.freePixels();
+}
+
+void TextureStreamer::setBudget(size_t bytes) { budget_ = std::max(bytes, (size_t)64 * 1024); }
+size_t TextureStreamer::getBudget() { return budget_; }
+size_t TextureStreamer::getUploadedBytes() { return uploaded_bytes_; }
+
+int TextureStreamer::getPending() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return (int)pending_.size();
+}
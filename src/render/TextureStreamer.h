@@ -0,0 +1,46 @@
+#pragma once
+#include "../includes.h"
+
+// Texture streamer.
+// load() creates the texture straight away with a 1x1 white placeholder, and
+// queues the file for worker threads, which read and decode it. Once per frame
+// update() copies decoded images into a ring of pixel buffer objects and
+// uploads them with glTexSubImage2D from the buffer, until a byte budget is
+// used up, so loading many textures spreads over several frames instead of
+// stalling one. The texture id never changes, so materials can use it before
+// the image is resident.
+// The ring is split in regions, one per frame in flight, each protected by a
+// fence. It is persistently mapped if GL_ARB_buffer_storage is available, and
+// mapped every frame otherwise.
+// If a cooked .dds or .ktx file (see tools/TextureCooker) sits next to the
+// source with the same name, and the GPU supports its format, it is loaded
+// instead: the blocks and their precomputed mips are uploaded with
+// glCompressedTexImage2D, which costs 4 to 8 times fewer bytes and no
+// glGenerateMipmap.
+
+namespace TextureStreamer {
+    static const int NUM_REGIONS = 3;
+
+    //starts the workers. Called by the first load() if not called before
+    void init();
+    //stops the workers and frees the buffers. Textures still loading keep
+    //their placeholder
+    void shutdown();
+
+    //returns a texture with a placeholder image and starts loading the file:
+    //a .tga, or a .dds or .ktx holding BC1, BC3 or BC5. For any of them, a
+    //.dds (then .ktx) with the same name is preferred when the GPU supports it
+    GLuint load(const std::string& filename);
+    //uploads decoded images within the budget. Must be called once per frame
+    void update();
+    //blocks until texture is resident (for code which needs its real size)
+    void finish(GLuint texture);
+
+    //max bytes uploaded per frame. An image bigger than the budget is uploaded
+    //alone, from client memory
+    void setBudget(size_t bytes);
+    size_t getBudget();
+    //textures queued or decoded, but not uploaded yet
+    int getPending();
+    size_t getUploadedBytes(); //during last update
+}
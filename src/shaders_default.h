@@ -69,6 +69,59 @@ static const char* g_shader_line_fragment =
 "    fragColor = v_color;\n"
 "}\n";
 
+//**** Debug draw shader (world space lines with per vertex color) **** //
+
+static const char* g_shader_debug_draw_vertex =
+"#version 330\n"
+"layout(location = 0) in vec3 a_vertex; \n"
+"layout(location = 1) in vec4 a_color; \n"
+"uniform mat4 u_vp;\n"
+"out vec4 v_color;\n"
+"void main() {\n"
+"    gl_Position = u_vp * vec4(a_vertex, 1); \n"
+"    v_color = a_color;\n"
+"}\n";
+
+static const char* g_shader_debug_draw_fragment =
+"#version 330\n"
+"in vec4 v_color;\n"
+"layout(location = 0) out vec4 fragColor;\n"
+"void main() {\n"
+"    fragColor = v_color;\n"
+"}\n";
+
+//**** Depth pre-pass (positions transformed exactly as phong.vert does, so depths are equal) **** //
+//uses g_shader_depth_fragment
+
+static const char* g_shader_depth_prepass_vertex =
+"#version 330\n"
+"layout(location = 0) in vec3 a_vertex; \n"
+"uniform mat4 u_mvp;\n"
+"invariant gl_Position;\n"
+"void main() {\n"
+"    gl_Position = u_mvp * vec4(a_vertex, 1.0); \n"
+"}\n";
+
+//multi-draw version, reads the model from IndirectDrawBuffer like the INSTANCING variant of phong.vert
+static const char* g_shader_depth_prepass_multi_draw_vertex =
+"#version 430 core\n"
+"layout(location = 0) in vec3 a_vertex; \n"
+"layout(location = 3) in uint a_draw_id; \n"
+"struct PerDraw {\n"
+"    mat4 model;\n"
+"    vec4 normal_matrix[3];\n"
+"    uint material;\n"
+"};\n"
+"layout(std430) buffer PerDrawBuffer {\n"
+"    PerDraw draws[];\n"
+"};\n"
+"uniform mat4 u_vp;\n"
+"invariant gl_Position;\n"
+"void main() {\n"
+"    vec3 world_pos = (draws[a_draw_id].model * vec4(a_vertex, 1.0)).xyz;\n"
+"    gl_Position = u_vp * vec4(world_pos, 1.0); \n"
+"}\n";
+
 //**** Icon Shader (draw textured mesh in MVP coordinates **** //
 
 static const char* g_shader_icon_vertex =
@@ -92,26 +145,54 @@ static const char* g_shader_icon_fragment =
 "}\n";
 
 //font shader
+//glyph quads of all texts using a font, in pixels (see GlyphCache)
 static const char* g_shader_font_vertex =
 "#version 330\n"
-"layout(location = 0) in vec3 a_vertex;\n"
+"layout(location = 0) in vec2 a_vertex;\n"
 "layout(location = 1) in vec2 a_uv;\n"
+"layout(location = 2) in vec3 a_color;\n"
 "uniform mat4 u_mvp;\n"
 "out vec2 v_uv;\n"
+"out vec3 v_color;\n"
 "void main() {\n"
-"	gl_Position = u_mvp * vec4(a_vertex, 1);\n"
+"	gl_Position = u_mvp * vec4(a_vertex, 1, 1);\n"
 "	v_uv = a_uv;\n"
+"	v_color = a_color;\n"
 "}\n";
 
 static const char* g_shader_font_fragment =
 "#version 330\n"
 "in vec2 v_uv;\n"
+"in vec3 v_color;\n"
 "out vec4 fragColor;\n"
 "uniform sampler2D u_icon;\n"
-"uniform vec3 u_color;\n"
 "void main() {\n"
 "	float final_color = texture(u_icon, v_uv).r;\n"
-"	fragColor = vec4(u_color, final_color);\n"
+"	fragColor = vec4(v_color, final_color);\n"
+"}\n";
+
+//GUI images, batched with the font vertex shader
+static const char* g_shader_sprite_fragment =
+"#version 330\n"
+"in vec2 v_uv;\n"
+"in vec3 v_color;\n"
+"out vec4 fragColor;\n"
+"uniform sampler2D u_icon;\n"
+"void main() {\n"
+"	fragColor = texture(u_icon, v_uv) * vec4(v_color, 1.0);\n"
+"}\n";
+
+//signed distance field glyphs: 0.5 on the outline, edge smoothed over a screen pixel
+static const char* g_shader_font_sdf_fragment =
+"#version 330\n"
+"in vec2 v_uv;\n"
+"in vec3 v_color;\n"
+"out vec4 fragColor;\n"
+"uniform sampler2D u_icon;\n"
+"void main() {\n"
+"	float distance = texture(u_icon, v_uv).r;\n"
+"	float width = max(fwidth(distance) * 0.7, 0.001);\n"
+"	fragColor = vec4(v_color, smoothstep(0.5 - width, 0.5 + width, distance));\n"
 "}\n";
 
 //environment shader
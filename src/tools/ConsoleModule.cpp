@@ -7,6 +7,10 @@
 #include <sstream>
 
 #include "../Game.h"
+#include "../render/TextureStreamer.h"
+#include "../render/RenderStats.h"
+#include "EditorIdle.h"
+#include "TextureCooker.h"
 
 #define dmin(a,b)            (((a) < (b)) ? (a) : (b))
 #define dmax(a,b)            (((a) > (b)) ? (a) : (b))
@@ -65,6 +69,16 @@ void ConsoleModule::init()
 	commands_.push_back("colorbackground");
 	commands_.push_back("debug");
 	commands_.push_back("changecamera");
+	commands_.push_back("nullrender");
+	commands_.push_back("multidraw");
+	commands_.push_back("occlusion");
+	commands_.push_back("texturebudget");
+	commands_.push_back("cooktextures");
+	commands_.push_back("resolution");
+	commands_.push_back("framegraph");
+	commands_.push_back("renderstats");
+	commands_.push_back("depthprepass");
+	commands_.push_back("idle");
     ConsoleWrite(true, "Console Initialized!");
 }
 
@@ -320,6 +334,152 @@ void ConsoleModule::BuildCommand(const char* cmd)
 		com_found = true;
 	}
 
+	if (input.find("nullrender") != std::string::npos)
+	{
+		GraphicsSystem& graphics = Game::get().game_instance->getGraphicsSystem();
+		float state = v.size() > 1 ? atof(v[1].c_str()) : -1;
+		if (state == 1) {
+			graphics.setNullBackend(true);
+			ConsoleWrite(false, "Null render backend: scene is traversed but not drawn.");
+		} else if (state == 0) {
+			graphics.setNullBackend(false);
+		} else {
+			ConsoleWrite(false, "Invalid Parameter: can only be 0(off) or 1(on).");
+		}
+		com_found = true;
+	}
+
+	if (input.find("multidraw") != std::string::npos)
+	{
+		GraphicsSystem& graphics = Game::get().game_instance->getGraphicsSystem();
+		float state = v.size() > 1 ? atof(v[1].c_str()) : -1;
+		if (state == 1) {
+			if (!graphics.setMultiDraw(true))
+				ConsoleWrite(false, "Multi-draw indirect is not supported by this driver.");
+		} else if (state == 0) {
+			graphics.setMultiDraw(false);
+		} else {
+			ConsoleWrite(false, "Invalid Parameter: can only be 0(off) or 1(on).");
+		}
+		com_found = true;
+	}
+
+	if (input.find("occlusion") != std::string::npos)
+	{
+		GraphicsSystem& graphics = Game::get().game_instance->getGraphicsSystem();
+		float state = v.size() > 1 ? atof(v[1].c_str()) : -1;
+		if (state == 1 || state == 0) {
+			graphics.occlusion_culling = state == 1;
+		} else {
+			ConsoleWrite(false, "Invalid Parameter: can only be 0(off) or 1(on).");
+		}
+		com_found = true;
+	}
+
+	if (input.find("texturebudget") != std::string::npos)
+	{
+		//max megabytes of texture data uploaded per frame
+		float megabytes = v.size() > 1 ? (float)atof(v[1].c_str()) : 0;
+		if (megabytes > 0) {
+			TextureStreamer::setBudget((size_t)(megabytes * 1024 * 1024));
+		} else {
+			ConsoleWrite(false, "Texture budget: %.1f MB per frame, %d textures loading.",
+				TextureStreamer::getBudget() / (1024.0f * 1024.0f), TextureStreamer::getPending());
+		}
+		com_found = true;
+	}
+
+	if (input.find("cooktextures") != std::string::npos)
+	{
+		//compresses the TGA files of a directory to .dds, used on next load
+		std::string directory = v.size() > 1 ? v[1] : "data/assets";
+		std::string name = v.size() > 2 ? v[2] : "auto";
+		CookFormat format = COOK_AUTO;
+		if (name == "bc1") format = COOK_BC1;
+		else if (name == "bc3") format = COOK_BC3;
+		else if (name == "bc5") format = COOK_BC5;
+		else if (name != "auto") ConsoleWrite(false, "Invalid Parameter: format can only be bc1, bc3, bc5 or auto.");
+		int cooked = TextureCooker::cookDirectory(directory, format);
+		ConsoleWrite(false, "Cooked %d textures in %s.", cooked, directory.c_str());
+		com_found = true;
+	}
+
+	if (input.find("resolution") != std::string::npos)
+	{
+		//'resolution 0.75' renders at a fixed scale, 'resolution auto 16.6' picks it from a frame time target
+		DynamicResolution& resolution = Game::get().game_instance->getGraphicsSystem().getDynamicResolution();
+		if (v.size() > 1 && v[1] == "auto") {
+			resolution.enabled = true;
+			if (v.size() > 2) resolution.target_ms = (float)atof(v[2].c_str());
+		} else if (v.size() > 1 && atof(v[1].c_str()) > 0) {
+			resolution.SetScale((float)atof(v[1].c_str()));
+		}
+		ConsoleWrite(false, "Resolution scale: %.2f (%s, frame %.1f ms, target %.1f ms).", resolution.GetScale(),
+			resolution.enabled ? "auto" : "fixed", resolution.GetAverageMs(), resolution.target_ms);
+		com_found = true;
+	}
+
+	if (input.find("framegraph") != std::string::npos)
+	{
+		//passes, resources and target slots of the last frame
+		std::stringstream dump;
+		Game::get().game_instance->getGraphicsSystem().getFrameGraph().dump(dump);
+		std::string line;
+		while (std::getline(dump, line))
+			ConsoleWrite(false, "%s", line.c_str());
+		com_found = true;
+	}
+
+	if (input.find("depthprepass") != std::string::npos)
+	{
+		//'depthprepass 0|1|auto [camera]' sets the mode of a camera, the main one by default
+		GraphicsSystem& graphics = Game::get().game_instance->getGraphicsSystem();
+		auto& cameras = ECS.getAllComponents<Camera>();
+		int camera = v.size() > 2 ? atoi(v[2].c_str()) : ECS.main_camera;
+		if (camera < 0 || camera >= (int)cameras.size()) {
+			ConsoleWrite(false, "Invalid Parameter: there are %d cameras.", (int)cameras.size());
+		} else {
+			DepthPrepassMode& mode = cameras[camera].depth_prepass;
+			if (v.size() > 1 && v[1] == "auto") mode = DepthPrepassAuto;
+			else if (v.size() > 1 && v[1] == "1") mode = DepthPrepassOn;
+			else if (v.size() > 1 && v[1] == "0") mode = DepthPrepassOff;
+			else if (v.size() > 1) ConsoleWrite(false, "Invalid Parameter: can only be 0(off), 1(on) or auto.");
+			const char* names[] = { "off", "on", "auto" };
+			ConsoleWrite(false, "Depth pre-pass of camera %d: %s (overdraw %.2f, auto above %.2f).", camera,
+				names[mode], graphics.getOverdraw(), graphics.depth_prepass_overdraw);
+		}
+		com_found = true;
+	}
+
+	if (input.find("idle") != std::string::npos)
+	{
+		//'idle 1' only redraws the editor scene when it changes, and slows the loop down without input
+		float state = v.size() > 1 ? atof(v[1].c_str()) : -1;
+		if (state == 1 || state == 0) EditorIdle::setEnabled(state == 1);
+		else if (v.size() > 1) ConsoleWrite(false, "Invalid Parameter: can only be 0(off) or 1(on).");
+		ConsoleWrite(false, "Editor idle mode: %s (%d scene frames skipped).",
+			EditorIdle::isEnabled() ? "on" : "off", EditorIdle::getSkippedFrames());
+		com_found = true;
+	}
+
+	if (input.find("renderstats") != std::string::npos)
+	{
+		//'renderstats dump file.csv' appends every frame to the file, 'renderstats stop' closes it
+		if (v.size() > 2 && v[1] == "dump") {
+			if (RenderStats::startDump(v[2])) ConsoleWrite(false, "Dumping render stats to %s.", v[2].c_str());
+			else ConsoleWrite(false, "Could not open %s.", v[2].c_str());
+		} else if (v.size() > 1 && v[1] == "stop") {
+			RenderStats::stopDump();
+			ConsoleWrite(false, "Render stats dump stopped.");
+		} else {
+			for (auto& pass : RenderStats::getPasses())
+				ConsoleWrite(false, "%s: %lld draws, %lld triangles, %lld visible, %lld culled", pass.name.c_str(),
+					(long long)pass[RenderStats::DRAW_CALLS], (long long)pass[RenderStats::TRIANGLES], (long long)pass[RenderStats::VISIBLE],
+					(long long)(pass[RenderStats::FRUSTUM_CULLED] + pass[RenderStats::OCCLUSION_CULLED]));
+		}
+		com_found = true;
+	}
+
 	if (!com_found) {
         ConsoleWrite(false, "Unknown command: '%s'\n", cmd);
     }
@@ -0,0 +1,91 @@
+#include "EditorIdle.h"
+#include "../GraphicsSystem.h"
+#include "../extern.h"
+#include "../render/TextureStreamer.h"
+
+static bool enabled_ = true;
+static bool dirty_ = true; //scene must be rendered
+static uint64_t scene_hash_ = 0;
+static double last_activity_ = 0.0; //time of the last input or change
+static int skipped_frames_ = 0;
+
+//FNV-1a, over the bytes of the state
+static void hashBytes(uint64_t& hash, const void* data, size_t size) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+}
+
+static uint64_t hashScene(GraphicsSystem& graphics, int width, int height) {
+    uint64_t hash = 14695981039346656037ULL;
+    hashBytes(hash, &width, sizeof(width));
+    hashBytes(hash, &height, sizeof(height));
+    hashBytes(hash, &ECS.main_camera, sizeof(ECS.main_camera));
+    lm::vec3 clear_color = graphics.getClearColor();
+    hashBytes(hash, clear_color.value_, sizeof(clear_color.value_));
+    //view matrices are only updated when the scene is rendered, so hash what they come from
+    for (auto& cam : ECS.getAllComponents<Camera>()) {
+        hashBytes(hash, cam.position.value_, sizeof(cam.position.value_));
+        hashBytes(hash, cam.forward.value_, sizeof(cam.forward.value_));
+        hashBytes(hash, cam.up.value_, sizeof(cam.up.value_));
+        hashBytes(hash, cam.projection_matrix.m, sizeof(cam.projection_matrix.m));
+    }
+    for (auto& transform : ECS.getAllComponents<Transform>()) {
+        hashBytes(hash, transform.m, sizeof(transform.m));
+        hashBytes(hash, &transform.parent, sizeof(transform.parent));
+    }
+    for (auto& mesh : ECS.getAllComponents<Mesh>()) {
+        hashBytes(hash, &mesh.geometry, sizeof(mesh.geometry));
+        hashBytes(hash, &mesh.material, sizeof(mesh.material));
+    }
+    for (auto& light : ECS.getAllComponents<Light>()) {
+        hashBytes(hash, light.color.value_, sizeof(light.color.value_));
+        hashBytes(hash, &light.radius, sizeof(light.radius));
+    }
+    for (int i = 0; i < graphics.getNumMaterials(); i++) {
+        uint64_t material = graphics.getMaterial(i).hashParameters();
+        hashBytes(hash, &material, sizeof(material));
+    }
+    return hash;
+}
+
+void EditorIdle::setEnabled(bool enabled) {
+    enabled_ = enabled;
+    dirty_ = true;
+    skipped_frames_ = 0;
+}
+
+bool EditorIdle::isEnabled() {
+    return enabled_;
+}
+
+void EditorIdle::onInput(bool redraw_scene) {
+    last_activity_ = glfwGetTime();
+    if (redraw_scene) dirty_ = true;
+}
+
+void EditorIdle::invalidate() {
+    dirty_ = true;
+}
+
+bool EditorIdle::updateScene(GraphicsSystem& graphics, int width, int height) {
+    uint64_t hash = hashScene(graphics, width, height);
+    bool render = dirty_ || hash != scene_hash_ || TextureStreamer::getPending() > 0;
+    scene_hash_ = hash;
+    dirty_ = false;
+    if (render) last_activity_ = glfwGetTime();
+    else skipped_frames_++;
+    return render;
+}
+
+double EditorIdle::getWaitTime() {
+    if (!enabled_ || dirty_) return 0.0;
+    double idle_time = glfwGetTime() - last_activity_;
+    return idle_time < ACTIVE_TIME ? 0.0 : MAX_WAIT;
+}
+
+int EditorIdle::getSkippedFrames() {
+    return skipped_frames_;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "../includes.h"
+
+class GraphicsSystem;
+
+// Editor idle mode.
+// Keeps the editor from redrawing the scene, and the main loop from spinning,
+// while nothing happens. Each frame the state the scene view shows (cameras,
+// transforms, meshes, materials, lights, view size) is hashed, and the scene
+// is only rendered again, into a target kept between frames, when the hash
+// changes, textures are streaming in, or a key or mouse button was pressed.
+// Once nothing has happened for ACTIVE_TIME, the main loop waits for events
+// for up to MAX_WAIT instead of polling, so ImGui redraws a few times per
+// second; scripts still run every frame, so an animated scene never idles.
+// Toggled with the 'idle' console command.
+namespace EditorIdle {
+    static const double MAX_WAIT = 0.25; //seconds between frames without input
+    static const double ACTIVE_TIME = 0.5; //seconds at full rate after input or a change
+
+    void setEnabled(bool enabled);
+    bool isEnabled();
+
+    //from the window callbacks. Mouse motion and typing only redraw ImGui,
+    //keys and buttons may change anything, so they also redraw the scene
+    void onInput(bool redraw_scene);
+    //the scene must be rendered next frame, e.g. after a resize
+    void invalidate();
+
+    //once per frame, with the size the scene is rendered at. Returns true if
+    //the scene must be rendered
+    bool updateScene(GraphicsSystem& graphics, int width, int height);
+    //seconds the main loop may wait for events, 0 to poll
+    double getWaitTime();
+    //scene renders skipped since the mode was enabled
+    int getSkippedFrames();
+}
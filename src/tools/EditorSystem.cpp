@@ -4,6 +4,8 @@
 #include "../render/RenderToTexture.h"
 #include "EditorGraphModule.h"
 #include "ConsoleModule.h"
+#include "ProfilerModule.h"
+#include "Profiler.h"
 #include "EditorUtils.h"
 #include "../rapidjson/stringbuffer.h"
 #include "../rapidjson/writer.h"
@@ -33,6 +35,7 @@ void EditorSystem::Init()
     is_saving_scene = false;
     graph_module_ = new EditorGraphModule();
     console_module_ = new ConsoleModule();
+    profiler_module_ = new ProfilerModule();
 
     SetStyles();
     node_project_ = ProcessDirectoryOredered("assets");
@@ -93,6 +96,7 @@ void EditorSystem::update(float dt)
             UpdateInspector(dt);
             UpdateProject(dt);
             UpdateConsole(dt);
+            UpdateProfiler(dt);
             UpdateComponentMenu(dt);
         }
         ImGui::End();
@@ -182,11 +186,16 @@ void EditorSystem::UpdateRender(float dt)
 {
     ImGui::Begin("Render", &is_editor_mode);
     {
-        ImVec2 pos = ImGui::GetWindowPos();
-        ImGui::GetWindowDrawList()->AddImage(
-            (void *)(Game::get().main_buffer)->GetColorBuffer(), ImVec2(ImGui::GetCursorScreenPos()),
-            ImGui::GetWindowSize(), ImVec2(0, 1), ImVec2(1, 0));
-        render_size = lm::vec2(ImGui::GetWindowSize().x, ImGui::GetWindowSize().y);
+        ImVec2 pos = ImGui::GetCursorScreenPos();
+        ImVec2 size = ImGui::GetContentRegionAvail();
+        RenderToTexture* target = Game::get().main_buffer;
+        if (target) {
+            ImGui::GetWindowDrawList()->AddImage(
+                (void *)(intptr_t)target->GetColorBuffer(), pos,
+                ImVec2(pos.x + size.x, pos.y + size.y), ImVec2(0, 1), ImVec2(1, 0));
+        }
+        render_pos = lm::vec2(pos.x, pos.y);
+        render_size = lm::vec2(size.x, size.y);
 
         if (ImGui::IsWindowFocused()) {
             is_render_active = true;
@@ -367,7 +376,17 @@ void EditorSystem::UpdateConsole(float dt)
     ImGui::End();
 }
 
-// Used to draw current fps on screen
+// Frame time graph, zone breakdown and render counters
+void EditorSystem::UpdateProfiler(float dt)
+{
+    ImGui::Begin("Profiler", &is_editor_mode);
+    {
+        profiler_module_->update(dt);
+    }
+    ImGui::End();
+}
+
+// Used to draw current fps and frame time on screen
 void EditorSystem::UpdateFPS(float dt)
 {
     {
@@ -385,8 +404,8 @@ void EditorSystem::UpdateFPS(float dt)
             ImGuiWindowFlags_::ImGuiWindowFlags_NoResize |
             ImGuiWindowFlags_::ImGuiWindowFlags_NoTitleBar);
         {
-            ImGui::SetCursorPos(ImVec2(Game::get().getWidth() - Game::get().getWidth() * 0.05f, Game::get().getHeight() * 0.01f));
-            ImGui::Text("FPS %d", (int)Game::get().fps);
+            ImGui::SetCursorPos(ImVec2(Game::get().getWidth() - Game::get().getWidth() * 0.1f, Game::get().getHeight() * 0.01f));
+            ImGui::Text("FPS %d %.1f ms", (int)Game::get().fps, Profiler::getAverageFrameMs());
         }
 
         ImGui::End();
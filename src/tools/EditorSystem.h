@@ -15,11 +15,15 @@ struct TransformNode {
 class NodeFile;
 class ConsoleModule;
 class EditorGraphModule;
+class ProfilerModule;
 
 // This class holds the user interface and other related methods
 class EditorSystem {
 public:
 
+    //screen position and size of the scene in the render window. The scene is
+    //rendered at this size (see Game::render_)
+    lm::vec2 render_pos;
     lm::vec2 render_size;
     static EditorSystem* editor_instance;
 
@@ -69,6 +73,7 @@ private:
     void UpdateProject(float dt);
     void UpdateConsole(float dt);
     void UpdateFPS(float dt);
+    void UpdateProfiler(float dt);
     
     void UpdateComponentMenu(float dt);
     void AddComponentSelected(int id, int entity_id);
@@ -80,5 +85,6 @@ private:
 
     ConsoleModule * console_module_;
     EditorGraphModule * graph_module_;
+    ProfilerModule * profiler_module_;
 };
 
@@ -0,0 +1,261 @@
+#include "Headless.h"
+#include "Profiler.h"
+#include "../render/RenderStats.h"
+#include "../render/RenderCommandBuffer.h"
+#include "../Game.h"
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+static void printUsage() {
+    std::cerr << "usage: [--headless] [--frames N] [--dt seconds] [--null-render] [--check-traversal]"
+                 " [--capture out.ppm] [--golden reference.ppm] [--tolerance 0-255] [--stats out.csv]" << std::endl;
+}
+
+bool Headless::parseArgs(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (!strcmp(arg, "--headless")) options.enabled = true;
+        else if (!strcmp(arg, "--null-render")) options.null_render = true;
+        else if (!strcmp(arg, "--check-traversal")) options.check_traversal = true;
+        else if (!strcmp(arg, "--frames") && has_value) options.frames = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(arg, "--dt") && has_value) options.dt = (float)atof(argv[++i]);
+        else if (!strcmp(arg, "--capture") && has_value) options.capture = argv[++i];
+        else if (!strcmp(arg, "--golden") && has_value) options.golden = argv[++i];
+        else if (!strcmp(arg, "--tolerance") && has_value) options.tolerance = atoi(argv[++i]);
+        else if (!strcmp(arg, "--stats") && has_value) options.stats = argv[++i];
+        else {
+            std::cerr << "ERROR: Unknown argument " << arg << std::endl;
+            printUsage();
+            return false;
+        }
+    }
+    return true;
+}
+
+void Headless::readFramebuffer(int width, int height, std::vector<unsigned char>& pixels) {
+    std::vector<unsigned char> rows(width * height * 3);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glReadBuffer(GL_BACK);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, rows.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    //GL rows start at the bottom
+    pixels.resize(rows.size());
+    size_t row_size = width * 3;
+    for (int y = 0; y < height; y++)
+        memcpy(&pixels[y * row_size], &rows[(height - 1 - y) * row_size], row_size);
+}
+
+bool Headless::writePPM(const std::string& path, int width, int height, const std::vector<unsigned char>& pixels) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) return false;
+    file << "P6\n" << width << " " << height << "\n255\n";
+    file.write((const char*)pixels.data(), pixels.size());
+    return (bool)file;
+}
+
+bool Headless::readPPM(const std::string& path, int& width, int& height, std::vector<unsigned char>& pixels) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    std::string magic;
+    int max_value = 0;
+    file >> magic >> width >> height >> max_value;
+    if (magic != "P6" || width <= 0 || height <= 0 || max_value != 255) return false;
+    file.get(); //single whitespace before the data
+    pixels.resize(width * height * 3);
+    file.read((char*)pixels.data(), pixels.size());
+    return (bool)file;
+}
+
+float Headless::compareImages(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b, int tolerance) {
+    if (a.size() != b.size() || a.empty()) return 1.0f;
+    size_t different = 0;
+    for (size_t i = 0; i < a.size(); i += 3) {
+        for (int c = 0; c < 3; c++) {
+            if (abs((int)a[i + c] - (int)b[i + c]) > tolerance) {
+                different++;
+                break;
+            }
+        }
+    }
+    return (float)different / (a.size() / 3);
+}
+
+int Headless::checkTraversal() {
+    //draws spread over the queues of 4 workers, as parallelFor batches would leave them.
+    //Every geometry is drawn once, so draws can be matched back to their items
+    const int num_queues = 4, num_draws = 200;
+    std::vector<RenderQueue> queues(num_queues);
+    std::vector<DrawItem> expected;
+    unsigned int seed = 12345;
+    auto next = [&](int range) { seed = seed * 1103515245u + 12345u; return (int)((seed >> 16) % range); };
+    for (int i = 0; i < num_draws; i++) {
+        int pipeline = 1 + next(3), material = next(6);
+        DrawItem& item = queues[i * num_queues / num_draws].push(pipeline, material, i, next(3), (uint32_t)next(2));
+        item.constants.material = material;
+        expected.push_back(item);
+    }
+    for (auto& queue : queues) queue.sort();
+    std::stable_sort(expected.begin(), expected.end(), [](const DrawItem& a, const DrawItem& b) {
+        return a.sort_key < b.sort_key;
+    });
+
+    RenderCommandBuffer buffer;
+    buffer.merge(queues);
+    NullRenderBackend backend;
+    backend.execute(buffer);
+
+    //replay the recorded commands and compare with the sorted items
+    int errors = 0, draw = 0, expected_pipelines = 0, expected_materials = 0;
+    int pipeline = -1, material = -1, constants = -1;
+    for (auto& item : expected) {
+        if (item.pipeline != pipeline) { expected_pipelines++; material = -1; }
+        if (item.material != material) expected_materials++;
+        pipeline = item.pipeline;
+        material = item.material;
+    }
+    pipeline = material = -1;
+    for (auto& cmd : backend.recorded) {
+        switch (cmd.type) {
+        case RenderCommandSetPipeline: pipeline = cmd.arg; material = -1; break;
+        case RenderCommandBindMaterial: material = cmd.arg; break;
+        case RenderCommandSetConstants: constants = cmd.arg; break;
+        case RenderCommandDraw: {
+            if (draw == num_draws) { errors++; break; }
+            const DrawItem& item = expected[draw++];
+            if (cmd.arg != item.geometry || cmd.lod != item.lod || pipeline != item.pipeline || material != item.material ||
+                constants < 0 || backend.recorded_constants[constants].material != item.material) {
+                std::cerr << "ERROR: Draw " << draw - 1 << " is geometry " << cmd.arg << ", expected " << item.geometry << std::endl;
+                errors++;
+            }
+            constants = -1; //every draw sets its own constants
+            break;
+        }
+        }
+    }
+    const RenderBackendStats& stats = backend.stats;
+    if (draw != num_draws || stats.draw_calls != num_draws) {
+        std::cerr << "ERROR: " << stats.draw_calls << " draws, expected " << num_draws << std::endl;
+        errors++;
+    }
+    if (stats.pipeline_changes != expected_pipelines || stats.material_changes != expected_materials) {
+        std::cerr << "ERROR: " << stats.pipeline_changes << " pipeline and " << stats.material_changes << " material changes, expected "
+                  << expected_pipelines << " and " << expected_materials << std::endl;
+        errors++;
+    }
+    std::cout << "Traversal check: " << num_queues << " queues, " << stats.commands << " commands, " << stats.draw_calls << " draws, "
+              << stats.pipeline_changes << " pipeline changes, " << stats.material_changes << " material changes" << std::endl;
+    if (errors) {
+        backend.dump(std::cerr);
+        return 1;
+    }
+    return 0;
+}
+
+int Headless::run(Game& game, GLFWwindow* window, const Options& options) {
+    int width = game.getWidth(), height = game.getHeight();
+    std::vector<unsigned char> pixels;
+    std::vector<float> frame_ms;
+    frame_ms.reserve(options.frames);
+    if (!options.stats.empty() && !RenderStats::startDump(options.stats)) {
+        std::cerr << "ERROR: Could not write " << options.stats << std::endl;
+        return 1;
+    }
+
+    //textures stream in asynchronously, so the run starts, and the captured frame
+    //is drawn, once they are all resident and the atlas is built. Frames run
+    //meanwhile use a zero time step, so the captured frame is always at the
+    //same time, and are not timed
+    bool capture = !options.null_render && (!options.capture.empty() || !options.golden.empty());
+    int settle_frames = 0;
+    auto settle = [&]() {
+        while (game.getGraphicsSystem().isLoading()) {
+            if (settle_frames == MAX_SETTLE_FRAMES) return false;
+            glfwPollEvents();
+            game.update(0.0f);
+            glfwSwapBuffers(window);
+            settle_frames++;
+        }
+        return true;
+    };
+    bool settled = settle();
+
+    double start_time = glfwGetTime();
+    for (int frame = 0; frame < options.frames && settled; frame++) {
+        bool last = frame == options.frames - 1;
+        if (last && capture) {
+            double settle_start = glfwGetTime();
+            settled = settle();
+            start_time += glfwGetTime() - settle_start;
+            if (!settled) break;
+        }
+
+        double frame_start = glfwGetTime();
+        glfwPollEvents();
+        game.update(options.dt);
+        //the back buffer is undefined after swapping
+        if (last && !options.null_render)
+            readFramebuffer(width, height, pixels);
+        glfwSwapBuffers(window);
+        frame_ms.push_back((float)((glfwGetTime() - frame_start) * 1000.0));
+    }
+    glFinish();
+    double total = glfwGetTime() - start_time;
+    RenderStats::stopDump();
+    if (!settled) {
+        std::cerr << "ERROR: Textures still loading after " << MAX_SETTLE_FRAMES << " extra frames" << std::endl;
+        return 1;
+    }
+    if (settle_frames) std::cout << "Headless: " << settle_frames << " extra frames until textures were loaded" << std::endl;
+
+    std::sort(frame_ms.begin(), frame_ms.end());
+    const RenderBackendStats& stats = game.getGraphicsSystem().getBackend().stats;
+    std::cout << "Headless: " << options.frames << " frames in " << total << " s" << std::endl;
+    std::cout << "  frame ms: average " << total * 1000.0 / options.frames
+              << ", median " << frame_ms[frame_ms.size() / 2]
+              << ", min " << frame_ms.front() << ", max " << frame_ms.back() << std::endl;
+    std::cout << "  1% low " << Profiler::getLowFps(0.01f) << " fps, 0.1% low " << Profiler::getLowFps(0.001f) << " fps" << std::endl;
+    std::cout << "  last frame: " << stats.draw_calls << " draws, " << stats.pipeline_changes << " pipeline changes, "
+              << stats.material_changes << " material changes" << std::endl;
+    const RenderStats::PassStats& totals = RenderStats::getTotals();
+    std::cout << "  last frame: " << totals[RenderStats::TRIANGLES] << " triangles, " << totals[RenderStats::VISIBLE] << " visible, "
+              << totals[RenderStats::FRUSTUM_CULLED] + totals[RenderStats::OCCLUSION_CULLED] << " culled, "
+              << totals[RenderStats::UPLOAD_BYTES] << " bytes uploaded" << std::endl;
+    if (!options.stats.empty()) std::cout << "  render stats in " << options.stats << std::endl;
+
+    if (options.null_render) {
+        if (!options.capture.empty() || !options.golden.empty())
+            std::cerr << "WARNING: Nothing is drawn with --null-render, no capture" << std::endl;
+        return 0;
+    }
+    if (!options.capture.empty()) {
+        if (!writePPM(options.capture, width, height, pixels)) {
+            std::cerr << "ERROR: Could not write " << options.capture << std::endl;
+            return 1;
+        }
+        std::cout << "  captured " << options.capture << std::endl;
+    }
+    if (!options.golden.empty()) {
+        int golden_width = 0, golden_height = 0;
+        std::vector<unsigned char> golden;
+        if (!readPPM(options.golden, golden_width, golden_height, golden)) {
+            std::cerr << "ERROR: Could not read golden image " << options.golden << std::endl;
+            return 1;
+        }
+        if (golden_width != width || golden_height != height) {
+            std::cerr << "ERROR: Golden image is " << golden_width << "x" << golden_height
+                      << ", frame is " << width << "x" << height << std::endl;
+            return 1;
+        }
+        float different = compareImages(pixels, golden, options.tolerance);
+        std::cout << "  golden " << options.golden << ": " << different * 100.0f << "% pixels differ" << std::endl;
+        if (different > options.max_different) {
+            std::cerr << "ERROR: Frame does not match golden image" << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "../includes.h"
+#include <string>
+#include <vector>
+
+class Game;
+
+// Headless runs, for benchmarks and image regressions on build machines.
+// The window is hidden and the game runs a fixed number of frames with a
+// fixed time step, without the editor, then timings are printed. The last
+// frame can be saved as a PPM and compared with a golden image; the exit code
+// is non-zero if too many pixels differ. Extra frames run before the captured
+// one until streamed textures are resident, so captures never show placeholders. With --null-render nothing is drawn
+// (see NullRenderBackend) and only CPU costs are measured.
+// A GL 3.3 context is still needed: on machines without a GPU, run under
+// Xvfb with Mesa's llvmpipe (LIBGL_ALWAYS_SOFTWARE=1).
+//   --headless --frames 600 --capture out.ppm --golden data/golden/level.ppm
+// --check-traversal needs no window or GL context: it fills RenderQueues as
+// traversal workers do, merges them and checks what NullRenderBackend records.
+namespace Headless {
+    struct Options {
+        bool enabled = false;
+        int frames = 300;
+        float dt = 1.0f / 60.0f; //fixed, so runs are reproducible
+        bool null_render = false;
+        bool check_traversal = false;
+        std::string capture; //PPM written with the last frame
+        std::string golden; //PPM compared with the last frame
+        std::string stats; //CSV with the RenderStats of every frame
+        int tolerance = 8; //per channel difference ignored
+        float max_different = 0.001f; //fraction of pixels allowed to differ
+    };
+
+    //frames run before the captured one while textures are still loading,
+    //before giving up
+    static const int MAX_SETTLE_FRAMES = 1000;
+
+    //reads --headless, --frames N, --dt S, --null-render, --check-traversal,
+    //--capture file, --golden file, --tolerance T, --stats file. Returns false, after printing the usage,
+    //for unknown arguments
+    bool parseArgs(int argc, char** argv, Options& options);
+
+    //RGB of the back buffer, top row first
+    void readFramebuffer(int width, int height, std::vector<unsigned char>& pixels);
+    bool writePPM(const std::string& path, int width, int height, const std::vector<unsigned char>& pixels);
+    bool readPPM(const std::string& path, int& width, int& height, std::vector<unsigned char>& pixels);
+    //fraction of pixels with a channel differing by more than tolerance. 1 if sizes differ
+    float compareImages(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b, int tolerance);
+
+    //merges synthetic per-worker queues into a command buffer, executes it with
+    //a NullRenderBackend and checks the draw order and the state change counts.
+    //Makes no GL calls. Returns the exit code of the program
+    int checkTraversal();
+
+    //runs the frames, prints timings and does the capture and comparison.
+    //Returns the exit code of the program
+    int run(Game& game, GLFWwindow* window, const Options& options);
+}
@@ -0,0 +1,201 @@
+#include "Profiler.h"
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+//weight of a new frame in the averages
+static const float kSmoothing = 0.05f;
+
+//zone as recorded during a frame
+struct ZoneRecord {
+    std::string name;
+    int depth;
+    Clock::time_point start;
+    float cpu_ms;
+    int query; //index in the queries of the frame, -1 without GPU time
+};
+
+struct FrameRecord {
+    std::vector<ZoneRecord> zones;
+    std::vector<GLuint> queries; //grows, reused every NUM_FRAMES frames
+    int num_queries = 0;
+    bool pending = false; //GPU results not read yet
+};
+
+static FrameRecord frames_[Profiler::NUM_FRAMES];
+static int frame_ = 0;
+static bool in_frame_ = false;
+static std::vector<int> open_zones_; //indices in the zones of the current frame
+
+static bool has_frame_start_ = false;
+static Clock::time_point frame_start_;
+static std::vector<float> frame_times_; //ring of HISTORY frames
+static int next_frame_time_ = 0;
+static float average_frame_ms_ = 0;
+static float gpu_frame_ms_ = -1;
+
+static std::unordered_map<std::string, Profiler::ZoneStats> stats_;
+static std::vector<Profiler::ZoneStats> zones_;
+static bool gpu_enabled_ = true;
+
+static float smooth(float average, float value) {
+    return average < 0 ? value : average + (value - average) * kSmoothing;
+}
+
+static float elapsedMs(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+//reads the GPU times of a frame if they are all available, drops them otherwise
+static void readGpuTimes(FrameRecord& frame) {
+    frame.pending = false;
+    GLint available = 0;
+    glGetQueryObjectiv(frame.queries[frame.num_queries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) return;
+
+    //a zone may appear more than once in a frame
+    std::unordered_map<std::string, float> gpu_ms;
+    float total = 0;
+    for (auto& zone : frame.zones) {
+        if (zone.query == -1) continue;
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(frame.queries[zone.query], GL_QUERY_RESULT, &ns);
+        gpu_ms[zone.name] += ns / 1000000.0f;
+        total += ns / 1000000.0f;
+    }
+    for (auto& it : gpu_ms) {
+        Profiler::ZoneStats& stats = stats_[it.first];
+        stats.gpu_ms = smooth(stats.gpu_ms, it.second);
+    }
+    gpu_frame_ms_ = smooth(gpu_frame_ms_, total);
+}
+
+void Profiler::beginFrame() {
+    Clock::time_point now = Clock::now();
+    if (has_frame_start_) {
+        float ms = elapsedMs(frame_start_, now);
+        if ((int)frame_times_.size() < HISTORY) frame_times_.push_back(ms);
+        else frame_times_[next_frame_time_] = ms;
+        next_frame_time_ = (next_frame_time_ + 1) % HISTORY;
+        average_frame_ms_ = average_frame_ms_ > 0 ? average_frame_ms_ + (ms - average_frame_ms_) * kSmoothing : ms;
+    }
+    has_frame_start_ = true;
+    frame_start_ = now;
+
+    //the frame in this slot was NUM_FRAMES frames ago
+    frame_ = (frame_ + 1) % NUM_FRAMES;
+    FrameRecord& frame = frames_[frame_];
+    if (frame.pending) readGpuTimes(frame);
+    frame.zones.clear();
+    frame.num_queries = 0;
+    open_zones_.clear();
+    in_frame_ = true;
+}
+
+void Profiler::endFrame() {
+    if (!in_frame_) return;
+    while (!open_zones_.empty()) endZone();
+    FrameRecord& frame = frames_[frame_];
+    frame.pending = frame.num_queries > 0;
+    in_frame_ = false;
+
+    //totals per name, in order of first appearance
+    std::vector<int> first;
+    std::unordered_map<std::string, float> cpu_ms;
+    for (size_t i = 0; i < frame.zones.size(); i++) {
+        if (!cpu_ms.count(frame.zones[i].name)) first.push_back((int)i);
+        cpu_ms[frame.zones[i].name] += frame.zones[i].cpu_ms;
+    }
+    zones_.clear();
+    for (int i : first) {
+        const ZoneRecord& zone = frame.zones[i];
+        ZoneStats& stats = stats_[zone.name];
+        if (stats.name.empty()) {
+            stats.name = zone.name;
+            stats.cpu_ms = -1;
+        }
+        stats.depth = zone.depth;
+        stats.cpu_ms = smooth(stats.cpu_ms, cpu_ms[zone.name]);
+        zones_.push_back(stats);
+    }
+}
+
+void Profiler::beginZone(const char* name) {
+    if (!in_frame_) return;
+    FrameRecord& frame = frames_[frame_];
+    ZoneRecord zone;
+    zone.name = name;
+    zone.depth = (int)open_zones_.size();
+    zone.cpu_ms = 0;
+    zone.query = -1;
+    //GL_TIME_ELAPSED queries can't nest, so only top level zones get one
+    if (zone.depth == 0 && isGpuEnabled()) {
+        if (frame.num_queries == (int)frame.queries.size()) {
+            GLuint query;
+            glGenQueries(1, &query);
+            frame.queries.push_back(query);
+        }
+        zone.query = frame.num_queries++;
+        glBeginQuery(GL_TIME_ELAPSED, frame.queries[zone.query]);
+    }
+    open_zones_.push_back((int)frame.zones.size());
+    frame.zones.push_back(zone);
+    frame.zones.back().start = Clock::now();
+}
+
+void Profiler::endZone() {
+    if (!in_frame_ || open_zones_.empty()) return;
+    ZoneRecord& zone = frames_[frame_].zones[open_zones_.back()];
+    open_zones_.pop_back();
+    zone.cpu_ms = elapsedMs(zone.start, Clock::now());
+    if (zone.query != -1) glEndQuery(GL_TIME_ELAPSED);
+}
+
+const std::vector<Profiler::ZoneStats>& Profiler::getZones() {
+    //GPU times arrive after the zone list was built
+    for (auto& zone : zones_)
+        zone.gpu_ms = stats_[zone.name].gpu_ms;
+    return zones_;
+}
+
+void Profiler::getFrameTimes(std::vector<float>& times) {
+    times.clear();
+    if ((int)frame_times_.size() < HISTORY) {
+        times = frame_times_;
+        return;
+    }
+    times.insert(times.end(), frame_times_.begin() + next_frame_time_, frame_times_.end());
+    times.insert(times.end(), frame_times_.begin(), frame_times_.begin() + next_frame_time_);
+}
+
+float Profiler::getAverageFrameMs() {
+    return average_frame_ms_;
+}
+
+float Profiler::getGpuFrameMs() {
+    return gpu_frame_ms_;
+}
+
+float Profiler::getLowFps(float fraction) {
+    if (frame_times_.empty()) return 0;
+    std::vector<float> sorted = frame_times_;
+    size_t count = std::max((size_t)1, (size_t)(sorted.size() * fraction));
+    std::partial_sort(sorted.begin(), sorted.begin() + count, sorted.end(), std::greater<float>());
+    float total = 0;
+    for (size_t i = 0; i < count; i++) total += sorted[i];
+    return total > 0 ? 1000.0f * count / total : 0;
+}
+
+bool Profiler::isGpuSupported() {
+    return GLEW_ARB_timer_query != 0;
+}
+
+void Profiler::setGpuEnabled(bool enabled) {
+    gpu_enabled_ = enabled;
+}
+
+bool Profiler::isGpuEnabled() {
+    return gpu_enabled_ && isGpuSupported();
+}
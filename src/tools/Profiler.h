@@ -0,0 +1,52 @@
+#pragma once
+#include "../includes.h"
+#include <string>
+#include <vector>
+
+// Frame profiler.
+// Zones time a scope of the main thread on the CPU and, if they are not
+// nested in another zone, on the GPU with a GL_TIME_ELAPSED query (such
+// queries can not nest). Query results are read NUM_FRAMES frames later, and
+// only if they are available, so the profiler never waits for the GPU.
+// Times are averaged per zone name, and the last frame times are kept for the
+// graph and the 1% / 0.1% lows shown by ProfilerModule.
+// Usage: { Profiler::Zone zone("scene"); ... }
+
+namespace Profiler {
+    static const int NUM_FRAMES = 3; //frames in flight before GPU results are read
+    static const int HISTORY = 1000; //frame times kept
+
+    //averaged times of a zone
+    struct ZoneStats {
+        std::string name;
+        int depth = 0;
+        float cpu_ms = 0;
+        float gpu_ms = -1; //-1 if the zone has no GPU time
+    };
+
+    //frame boundaries, around everything the main loop does
+    void beginFrame();
+    void endFrame();
+
+    void beginZone(const char* name);
+    void endZone();
+
+    struct Zone {
+        Zone(const char* name) { beginZone(name); }
+        ~Zone() { endZone(); }
+    };
+
+    //zones of the last frame, in order, with averaged times
+    const std::vector<ZoneStats>& getZones();
+    //time between frame starts, in ms, oldest first. At most HISTORY frames
+    void getFrameTimes(std::vector<float>& times);
+    float getAverageFrameMs();
+    float getGpuFrameMs(); //sum of top level GPU zones, averaged
+    //average fps of the slowest fraction of frames (0.01 for 1% lows)
+    float getLowFps(float fraction);
+
+    //GPU timing needs GL_ARB_timer_query
+    bool isGpuSupported();
+    void setGpuEnabled(bool enabled);
+    bool isGpuEnabled();
+}
@@ -0,0 +1,102 @@
+#include "ProfilerModule.h"
+#include "Profiler.h"
+#include "../render/RenderStats.h"
+#include "../extern.h"
+#include "../Game.h"
+#include <algorithm>
+
+void ProfilerModule::update(float dt)
+{
+    UpdateFrameTimes();
+    ImGui::Separator();
+    UpdateZones();
+    ImGui::Separator();
+    UpdateCounters();
+    ImGui::Separator();
+    UpdateRenderStats();
+}
+
+// Rolling graph of the last frames, with averages and lows
+void ProfilerModule::UpdateFrameTimes()
+{
+    float average_ms = Profiler::getAverageFrameMs();
+    ImGui::Text("Frame %.2f ms (%d fps)", average_ms, average_ms > 0 ? (int)(1000.0f / average_ms) : 0);
+    float gpu_ms = Profiler::getGpuFrameMs();
+    if (!Profiler::isGpuSupported()) ImGui::Text("GPU -- (no GL_ARB_timer_query)");
+    else if (gpu_ms >= 0) ImGui::Text("GPU %.2f ms", gpu_ms);
+    ImGui::Text("1%% low %d fps   0.1%% low %d fps", (int)Profiler::getLowFps(0.01f), (int)Profiler::getLowFps(0.001f));
+
+    Profiler::getFrameTimes(frame_times_);
+    if (frame_times_.empty()) return;
+    float max_ms = *std::max_element(frame_times_.begin(), frame_times_.end());
+    //scale in steps of 1/60 s, so the graph does not jump every frame
+    float scale = 16.6f;
+    while (scale < max_ms) scale *= 2.0f;
+    ImGui::PlotLines("##frame_times", frame_times_.data(), (int)frame_times_.size(), 0,
+                     nullptr, 0.0f, scale, ImVec2(ImGui::GetContentRegionAvailWidth(), 80));
+    ImGui::Text("0 - %.1f ms, %d frames", scale, (int)frame_times_.size());
+
+    bool gpu = Profiler::isGpuEnabled();
+    if (Profiler::isGpuSupported() && ImGui::Checkbox("GPU timing", &gpu))
+        Profiler::setGpuEnabled(gpu);
+}
+
+// Per zone breakdown. Only top level zones have GPU times
+void ProfilerModule::UpdateZones()
+{
+    ImGui::Columns(3, "zones");
+    ImGui::Text("Zone"); ImGui::NextColumn();
+    ImGui::Text("CPU ms"); ImGui::NextColumn();
+    ImGui::Text("GPU ms"); ImGui::NextColumn();
+    ImGui::Separator();
+    for (auto& zone : Profiler::getZones()) {
+        ImGui::Text("%*s%s", zone.depth * 2, "", zone.name.c_str()); ImGui::NextColumn();
+        ImGui::Text("%.3f", zone.cpu_ms); ImGui::NextColumn();
+        if (zone.gpu_ms >= 0) ImGui::Text("%.3f", zone.gpu_ms);
+        else ImGui::Text("-");
+        ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
+}
+
+// Draws, state changes and culling of the last frame
+void ProfilerModule::UpdateCounters()
+{
+    GraphicsSystem& graphics = Game::get().getGraphicsSystem();
+    const RenderBackendStats& stats = graphics.getBackend().stats;
+    ImGui::Text("Commands %d", stats.commands);
+    ImGui::Text("Draw calls %d (multi-draw %d)", stats.draw_calls, stats.multi_draw_calls);
+    ImGui::Text("Pipeline changes %d", stats.pipeline_changes);
+    ImGui::Text("Material changes %d", stats.material_changes);
+    ImGui::Text("Overdraw %.2f (depth pre-pass above %.2f)", graphics.getOverdraw(), graphics.depth_prepass_overdraw);
+    ImGui::Text("Render targets %d", (int)graphics.getRenderTargets().GetSize());
+}
+
+// GPU work of the last frame, one column per pass
+void ProfilerModule::UpdateRenderStats()
+{
+    const auto& passes = RenderStats::getPasses();
+    const RenderStats::PassStats& totals = RenderStats::getTotals();
+    ImGui::Columns((int)passes.size() + 2, "render_stats");
+    ImGui::Text("Counter"); ImGui::NextColumn();
+    for (auto& pass : passes) {
+        ImGui::Text("%s", pass.name.c_str()); ImGui::NextColumn();
+    }
+    ImGui::Text("total"); ImGui::NextColumn();
+    ImGui::Separator();
+    for (int c = 0; c < RenderStats::NUM_COUNTERS; c++) {
+        ImGui::Text("%s", RenderStats::getName((RenderStats::Counter)c)); ImGui::NextColumn();
+        for (auto& pass : passes) {
+            ImGui::Text("%lld", (long long)pass.counters[c]); ImGui::NextColumn();
+        }
+        ImGui::Text("%lld", (long long)totals.counters[c]); ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
+
+    if (RenderStats::isDumping()) {
+        if (ImGui::Button("Stop dump")) RenderStats::stopDump();
+    }
+    else if (ImGui::Button("Dump to render_stats.csv")) {
+        RenderStats::startDump("render_stats.csv");
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "../includes.h"
+#include <vector>
+
+// Profiler module
+// Editor panel showing where frame time goes, from the Profiler zones, the
+// counters of the graphics system and the RenderStats of each pass
+class ProfilerModule {
+public:
+
+    void update(float dt);
+
+private:
+
+    std::vector<float> frame_times_;
+
+    void UpdateFrameTimes();
+    void UpdateZones();
+    void UpdateCounters();
+    void UpdateRenderStats();
+};
@@ -0,0 +1,287 @@
+#include "TextureCooker.h"
+#include "../Parsers.h"
+#include "dirent.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+//565 colour from a float colour in [0, 255]
+static uint16_t packColor565(const float c[3]) {
+    int r = (int)std::min(31.0f, std::max(0.0f, c[0] * 31.0f / 255.0f + 0.5f));
+    int g = (int)std::min(63.0f, std::max(0.0f, c[1] * 63.0f / 255.0f + 0.5f));
+    int b = (int)std::min(31.0f, std::max(0.0f, c[2] * 31.0f / 255.0f + 0.5f));
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void unpackColor565(uint16_t c, float out[3]) {
+    out[0] = (float)((c >> 11) & 31) * 255.0f / 31.0f;
+    out[1] = (float)((c >> 5) & 63) * 255.0f / 63.0f;
+    out[2] = (float)(c & 31) * 255.0f / 31.0f;
+}
+
+//assigns each pixel to the nearest of the four palette colours of two endpoints.
+//Returns the 2 bit indices, and squared error in error
+static uint32_t bc1Indices(const float pixels[16][3], uint16_t c0, uint16_t c1, float& error) {
+    float palette[4][3];
+    unpackColor565(c0, palette[0]);
+    unpackColor565(c1, palette[1]);
+    for (int k = 0; k < 3; k++) {
+        palette[2][k] = (2.0f * palette[0][k] + palette[1][k]) / 3.0f;
+        palette[3][k] = (palette[0][k] + 2.0f * palette[1][k]) / 3.0f;
+    }
+    uint32_t indices = 0;
+    error = 0;
+    for (int i = 0; i < 16; i++) {
+        int best = 0;
+        float best_d = 1e30f;
+        for (int p = 0; p < 4; p++) {
+            float dr = pixels[i][0] - palette[p][0], dg = pixels[i][1] - palette[p][1], db = pixels[i][2] - palette[p][2];
+            float d = dr * dr + dg * dg + db * db;
+            if (d < best_d) { best_d = d; best = p; }
+        }
+        indices |= (uint32_t)best << (i * 2);
+        error += best_d;
+    }
+    return indices;
+}
+
+//endpoints a and b which best fit the pixels for the given indices (least squares)
+static bool fitEndpoints(const float pixels[16][3], uint32_t indices, float a[3], float b[3]) {
+    static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f }; //weight of endpoint a
+    float aa = 0, bb = 0, ab = 0, ax[3] = { 0, 0, 0 }, bx[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; i++) {
+        float w = weights[(indices >> (i * 2)) & 3];
+        aa += w * w;
+        bb += (1 - w) * (1 - w);
+        ab += w * (1 - w);
+        for (int k = 0; k < 3; k++) {
+            ax[k] += w * pixels[i][k];
+            bx[k] += (1 - w) * pixels[i][k];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if (fabsf(det) < 1e-6f) return false;
+    for (int k = 0; k < 3; k++) {
+        a[k] = (ax[k] * bb - bx[k] * ab) / det;
+        b[k] = (bx[k] * aa - ax[k] * ab) / det;
+    }
+    return true;
+}
+
+//BC1 block (always 4 colour mode, so it is also valid as the colour part of BC3)
+static void encodeBC1Block(const unsigned char rgba[16][4], unsigned char* out) {
+    float pixels[16][3];
+    float mean[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; i++)
+        for (int k = 0; k < 3; k++) {
+            pixels[i][k] = rgba[i][k];
+            mean[k] += pixels[i][k] / 16.0f;
+        }
+
+    //principal axis of the colours, by power iteration on the covariance
+    float cov[6] = { 0, 0, 0, 0, 0, 0 };
+    for (int i = 0; i < 16; i++) {
+        float r = pixels[i][0] - mean[0], g = pixels[i][1] - mean[1], b = pixels[i][2] - mean[2];
+        cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+        cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+    }
+    float axis[3] = { 1, 1, 1 };
+    for (int it = 0; it < 8; it++) {
+        float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        float len = std::max(fabsf(x), std::max(fabsf(y), fabsf(z)));
+        if (len < 1e-6f) break;
+        axis[0] = x / len; axis[1] = y / len; axis[2] = z / len;
+    }
+
+    //endpoints are the extremes of the projection on the axis
+    float min_t = 1e30f, max_t = -1e30f;
+    for (int i = 0; i < 16; i++) {
+        float t = (pixels[i][0] - mean[0]) * axis[0] + (pixels[i][1] - mean[1]) * axis[1] + (pixels[i][2] - mean[2]) * axis[2];
+        min_t = std::min(min_t, t);
+        max_t = std::max(max_t, t);
+    }
+    float axis_len2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    float a[3], b[3];
+    for (int k = 0; k < 3; k++) {
+        a[k] = mean[k] + axis[k] * max_t / std::max(axis_len2, 1e-6f);
+        b[k] = mean[k] + axis[k] * min_t / std::max(axis_len2, 1e-6f);
+    }
+
+    uint16_t c0 = packColor565(a), c1 = packColor565(b);
+    float error;
+    uint32_t indices = bc1Indices(pixels, std::max(c0, c1), std::min(c0, c1), error);
+
+    //one least squares refinement, kept if it lowers the error
+    float ra[3], rb[3];
+    if (fitEndpoints(pixels, indices, ra, rb)) {
+        uint16_t r0 = packColor565(ra), r1 = packColor565(rb);
+        float refined_error;
+        uint32_t refined = bc1Indices(pixels, std::max(r0, r1), std::min(r0, r1), refined_error);
+        if (refined_error < error) {
+            c0 = r0; c1 = r1; indices = refined;
+        }
+    }
+    if (c0 < c1) std::swap(c0, c1);
+    if (c0 == c1) indices = 0;
+    else indices = bc1Indices(pixels, c0, c1, error);
+
+    out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+    out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+    for (int i = 0; i < 4; i++) out[4 + i] = (indices >> (i * 8)) & 0xFF;
+}
+
+//BC4 block of one channel, in 8 value mode
+static void encodeBC4Block(const unsigned char rgba[16][4], int channel, unsigned char* out) {
+    int lo = 255, hi = 0;
+    for (int i = 0; i < 16; i++) {
+        lo = std::min(lo, (int)rgba[i][channel]);
+        hi = std::max(hi, (int)rgba[i][channel]);
+    }
+    out[0] = (unsigned char)hi;
+    out[1] = (unsigned char)lo;
+    uint64_t indices = 0;
+    if (hi > lo) {
+        //palette: hi, lo, then 6 values from hi to lo
+        int palette[8] = { hi, lo };
+        for (int p = 1; p < 7; p++) palette[p + 1] = ((7 - p) * hi + p * lo) / 7;
+        for (int i = 0; i < 16; i++) {
+            int v = rgba[i][channel], best = 0, best_d = 256;
+            for (int p = 0; p < 8; p++) {
+                int d = abs(v - palette[p]);
+                if (d < best_d) { best_d = d; best = p; }
+            }
+            indices |= (uint64_t)best << (i * 3);
+        }
+    }
+    for (int i = 0; i < 6; i++) out[2 + i] = (indices >> (i * 8)) & 0xFF;
+}
+
+//halves an RGBA image with a box filter
+static std::vector<unsigned char> downsample(const std::vector<unsigned char>& src, GLuint w, GLuint h) {
+    GLuint dw = std::max(1u, w / 2), dh = std::max(1u, h / 2);
+    std::vector<unsigned char> dst(dw * dh * 4);
+    for (GLuint y = 0; y < dh; y++) {
+        GLuint y0 = std::min(y * 2, h - 1), y1 = std::min(y * 2 + 1, h - 1);
+        for (GLuint x = 0; x < dw; x++) {
+            GLuint x0 = std::min(x * 2, w - 1), x1 = std::min(x * 2 + 1, w - 1);
+            for (int k = 0; k < 4; k++) {
+                int sum = src[(y0 * w + x0) * 4 + k] + src[(y0 * w + x1) * 4 + k] +
+                          src[(y1 * w + x0) * 4 + k] + src[(y1 * w + x1) * 4 + k];
+                dst[(y * dw + x) * 4 + k] = (unsigned char)((sum + 2) / 4);
+            }
+        }
+    }
+    return dst;
+}
+
+bool TextureCooker::compress(const unsigned char* rgba, GLuint width, GLuint height, GLenum format, CompressedImage& image) {
+    size_t block_bytes = compressedBlockBytes(format);
+    if (!block_bytes || !width || !height) return false;
+    image.format = format;
+    image.width = width;
+    image.height = height;
+    image.levels.clear();
+    image.data.clear();
+
+    std::vector<unsigned char> level(rgba, rgba + (size_t)width * height * 4);
+    GLuint w = width, h = height;
+    while (true) {
+        CompressedLevel info = { w, h, image.data.size(), compressedLevelSize(format, w, h) };
+        image.data.resize(info.offset + info.size);
+        unsigned char* out = &image.data[info.offset];
+
+        for (GLuint by = 0; by < h; by += 4) {
+            for (GLuint bx = 0; bx < w; bx += 4) {
+                //blocks crossing the edge repeat the last row and column
+                unsigned char block[16][4];
+                for (int i = 0; i < 16; i++) {
+                    GLuint x = std::min(bx + (i & 3), w - 1), y = std::min(by + (i >> 2), h - 1);
+                    memcpy(block[i], &level[(y * w + x) * 4], 4);
+                }
+                if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+                    encodeBC4Block(block, 3, out);
+                    encodeBC1Block(block, out + 8);
+                }
+                else if (format == GL_COMPRESSED_RG_RGTC2) {
+                    encodeBC4Block(block, 0, out);
+                    encodeBC4Block(block, 1, out + 8);
+                }
+                else {
+                    encodeBC1Block(block, out);
+                }
+                out += block_bytes;
+            }
+        }
+        image.levels.push_back(info);
+
+        if (w == 1 && h == 1) break;
+        level = downsample(level, w, h);
+        w = std::max(1u, w / 2);
+        h = std::max(1u, h / 2);
+    }
+    return true;
+}
+
+bool TextureCooker::cookTexture(const std::string& filename, CookFormat format) {
+    TGAInfo* tga = Parsers::loadTGA(filename);
+    if (!tga) return false;
+
+    //TGA stores BGR(A)
+    size_t num_pixels = (size_t)tga->width * tga->height;
+    int bytes_per_pixel = tga->bpp / 8;
+    std::vector<unsigned char> rgba(num_pixels * 4);
+    bool uses_alpha = false;
+    for (size_t i = 0; i < num_pixels; i++) {
+        const GLubyte* src = &tga->data[i * bytes_per_pixel];
+        rgba[i * 4 + 0] = src[2];
+        rgba[i * 4 + 1] = src[1];
+        rgba[i * 4 + 2] = src[0];
+        rgba[i * 4 + 3] = bytes_per_pixel == 4 ? src[3] : 255;
+        uses_alpha |= rgba[i * 4 + 3] != 255;
+    }
+    GLuint width = tga->width, height = tga->height;
+    free(tga->data);
+    delete tga;
+
+    if (format == COOK_AUTO) {
+        std::string lower = filename;
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+        if (lower.find("normal") != std::string::npos || lower.find("_nrm") != std::string::npos) format = COOK_BC5;
+        else format = uses_alpha ? COOK_BC3 : COOK_BC1;
+    }
+    GLenum gl_format = format == COOK_BC5 ? GL_COMPRESSED_RG_RGTC2 :
+                       format == COOK_BC3 ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+
+    CompressedImage image;
+    if (!compress(rgba.data(), width, height, gl_format, image)) return false;
+    std::string out_filename = filename.substr(0, filename.find_last_of('.')) + ".dds";
+    if (!saveDDS(out_filename, image)) {
+        std::cerr << "ERROR: Could not write " << out_filename << std::endl;
+        return false;
+    }
+    std::cout << "Cooked " << out_filename << ": " << (num_pixels * bytes_per_pixel) / 1024 << " KB -> "
+              << image.data.size() / 1024 << " KB with " << image.levels.size() << " mips" << std::endl;
+    return true;
+}
+
+int TextureCooker::cookDirectory(const std::string& directory, CookFormat format) {
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) return 0;
+    int cooked = 0;
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name == "." || name == "..") continue;
+        std::string path = directory + "/" + name;
+        if (entry->d_type == DT_DIR) {
+            cooked += cookDirectory(path, format);
+            continue;
+        }
+        std::string ext = name.size() > 4 ? name.substr(name.size() - 4) : "";
+        if ((ext == ".tga" || ext == ".TGA") && cookTexture(path, format)) cooked++;
+    }
+    closedir(dir);
+    return cooked;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "../render/CompressedTexture.h"
+
+// Texture cooker.
+// Offline conversion of TGA sources to block compressed DDS files, with the
+// full mip chain precomputed. The cooked file is written next to the source
+// with the same name and a .dds extension, and TextureStreamer loads it
+// instead of the TGA when it exists.
+// Encoder: BC1 endpoints come from the principal axis of the block colours,
+// refined once by least squares; BC4 blocks (alpha of BC3, both channels of
+// BC5) use the min and max of the block. Quality is below that of dedicated
+// encoders, but good enough for albedo textures and fast enough to cook a
+// level from the console.
+
+enum CookFormat {
+    COOK_AUTO, //BC5 for normal maps (name contains "normal" or "_nrm"), BC3 if alpha is used, BC1 otherwise
+    COOK_BC1,
+    COOK_BC3,
+    COOK_BC5
+};
+
+namespace TextureCooker {
+    //compresses an RGBA image and its mip chain into a BC1, BC3 or BC5 format
+    //- format: GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT or GL_COMPRESSED_RG_RGTC2
+    bool compress(const unsigned char* rgba, GLuint width, GLuint height, GLenum format, CompressedImage& image);
+
+    //cooks one TGA file. Returns false if it could not be read or written
+    bool cookTexture(const std::string& filename, CookFormat format = COOK_AUTO);
+    //cooks all TGA files in a directory and its subdirectories. Returns number of files cooked
+    int cookDirectory(const std::string& directory, CookFormat format = COOK_AUTO);
+}